@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "OsmStream.hpp"
+
+// What more than one benchmark needs
+
+// Keeps the whole file around with resolved node references, so the later stages can run on it again and again
+class Recorder : public OsmHandler
+{
+public:
+	struct Way {
+		NodeList nodes;
+		Tags tags;
+		bool area;
+	};
+
+	struct Relation {
+		uint64_t id;
+		Tags tags;
+		std::vector<NodeList> nodes;
+		std::vector<RelationMember> members;
+	};
+
+	void OnBounds(const osmp::Bounds& bounds) override
+	{
+		this->bounds = bounds;
+		hasBounds = true;
+	}
+
+	void OnNode(uint64_t id, double lon, double lat, const Tags& tags) override
+	{
+		nodes[id] = { id, lon, lat };
+	}
+
+	void OnWay(uint64_t id, const std::vector<uint64_t>& refs, const Tags& tags) override
+	{
+		if (refs.size() < 2)
+			return;
+
+		NodeList list;
+		for (uint64_t ref : refs)
+		{
+			auto it = nodes.find(ref);
+			if (it == nodes.end())
+				return;
+
+			list.push_back(it->second);
+		}
+
+		wayNodes[id] = list;
+		ways.push_back({ list, tags, refs.front() == refs.back() && GetTag(tags, "area") != "no" });
+	}
+
+	void OnRelation(uint64_t id, const std::vector<OsmMember>& members, const Tags& tags) override
+	{
+		if (GetTag(tags, "type") != "multipolygon")
+			return;
+
+		Relation relation = { id, tags };
+		std::vector<bool> inner;
+		for (const OsmMember& member : members)
+		{
+			if (member.type != 'w')
+				continue;
+
+			auto it = wayNodes.find(member.ref);
+			if (it == wayNodes.end())
+				return;
+
+			relation.nodes.push_back(it->second);
+			inner.push_back(member.role == "inner");
+		}
+
+		relations.push_back(std::move(relation));
+		relationInner.push_back(std::move(inner));
+	}
+
+	// The members point into the node lists, which only stop moving once everything is read
+	void Finish()
+	{
+		for (size_t i = 0; i < relations.size(); i++)
+		{
+			for (size_t j = 0; j < relations[i].nodes.size(); j++)
+				relations[i].members.push_back({ &relations[i].nodes[j], relationInner[i][j] });
+		}
+
+		if (!hasBounds)
+		{
+			bounds.minlat = 90.0;
+			bounds.minlon = 180.0;
+			bounds.maxlat = -90.0;
+			bounds.maxlon = -180.0;
+			for (const auto& node : nodes)
+			{
+				bounds.minlat = std::min(bounds.minlat, node.second.lat);
+				bounds.minlon = std::min(bounds.minlon, node.second.lon);
+				bounds.maxlat = std::max(bounds.maxlat, node.second.lat);
+				bounds.maxlon = std::max(bounds.maxlon, node.second.lon);
+			}
+		}
+	}
+
+	osmp::Bounds bounds = {};
+	std::vector<Way> ways;
+	std::vector<Relation> relations;
+
+private:
+	bool hasBounds = false;
+	std::unordered_map<uint64_t, NodeCoord> nodes;
+	std::unordered_map<uint64_t, NodeList> wayNodes;
+	std::vector<std::vector<bool>> relationInner;
+};
+
+// Windows paths are full of backslashes
+inline std::string JsonString(const std::string& text)
+{
+	std::string result = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			result += '\\';
+		result += c;
+	}
+
+	return result + "\"";
+}
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Writes OSM XML files with made up map data of a chosen shape and size, so the loader can be measured and
+// stress tested on inputs that grow in one direction at a time. The same seed always gives the same file
+
+#define PI 3.14159265358979323846
+
+// Where the generated map lies, a bit of Leipzig
+#define MIN_LON 12.30
+#define MIN_LAT 51.30
+#define MAX_LON 12.40
+#define MAX_LAT 51.37
+
+struct Options
+{
+	std::string scenario;
+	std::string output;
+	uint32_t seed = 1;
+	int count = -1;		// Multipolygons, buildings or streets per direction, depending on the scenario
+	int holes = -1;		// Inner rings per multipolygon
+	int nodes = -1;		// Nodes per ring, or per street between two crossings
+	int members = -1;	// Member ways every ring is split into
+};
+
+// Collects the elements first, the loader wants all nodes before the first way and all ways before the first relation
+class OsmWriter
+{
+public:
+	struct Member {
+		uint64_t way;
+		bool inner;
+	};
+
+	typedef std::vector<std::pair<std::string, std::string>> TagList;
+
+	uint64_t AddNode(double lon, double lat)
+	{
+		nodes.push_back({ lon, lat });
+		return nodes.size();
+	}
+
+	uint64_t AddWay(const std::vector<uint64_t>& refs, const TagList& tags)
+	{
+		ways.push_back({ refs, tags });
+		return ways.size();
+	}
+
+	void AddRelation(const std::vector<Member>& members, const TagList& tags)
+	{
+		relations.push_back({ members, tags });
+	}
+
+	bool Write(const std::string& path) const
+	{
+		std::ofstream file(path);
+		if (!file)
+			return false;
+
+		file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+		file << "<osm version=\"0.6\" generator=\"generate_osm\">\n";
+		file << "\t<bounds minlat=\"" << MIN_LAT << "\" minlon=\"" << MIN_LON << "\" maxlat=\"" << MAX_LAT << "\" maxlon=\"" << MAX_LON << "\"/>\n";
+
+		// Seven decimal places, like OSM stores them
+		char coords[64];
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			snprintf(coords, sizeof(coords), "lat=\"%.7f\" lon=\"%.7f\"", nodes[i].second, nodes[i].first);
+			file << "\t<node id=\"" << i + 1 << "\" " << coords << "/>\n";
+		}
+
+		for (size_t i = 0; i < ways.size(); i++)
+		{
+			file << "\t<way id=\"" << i + 1 << "\">\n";
+			for (uint64_t ref : ways[i].refs)
+				file << "\t\t<nd ref=\"" << ref << "\"/>\n";
+			WriteTags(file, ways[i].tags);
+			file << "\t</way>\n";
+		}
+
+		for (size_t i = 0; i < relations.size(); i++)
+		{
+			file << "\t<relation id=\"" << i + 1 << "\">\n";
+			for (const Member& member : relations[i].members)
+				file << "\t\t<member type=\"way\" ref=\"" << member.way << "\" role=\"" << (member.inner ? "inner" : "outer") << "\"/>\n";
+			WriteTags(file, relations[i].tags);
+			file << "\t</relation>\n";
+		}
+
+		file << "</osm>\n";
+		return (bool)file;
+	}
+
+	size_t Nodes() const { return nodes.size(); }
+	size_t Ways() const { return ways.size(); }
+	size_t Relations() const { return relations.size(); }
+
+private:
+	struct Way {
+		std::vector<uint64_t> refs;
+		TagList tags;
+	};
+
+	struct Relation {
+		std::vector<Member> members;
+		TagList tags;
+	};
+
+	static void WriteTags(std::ofstream& file, const TagList& tags)
+	{
+		for (const auto& tag : tags)
+			file << "\t\t<tag k=\"" << tag.first << "\" v=\"" << tag.second << "\"/>\n";
+	}
+
+	std::vector<std::pair<double, double>> nodes;	// Longitude and latitude
+	std::vector<Way> ways;
+	std::vector<Relation> relations;
+};
+
+// mt19937 gives the same numbers everywhere, the standard distributions don't. So they're done by hand
+class Random
+{
+public:
+	Random(uint32_t seed) : engine(seed) {}
+
+	double Uniform(double min, double max) { return min + (max - min) * (engine() / 4294967296.0); }
+	int Integer(int min, int max) { return min + (int)(engine() % (uint32_t)(max - min + 1)); }
+
+	template<typename T>
+	const T& Pick(const std::vector<T>& values) { return values[engine() % values.size()]; }
+
+	template<typename T>
+	void Shuffle(std::vector<T>& values)
+	{
+		for (size_t i = values.size(); i > 1; i--)
+			std::swap(values[i - 1], values[engine() % i]);
+	}
+
+private:
+	std::mt19937 engine;
+};
+
+// Splits the map into a grid of square cells, count of them filled row by row
+struct Grid
+{
+	int columns;
+	double cellLon, cellLat;
+
+	Grid(int count)
+	{
+		columns = std::max(1, (int)std::ceil(std::sqrt((double)count)));
+		cellLon = (MAX_LON - MIN_LON) / columns;
+		cellLat = (MAX_LAT - MIN_LAT) / columns;
+	}
+
+	double CenterLon(int i) const { return MIN_LON + (i % columns + 0.5) * cellLon; }
+	double CenterLat(int i) const { return MIN_LAT + (i / columns + 0.5) * cellLat; }
+};
+
+// Closed ring around the center with a wobbly outline. The points go around in order and never move further
+// than the given fraction of the radius, so the ring stays simple and inside radius * (1 + wobble)
+static std::vector<uint64_t> WobblyRing(OsmWriter& writer, Random& random, double lon, double lat, double radiusLon, double radiusLat, int nodes, double wobble)
+{
+	std::vector<uint64_t> ring;
+	for (int i = 0; i < nodes; i++)
+	{
+		double angle = 2.0 * PI * i / nodes;
+		double scale = 1.0 + random.Uniform(-wobble, wobble);
+		ring.push_back(writer.AddNode(lon + radiusLon * scale * std::cos(angle), lat + radiusLat * scale * std::sin(angle)));
+	}
+
+	ring.push_back(ring.front());
+	return ring;
+}
+
+// Cuts the closed ring into member ways that share their end nodes, in random order and direction,
+// so the loader has to join them back together
+static void AddRingMembers(OsmWriter& writer, Random& random, const std::vector<uint64_t>& ring, int pieces, bool inner, std::vector<OsmWriter::Member>& members)
+{
+	pieces = std::max(1, std::min(pieces, (int)ring.size() - 1));
+
+	std::vector<OsmWriter::Member> ringMembers;
+	for (int i = 0; i < pieces; i++)
+	{
+		size_t first = (ring.size() - 1) * i / pieces;
+		size_t last = (ring.size() - 1) * (i + 1) / pieces;
+		std::vector<uint64_t> refs(ring.begin() + first, ring.begin() + last + 1);
+		if (pieces > 1 && random.Integer(0, 1))
+			std::reverse(refs.begin(), refs.end());
+
+		ringMembers.push_back({ writer.AddWay(refs, {}), inner });
+	}
+
+	random.Shuffle(ringMembers);
+	members.insert(members.end(), ringMembers.begin(), ringMembers.end());
+}
+
+// Multipolygons with an outer ring around a grid of holes. Every ring has the same number of nodes
+static void GenerateMultipolygons(OsmWriter& writer, Random& random, int count, int holes, int nodes, int members)
+{
+	static const std::vector<std::pair<std::string, std::string>> kinds = {
+		{ "natural", "wood" }, { "natural", "water" }, { "landuse", "forest" }, { "landuse", "grass" }, { "landuse", "residential" }
+	};
+
+	Grid grid(count);
+	for (int i = 0; i < count; i++)
+	{
+		double lon = grid.CenterLon(i), lat = grid.CenterLat(i);
+		double radiusLon = 0.45 * grid.cellLon, radiusLat = 0.45 * grid.cellLat;
+
+		std::vector<OsmWriter::Member> relation;
+		AddRingMembers(writer, random, WobblyRing(writer, random, lon, lat, radiusLon, radiusLat, nodes, 0.02), members, false, relation);
+
+		// The holes fill the square inside the outer ring, with enough room between them that they never touch
+		int holeColumns = std::max(1, (int)std::ceil(std::sqrt((double)holes)));
+		double holeLon = 2.0 * 0.65 * radiusLon / holeColumns, holeLat = 2.0 * 0.65 * radiusLat / holeColumns;
+		for (int j = 0; j < holes; j++)
+		{
+			double centerLon = lon - 0.65 * radiusLon + (j % holeColumns + 0.5) * holeLon;
+			double centerLat = lat - 0.65 * radiusLat + (j / holeColumns + 0.5) * holeLat;
+			std::vector<uint64_t> ring = WobblyRing(writer, random, centerLon, centerLat, 0.3 * holeLon, 0.3 * holeLat, nodes, 0.1);
+			AddRingMembers(writer, random, ring, members, true, relation);
+		}
+
+		const auto& kind = random.Pick(kinds);
+		writer.AddRelation(relation, { { "type", "multipolygon" }, { kind.first, kind.second } });
+	}
+}
+
+// Rectangular buildings in rows, like a city center
+static void GenerateBuildings(OsmWriter& writer, Random& random, int count)
+{
+	Grid grid(count);
+	for (int i = 0; i < count; i++)
+	{
+		double lon = grid.CenterLon(i), lat = grid.CenterLat(i);
+		double halfLon = random.Uniform(0.2, 0.4) * grid.cellLon, halfLat = random.Uniform(0.2, 0.4) * grid.cellLat;
+
+		std::vector<uint64_t> refs = {
+			writer.AddNode(lon - halfLon, lat - halfLat),
+			writer.AddNode(lon + halfLon, lat - halfLat),
+			writer.AddNode(lon + halfLon, lat + halfLat),
+			writer.AddNode(lon - halfLon, lat + halfLat)
+		};
+		refs.push_back(refs.front());
+
+		writer.AddWay(refs, { { "building", "yes" } });
+	}
+}
+
+// A street grid where every street runs across the whole map as one way. Crossing streets share the node
+// they cross in, between two crossings a street bends through the given number of nodes
+static void GenerateHighways(OsmWriter& writer, Random& random, int streets, int nodes)
+{
+	static const std::vector<std::string> classes = { "primary", "secondary", "tertiary", "residential", "residential", "footway" };
+
+	double stepLon = (MAX_LON - MIN_LON) / (streets + 1), stepLat = (MAX_LAT - MIN_LAT) / (streets + 1);
+	std::vector<uint64_t> crossings(streets * streets);
+	for (int y = 0; y < streets; y++)
+	{
+		for (int x = 0; x < streets; x++)
+			crossings[y * streets + x] = writer.AddNode(MIN_LON + (x + 1) * stepLon, MIN_LAT + (y + 1) * stepLat);
+	}
+
+	// Bends stay closer to the street than the nodes along it are to each other, so streets only meet at the crossings
+	for (int vertical = 0; vertical < 2; vertical++)
+	{
+		for (int street = 0; street < streets; street++)
+		{
+			std::vector<uint64_t> refs;
+			for (int i = 0; i < streets; i++)
+			{
+				int crossing = vertical ? i * streets + street : street * streets + i;
+				refs.push_back(crossings[crossing]);
+				if (i + 1 == streets)
+					break;
+
+				for (int j = 1; j <= nodes; j++)
+				{
+					double along = (i + 1 + (double)j / (nodes + 1));
+					double offset = random.Uniform(-0.4, 0.4) / (nodes + 1);
+					if (vertical)
+						refs.push_back(writer.AddNode(MIN_LON + (street + 1 + offset) * stepLon, MIN_LAT + along * stepLat));
+					else
+						refs.push_back(writer.AddNode(MIN_LON + along * stepLon, MIN_LAT + (street + 1 + offset) * stepLat));
+				}
+			}
+
+			if (refs.size() >= 2)
+				writer.AddWay(refs, { { "highway", random.Pick(classes) } });
+		}
+	}
+}
+
+static void PrintUsage()
+{
+	std::cerr << "Usage: generate_osm <scenario> [--seed n] [--count n] [--holes n] [--nodes n] [--members n] output.osm\n"
+		"  holes      multipolygons with many inner rings        count 1, holes 256, nodes 32, members 1\n"
+		"  split      multipolygons with rings split into ways   count 1, holes 0, nodes 4096, members 64\n"
+		"  buildings  grid of closed building ways               count 10000\n"
+		"  highways   grid of long streets sharing crossings     count 50 streets per direction, nodes 8" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--seed" && i + 1 < argc)
+			options.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--count" && i + 1 < argc)
+			options.count = std::max(1, atoi(argv[++i]));
+		else if (arg == "--holes" && i + 1 < argc)
+			options.holes = std::max(0, atoi(argv[++i]));
+		else if (arg == "--nodes" && i + 1 < argc)
+			options.nodes = std::max(3, atoi(argv[++i]));
+		else if (arg == "--members" && i + 1 < argc)
+			options.members = std::max(1, atoi(argv[++i]));
+		else if (options.scenario.empty())
+			options.scenario = arg;
+		else
+			options.output = arg;
+	}
+
+	if (options.scenario.empty() || options.output.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// Options that weren't given fall back to the scenario's defaults
+	auto value = [](int option, int fallback) { return (option >= 0 ? option : fallback); };
+
+	OsmWriter writer;
+	Random random(options.seed);
+	if (options.scenario == "holes")
+		GenerateMultipolygons(writer, random, value(options.count, 1), value(options.holes, 256), value(options.nodes, 32), value(options.members, 1));
+	else if (options.scenario == "split")
+		GenerateMultipolygons(writer, random, value(options.count, 1), value(options.holes, 0), value(options.nodes, 4096), value(options.members, 64));
+	else if (options.scenario == "buildings")
+		GenerateBuildings(writer, random, value(options.count, 10000));
+	else if (options.scenario == "highways")
+		GenerateHighways(writer, random, value(options.count, 50), value(options.nodes, 8));
+	else
+	{
+		std::cerr << "Unknown scenario " << options.scenario << std::endl;
+		PrintUsage();
+		return 1;
+	}
+
+	if (!writer.Write(options.output))
+	{
+		std::cerr << "Failed to write " << options.output << std::endl;
+		return 1;
+	}
+
+	std::cout << "Wrote " << writer.Nodes() << " nodes, " << writer.Ways() << " ways and " << writer.Relations() << " relations to " << options.output << std::endl;
+	return 0;
+}
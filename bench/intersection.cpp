@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+#include "Intersection.hpp"
+
+// Simple ring with n nodes, a star shaped polygon with a wobbly outline like a forest boundary.
+// Simple rings are the worst case, every edge has to be looked at
+std::vector<Vector2d> StarRing(int n, std::mt19937& rng)
+{
+	std::uniform_real_distribution<double> radius(0.8, 1.0);
+
+	std::vector<Vector2d> ring;
+	for (int i = 0; i < n; i++)
+	{
+		double angle = 2.0 * 3.14159265358979 * i / n;
+		double r = radius(rng);
+		ring.push_back({ 13.0 + 0.1 * r * cos(angle), 51.0 + 0.1 * r * sin(angle) });
+	}
+
+	return ring;
+}
+
+template<typename Func>
+double Measure(Func func, bool& result)
+{
+	auto start = std::chrono::steady_clock::now();
+	result = func();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+	std::mt19937 rng(1337);
+
+	std::cout << std::setw(10) << "nodes" << std::setw(16) << "brute force ms" << std::setw(16) << "sweep line ms" << std::setw(12) << "speed-up" << std::endl;
+	for (int n : { 100, 1000, 4000, 16000, 64000, 256000 })
+	{
+		std::vector<Vector2d> ring = StarRing(n, rng);
+
+		bool sweepResult;
+		double sweep = Measure([&ring]() { return SelfIntersecting(ring); }, sweepResult);
+
+		// Anything bigger takes forever
+		std::cout << std::setw(10) << n;
+		if (n <= 16000)
+		{
+			bool bruteResult;
+			double brute = Measure([&ring]() { return SelfIntersectingBruteForce(ring); }, bruteResult);
+			if (bruteResult != sweepResult)
+			{
+				std::cerr << "Results differ for " << n << " nodes" << std::endl;
+				return 1;
+			}
+
+			std::cout << std::setw(16) << brute << std::setw(16) << sweep << std::setw(11) << brute / sweep << "x" << std::endl;
+		}
+		else
+		{
+			std::cout << std::setw(16) << "-" << std::setw(16) << sweep << std::setw(12) << "-" << std::endl;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "OsmStream.hpp"
+#include "OsmPbf.hpp"
+#include "MapBuilder.hpp"
+#include "RingAssembly.hpp"
+#include "Style.hpp"
+#include "BenchCommon.hpp"
+
+// Times every stage of loading a map on its own, so changes to one of them can be compared between commits.
+// Stages run one after the other on a single thread, every stage is repeated and the median run counts
+
+// Every operator new in the process goes through here. Triangle allocates with malloc, that isn't counted
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = malloc(std::max<size_t>(size, 1)))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+struct Stage
+{
+	std::string name;
+	std::string unit;	// What the items are
+	size_t items = 0;
+	std::vector<double> seconds;
+	std::vector<size_t> allocations;
+
+	double Seconds() const { return Median(seconds); }
+	size_t Allocations() const { return (size_t)Median(std::vector<double>(allocations.begin(), allocations.end())); }
+
+	static double Median(std::vector<double> values)
+	{
+		std::sort(values.begin(), values.end());
+		return values.empty() ? 0.0 : values[values.size() / 2];
+	}
+};
+
+// Measures one run of a stage that is done in one go
+class Timer
+{
+public:
+	Timer(Stage& stage) :
+		stage(stage), allocationsBefore(allocations.load()), start(std::chrono::steady_clock::now())
+	{
+	}
+
+	~Timer()
+	{
+		// Read before pushing, which might allocate itself
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		size_t count = allocations.load() - allocationsBefore;
+		stage.seconds.push_back(seconds);
+		stage.allocations.push_back(count);
+	}
+
+private:
+	Stage& stage;
+	size_t allocationsBefore;
+	std::chrono::steady_clock::time_point start;
+};
+
+// Adds up a stage that is done a little at a time, like once per multipolygon
+class Accumulator
+{
+public:
+	template<typename Func>
+	void Measure(Func func)
+	{
+		size_t allocationsBefore = allocations.load();
+		auto start = std::chrono::steady_clock::now();
+		func();
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		count += allocations.load() - allocationsBefore;
+	}
+
+	void Finish(Stage& stage)
+	{
+		stage.seconds.push_back(seconds);
+		stage.allocations.push_back(count);
+		seconds = 0.0;
+		count = 0;
+	}
+
+private:
+	double seconds = 0.0;
+	size_t count = 0;
+};
+
+// Only counts the elements, so the parse stage measures the parser and nothing else
+class NullHandler : public OsmHandler
+{
+public:
+	void OnNode(uint64_t id, double lon, double lat, const Tags& tags) override { elements++; }
+	void OnWay(uint64_t id, const std::vector<uint64_t>& refs, const Tags& tags) override { elements++; }
+	void OnRelation(uint64_t id, const std::vector<OsmMember>& members, const Tags& tags) override { elements++; }
+
+	size_t elements = 0;
+};
+
+// PBF files are decoded on all cores like the viewer does, XML is read on the calling thread
+static bool Parse(const std::string& input, OsmHandler& handler, ThreadPool& decoders)
+{
+	return IsOsmPbf(input) ? StreamOsmPbf(input, handler, decoders) : StreamOsm(input, handler);
+}
+
+static void WriteJson(const std::string& path, const std::string& input, int runs, const std::vector<Stage>& stages)
+{
+	std::ofstream file(path);
+	file << std::setprecision(9);
+	file << "{\n";
+	file << "\t\"input\": " << JsonString(input) << ",\n";
+	file << "\t\"runs\": " << runs << ",\n";
+	file << "\t\"stages\": [\n";
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		const Stage& stage = stages[i];
+		file << "\t\t{ \"name\": \"" << stage.name << "\", \"seconds\": " << stage.Seconds() << ", \"items\": " << stage.items
+			<< ", \"unit\": \"" << stage.unit << "\", \"items_per_second\": " << stage.items / std::max(stage.Seconds(), 1e-9)
+			<< ", \"allocations\": " << stage.Allocations() << " }" << (i + 1 < stages.size() ? "," : "") << "\n";
+	}
+	file << "\t]\n";
+	file << "}\n";
+
+	if (!file)
+		std::cerr << "Failed to write " << path << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	// bench_load [--runs n] [--json results.json] [--style style.txt] file.osm|file.osm.pbf
+	std::string input, jsonPath, stylePath;
+	int runs = 5;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--runs" && i + 1 < argc)
+			runs = std::max(1, atoi(argv[++i]));
+		else if (arg == "--json" && i + 1 < argc)
+			jsonPath = argv[++i];
+		else if (arg == "--style" && i + 1 < argc)
+			stylePath = argv[++i];
+		else
+			input = arg;
+	}
+
+	if (input.empty())
+	{
+		std::cerr << "Usage: bench_load [--runs n] [--json results.json] [--style style.txt] file.osm|file.osm.pbf" << std::endl;
+		return 1;
+	}
+
+	StyleTable style;
+	if (!stylePath.empty() && !style.Load(stylePath))
+		return 1;
+
+	ThreadPool decoders;
+	Recorder recorder;
+	if (!Parse(input, recorder, decoders))
+	{
+		std::cerr << "Failed to load " << input << std::endl;
+		return 1;
+	}
+	recorder.Finish();
+	World world(recorder.bounds);
+
+	enum { PARSE, STYLE, CLASSIFY, ASSIGN_RINGS, GROUP_RINGS, EARCUT, DUPLICATES, TRIANGULATE, STAGE_COUNT };
+	std::vector<Stage> stages(STAGE_COUNT);
+	stages[PARSE] = { "parse", "elements" };
+	stages[STYLE] = { "style", "features" };
+	stages[CLASSIFY] = { "classify", "ways" };
+	stages[ASSIGN_RINGS] = { "assign_rings", "relations" };
+	stages[GROUP_RINGS] = { "group_rings", "rings" };
+	stages[EARCUT] = { "earcut", "triangles" };
+	stages[DUPLICATES] = { "duplicates", "vertices" };
+	stages[TRIANGULATE] = { "triangulate", "triangles" };
+
+	// Nothing in here uses the pool, the builder just needs one
+	ThreadPool pool(1);
+
+	for (int run = 0; run < runs; run++)
+	{
+		{
+			NullHandler handler;
+			Timer timer(stages[PARSE]);
+			Parse(input, handler, decoders);
+			stages[PARSE].items = handler.elements;
+		}
+
+		{
+			Timer timer(stages[STYLE]);
+			for (const Recorder::Way& way : recorder.ways)
+			{
+				Style wayStyle = { 0, 0, 0, Style::FILL, true };
+				style.Resolve(way.area ? StyleTable::AREA : StyleTable::LINE, way.tags, wayStyle);
+			}
+
+			for (const Recorder::Relation& relation : recorder.relations)
+			{
+				Style relationStyle = { 255, 0, 255, Style::FILL, true };
+				style.Resolve(StyleTable::MULTIPOLYGON, relation.tags, relationStyle);
+			}
+
+			stages[STYLE].items = recorder.ways.size() + recorder.relations.size();
+		}
+
+		{
+			std::vector<Multipolygon> multipolygons;
+			std::vector<Area> buildings;
+			std::vector<Highway> highways;
+			GeometryStore geometry;
+			MapBuilder builder(multipolygons, buildings, highways, geometry, style, pool);
+			builder.SetBounds(recorder.bounds);
+
+			Timer timer(stages[CLASSIFY]);
+			for (const Recorder::Way& way : recorder.ways)
+				builder.AddWay(way.nodes, way.tags, way.area);
+
+			stages[CLASSIFY].items = recorder.ways.size();
+		}
+
+		// Every multipolygon goes through all of its stages before the next one, like it does when loading
+		Accumulator assign, group, earcut, duplicates, triangulation;
+		size_t rings = 0, clipped = 0, vertices = 0, triangles = 0;
+		for (const Recorder::Relation& relation : recorder.relations)
+		{
+			ScratchScope scope;
+			ScratchVector<Ring> relationRings;
+			assign.Measure([&]() { AssignRings(relationRings, relation.members); });
+			rings += relationRings.size();
+
+			ScratchVector<RingGroup> ringGroups;
+			group.Measure([&]() { GroupRings(ringGroups, relationRings); });
+
+			for (const RingGroup& ringGroup : ringGroups)
+			{
+				TriangulationData td;
+				PrepareTriangulation(ringGroup, world, td);
+				if (td.vertices.size() < 6 || td.segments.size() < 6)
+					continue;
+
+				// Failed attempts count towards the ear clipping stage, the groups that fall back to Triangle go on from there
+				ScratchVector<Vector2d> points;
+				ScratchVector<int> groupTriangles;
+				bool simple;
+				earcut.Measure([&]() { simple = TriangulateWithEarcut(td, points, groupTriangles); });
+				if (simple)
+				{
+					clipped += groupTriangles.size() / 3;
+					continue;
+				}
+
+				vertices += td.vertices.size() / 2;
+				duplicates.Measure([&]() { MergeDuplicateVertices(td); });
+				if (td.vertices.size() < 6 || td.segments.size() < 6)
+					continue;
+
+				triangulation.Measure([&]() { TriangulateWithTriangle(td, points, groupTriangles); });
+				triangles += groupTriangles.size() / 3;
+			}
+		}
+
+		assign.Finish(stages[ASSIGN_RINGS]);
+		group.Finish(stages[GROUP_RINGS]);
+		earcut.Finish(stages[EARCUT]);
+		duplicates.Finish(stages[DUPLICATES]);
+		triangulation.Finish(stages[TRIANGULATE]);
+		stages[ASSIGN_RINGS].items = recorder.relations.size();
+		stages[GROUP_RINGS].items = rings;
+		stages[EARCUT].items = clipped;
+		stages[DUPLICATES].items = vertices;
+		stages[TRIANGULATE].items = triangles;
+	}
+
+	std::cout << input << ", median of " << runs << " runs" << std::endl;
+	std::cout << std::setw(14) << "stage" << std::setw(12) << "ms" << std::setw(12) << "items" << std::setw(14) << "items/s" << std::setw(14) << "allocations" << std::endl;
+	for (const Stage& stage : stages)
+	{
+		std::cout << std::setw(14) << stage.name << std::setw(12) << std::fixed << std::setprecision(3) << stage.Seconds() * 1000.0
+			<< std::setw(12) << stage.items << std::setw(14) << std::setprecision(0) << stage.items / std::max(stage.Seconds(), 1e-9)
+			<< std::setw(14) << stage.Allocations() << std::defaultfloat << std::endl;
+	}
+
+	if (!jsonPath.empty())
+		WriteJson(jsonPath, input, runs, stages);
+
+	return 0;
+}
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "OsmStream.hpp"
+#include "RingAssembly.hpp"
+#include "BenchCommon.hpp"
+
+// Ear clipping against Triangle on the polygons of a real map, every ring group of every multipolygon and every
+// building outline. Groups are bucketed by their number of points, both ways run over the same groups and the
+// median run counts. "automatic" is what loading does: ear clipping first, Triangle for the groups it won't take
+
+// A ring group ready to triangulate, copied into the scratch arena before every run
+struct Group {
+	std::vector<REAL> vertices, holes;
+	std::vector<int> segments, rings;
+};
+
+struct Bucket {
+	const char* name;
+	size_t maxPoints;
+	std::vector<Group> groups;
+	size_t clipped = 0;	// Groups ear clipping took
+	std::vector<double> triangle, automatic;
+};
+
+static double Median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	return values.empty() ? 0.0 : values[values.size() / 2];
+}
+
+static void AddGroup(const RingGroup& ringGroup, const World& world, std::vector<Bucket>& buckets)
+{
+	TriangulationData td;
+	PrepareTriangulation(ringGroup, world, td);
+	if (td.vertices.size() < 6 || td.segments.size() < 6)
+		return;
+
+	size_t points = td.vertices.size() / 2;
+	Bucket& bucket = *std::find_if(buckets.begin(), buckets.end(), [points](const Bucket& bucket) { return points <= bucket.maxPoints; });
+	bucket.groups.push_back({ { td.vertices.begin(), td.vertices.end() }, { td.holes.begin(), td.holes.end() },
+		{ td.segments.begin(), td.segments.end() }, { td.rings.begin(), td.rings.end() } });
+}
+
+static void Fill(const Group& group, TriangulationData& td)
+{
+	td.vertices.assign(group.vertices.begin(), group.vertices.end());
+	td.holes.assign(group.holes.begin(), group.holes.end());
+	td.segments.assign(group.segments.begin(), group.segments.end());
+	td.rings.assign(group.rings.begin(), group.rings.end());
+}
+
+// The way loading did it before ear clipping
+static void TriangleOnly(const Group& group)
+{
+	ScratchScope scope;
+	TriangulationData td;
+	Fill(group, td);
+
+	ScratchVector<Vector2d> points;
+	ScratchVector<int> triangles;
+	MergeDuplicateVertices(td);
+	if (td.vertices.size() >= 6 && td.segments.size() >= 6)
+		TriangulateWithTriangle(td, points, triangles);
+}
+
+static bool Automatic(const Group& group)
+{
+	ScratchScope scope;
+	TriangulationData td;
+	Fill(group, td);
+
+	ScratchVector<Vector2d> points;
+	ScratchVector<int> triangles;
+	if (TriangulateWithEarcut(td, points, triangles))
+		return true;
+
+	MergeDuplicateVertices(td);
+	if (td.vertices.size() >= 6 && td.segments.size() >= 6)
+		TriangulateWithTriangle(td, points, triangles);
+
+	return false;
+}
+
+template<typename Func>
+static double Measure(Func func)
+{
+	auto start = std::chrono::steady_clock::now();
+	func();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void WriteJson(const std::string& path, const std::string& input, int runs, const std::vector<Bucket>& buckets)
+{
+	std::ofstream file(path);
+	file << std::setprecision(9);
+	file << "{\n";
+	file << "\t\"input\": " << JsonString(input) << ",\n";
+	file << "\t\"runs\": " << runs << ",\n";
+	file << "\t\"buckets\": [\n";
+	for (size_t i = 0; i < buckets.size(); i++)
+	{
+		const Bucket& bucket = buckets[i];
+		file << "\t\t{ \"name\": \"" << bucket.name << "\", \"groups\": " << bucket.groups.size() << ", \"earcut_groups\": " << bucket.clipped
+			<< ", \"triangle_seconds\": " << Median(bucket.triangle) << ", \"automatic_seconds\": " << Median(bucket.automatic) << " }"
+			<< (i + 1 < buckets.size() ? "," : "") << "\n";
+	}
+	file << "\t]\n";
+	file << "}\n";
+
+	if (!file)
+		std::cerr << "Failed to write " << path << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	// bench_triangulate [--runs n] [--json results.json] file.osm
+	std::string input, jsonPath;
+	int runs = 5;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--runs" && i + 1 < argc)
+			runs = std::max(1, atoi(argv[++i]));
+		else if (arg == "--json" && i + 1 < argc)
+			jsonPath = argv[++i];
+		else
+			input = arg;
+	}
+
+	if (input.empty())
+	{
+		std::cerr << "Usage: bench_triangulate [--runs n] [--json results.json] file.osm" << std::endl;
+		return 1;
+	}
+
+	Recorder recorder;
+	if (!StreamOsm(input, recorder))
+	{
+		std::cerr << "Failed to load " << input << std::endl;
+		return 1;
+	}
+	recorder.Finish();
+	World world(recorder.bounds);
+
+	std::vector<Bucket> buckets = {
+		{ "3-20", 20 },
+		{ "21-100", 100 },
+		{ "101-1000", 1000 },
+		{ "1001+", SIZE_MAX }
+	};
+
+	for (const Recorder::Relation& relation : recorder.relations)
+	{
+		ScratchScope scope;
+		ScratchVector<Ring> rings;
+		if (!AssignRings(rings, relation.members))
+			continue;
+
+		ScratchVector<RingGroup> ringGroups;
+		GroupRings(ringGroups, rings);
+		for (const RingGroup& ringGroup : ringGroups)
+			AddGroup(ringGroup, world, buckets);
+	}
+
+	size_t relationGroups = 0;
+	for (const Bucket& bucket : buckets)
+		relationGroups += bucket.groups.size();
+
+	// Buildings are single rings, the closing node is left out like ring assembly does
+	for (const Recorder::Way& way : recorder.ways)
+	{
+		if (!way.area || GetTag(way.tags, "building").empty())
+			continue;
+
+		ScratchScope scope;
+		RingGroup ringGroup;
+		ringGroup.rings.push_back({ ScratchVector<NodeCoord>(way.nodes.begin(), way.nodes.end() - 1), false, 0 });
+		AddGroup(ringGroup, world, buckets);
+	}
+
+	for (int run = 0; run < runs; run++)
+	{
+		for (Bucket& bucket : buckets)
+		{
+			bucket.triangle.push_back(Measure([&bucket]() {
+				for (const Group& group : bucket.groups)
+					TriangleOnly(group);
+			}));
+
+			size_t clipped = 0;
+			bucket.automatic.push_back(Measure([&bucket, &clipped]() {
+				for (const Group& group : bucket.groups)
+					clipped += Automatic(group);
+			}));
+			bucket.clipped = clipped;
+		}
+	}
+
+	size_t allGroups = 0;
+	for (const Bucket& bucket : buckets)
+		allGroups += bucket.groups.size();
+
+	std::cout << input << ", " << relationGroups << " multipolygon ring groups and " << allGroups - relationGroups << " buildings, median of "
+		<< runs << " runs" << std::endl;
+	std::cout << std::setw(10) << "points" << std::setw(10) << "groups" << std::setw(10) << "earcut" << std::setw(14) << "triangle ms"
+		<< std::setw(14) << "automatic ms" << std::setw(12) << "speed-up" << std::endl;
+
+	double triangleTotal = 0.0, automaticTotal = 0.0;
+	size_t clipped = 0;
+	auto row = [](const std::string& name, size_t groups, size_t clipped, double triangle, double automatic) {
+		std::cout << std::setw(10) << name << std::setw(10) << groups << std::setw(9) << std::fixed << std::setprecision(1)
+			<< 100.0 * clipped / std::max<size_t>(groups, 1) << "%" << std::setprecision(3) << std::setw(14) << triangle * 1000.0
+			<< std::setw(14) << automatic * 1000.0 << std::setprecision(2);
+
+		// Empty buckets only time the loop
+		if (groups > 0)
+			std::cout << std::setw(11) << triangle / std::max(automatic, 1e-9) << "x";
+		else
+			std::cout << std::setw(12) << "-";
+		std::cout << std::defaultfloat << std::endl;
+	};
+
+	for (const Bucket& bucket : buckets)
+	{
+		row(bucket.name, bucket.groups.size(), bucket.clipped, Median(bucket.triangle), Median(bucket.automatic));
+		triangleTotal += Median(bucket.triangle);
+		automaticTotal += Median(bucket.automatic);
+		clipped += bucket.clipped;
+	}
+	row("all", allGroups, clipped, triangleTotal, automaticTotal);
+
+	if (!jsonPath.empty())
+		WriteJson(jsonPath, input, runs, buckets);
+
+	return 0;
+}
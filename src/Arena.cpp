@@ -0,0 +1,54 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+
+Arena::Arena(size_t blockSize) :
+	blockSize(blockSize)
+{
+}
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+	size = std::max<size_t>(size, 1);
+	while (true)
+	{
+		if (current < blocks.size())
+		{
+			Block& block = blocks[current];
+			uintptr_t start = (uintptr_t)block.memory.get();
+			size_t offset = ((start + used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - start;
+			if (offset + size <= block.size)
+			{
+				used = offset + size;
+				return block.memory.get() + offset;
+			}
+
+			// Blocks given back by a rewind are reused in order, one that's too small is skipped
+			if (current + 1 < blocks.size())
+			{
+				current++;
+				used = 0;
+				continue;
+			}
+		}
+
+		// Allocations bigger than a block get a block of their own
+		size_t newSize = std::max(blockSize, size + alignment);
+		blocks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[newSize]), newSize });
+		capacity += newSize;
+		current = blocks.size() - 1;
+		used = 0;
+	}
+}
+
+void Arena::Rewind(const Mark& mark)
+{
+	current = mark.block;
+	used = mark.used;
+}
+
+Arena& Scratch()
+{
+	static thread_local Arena scratch;
+	return scratch;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bump allocator. Memory is only ever given back all at once, or everything allocated after a mark.
+// Blocks never move, so nothing allocated from an arena moves either
+class Arena
+{
+public:
+	struct Mark {
+		size_t block, used;
+	};
+
+public:
+	Arena(size_t blockSize = 64 * 1024);
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* Allocate(size_t size, size_t alignment);
+
+	template<typename T>
+	T* Allocate(size_t count) { return (T*)Allocate(count * sizeof(T), alignof(T)); }
+
+	// Everything allocated after the mark is given back, the blocks are kept around for next time
+	Mark Position() const { return { current, used }; }
+	void Rewind(const Mark& mark);
+
+	size_t Capacity() const { return capacity; }	// Size of all blocks together
+
+private:
+	struct Block {
+		std::unique_ptr<uint8_t[]> memory;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t blockSize;
+	size_t current = 0, used = 0;	// Block being filled and how much of it is used
+	size_t capacity = 0;
+};
+
+// Scratch memory of the calling thread, for temporaries that don't outlive a ScratchScope
+Arena& Scratch();
+
+// Gives back everything allocated from the thread's scratch arena while it was alive. Containers from outside
+// must not grow inside a scope, their new memory would be gone once it ends
+class ScratchScope
+{
+public:
+	ScratchScope() : mark(Scratch().Position()) {}
+	~ScratchScope() { Scratch().Rewind(mark); }
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+private:
+	Arena::Mark mark;
+};
+
+// Lets standard containers live in the thread's scratch arena. Freeing does nothing, the scope takes care of that
+template<typename T>
+struct ScratchAllocator
+{
+	typedef T value_type;
+
+	ScratchAllocator() = default;
+
+	template<typename U>
+	ScratchAllocator(const ScratchAllocator<U>&) {}
+
+	T* allocate(size_t count) { return Scratch().Allocate<T>(count); }
+	void deallocate(T*, size_t) {}
+
+	template<typename U>
+	bool operator==(const ScratchAllocator<U>&) const { return true; }
+
+	template<typename U>
+	bool operator!=(const ScratchAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using ScratchVector = std::vector<T, ScratchAllocator<T>>;
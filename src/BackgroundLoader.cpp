@@ -0,0 +1,38 @@
+#include "BackgroundLoader.hpp"
+
+#include "Trace.hpp"
+
+BackgroundLoader::~BackgroundLoader()
+{
+	if (thread.joinable())
+		thread.join();
+}
+
+void BackgroundLoader::Start(Load load)
+{
+	thread = std::thread([this, load]() {
+		Trace::SetThreadName("Loader");
+		succeeded = load(*this);
+		done.store(true, std::memory_order_release);
+	});
+}
+
+void BackgroundLoader::Publish(std::shared_ptr<MapArena> arena, bool complete)
+{
+	queue.Push({ std::move(arena), complete });
+}
+
+bool BackgroundLoader::Poll(std::shared_ptr<MapArena>& arena, bool& complete)
+{
+	// Arenas that were replaced before they were ever drawn are skipped
+	bool found = false;
+	Snapshot snapshot;
+	while (queue.Pop(snapshot))
+	{
+		arena = std::move(snapshot.arena);
+		complete = snapshot.complete;
+		found = true;
+	}
+
+	return found;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "HandoffQueue.hpp"
+#include "MapArena.hpp"
+
+// Runs the load on a thread of its own, so the window opens and draws right away instead of after the whole load.
+// The load publishes arenas as it goes, they reach the render thread through a lock free queue and the render
+// thread picks up the newest one between two frames
+class BackgroundLoader
+{
+public:
+	// Returns false if loading failed
+	typedef std::function<bool(BackgroundLoader& loader)> Load;
+
+	BackgroundLoader() = default;
+	~BackgroundLoader();	// Waits for the load to finish
+
+	BackgroundLoader(const BackgroundLoader&) = delete;
+	BackgroundLoader& operator=(const BackgroundLoader&) = delete;
+
+	void Start(Load load);
+
+	// From the load's thread. The arena isn't changed anymore after this, the last one is complete
+	void Publish(std::shared_ptr<MapArena> arena, bool complete);
+
+	// From the render thread, the newest arena published since the last call. False if there's none
+	bool Poll(std::shared_ptr<MapArena>& arena, bool& complete);
+
+	// Once the load returned everything it published can be polled, and nothing else touches the map anymore
+	bool Done() const { return done.load(std::memory_order_acquire); }
+	bool Failed() const { return Done() && !succeeded; }
+
+private:
+	struct Snapshot {
+		std::shared_ptr<MapArena> arena;
+		bool complete = false;
+	};
+
+	std::thread thread;
+	HandoffQueue<Snapshot> queue;
+	std::atomic<bool> done{ false };
+	bool succeeded = false;
+};
@@ -0,0 +1,50 @@
+#include "Camera.hpp"
+
+#include <algorithm>
+
+#define MIN_SCALE 1e-6
+#define MAX_SCALE 1e3
+
+Camera::Camera(int width, int height) :
+	centerX(0.0), centerY(0.0), scale(1.0), width(std::max(1, width)), height(std::max(1, height))
+{
+}
+
+void Camera::Fit(const Box& world)
+{
+	centerX = (world.minX + world.maxX) / 2.0;
+	centerY = (world.minY + world.maxY) / 2.0;
+
+	double worldWidth = std::max(world.maxX - world.minX, 1e-9);
+	double worldHeight = std::max(world.maxY - world.minY, 1e-9);
+	scale = std::clamp(std::min(width / worldWidth, height / worldHeight), MIN_SCALE, MAX_SCALE);
+}
+
+void Camera::Pan(double dx, double dy)
+{
+	centerX -= dx / scale;
+	centerY -= dy / scale;
+}
+
+void Camera::Zoom(double factor, double x, double y)
+{
+	// World position under the cursor before and after has to be the same
+	double worldX = centerX + (x - width / 2.0) / scale;
+	double worldY = centerY + (y - height / 2.0) / scale;
+
+	scale = std::clamp(scale * factor, MIN_SCALE, MAX_SCALE);
+	centerX = worldX - (x - width / 2.0) / scale;
+	centerY = worldY - (y - height / 2.0) / scale;
+}
+
+void Camera::Resize(int width, int height)
+{
+	this->width = std::max(1, width);
+	this->height = std::max(1, height);
+}
+
+Box Camera::View() const
+{
+	double halfWidth = width / 2.0 / scale, halfHeight = height / 2.0 / scale;
+	return { centerX - halfWidth, centerY - halfHeight, centerX + halfWidth, centerY + halfHeight };
+}
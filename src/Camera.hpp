@@ -0,0 +1,33 @@
+#pragma once
+
+#include "SpatialIndex.hpp"
+
+// Decides which part of world space ends up in a viewport of the given size in pixels.
+// Panning, zooming and resizing only change a handful of numbers, the geometry stays as it is
+class Camera
+{
+public:
+	Camera(int width, int height);
+
+	// Centers the box and zooms so all of it is visible
+	void Fit(const Box& world);
+
+	// Moves the view along with a cursor that moved by dx, dy pixels
+	void Pan(double dx, double dy);
+
+	// Zooms in by the factor, keeping whatever is under pixel x, y in place
+	void Zoom(double factor, double x, double y);
+
+	// Keeps the center and scale, so a bigger viewport shows more of the world
+	void Resize(int width, int height);
+
+	// The part of the world that is visible
+	Box View() const;
+
+	double Scale() const { return scale; }	// Pixels per world unit
+
+private:
+	double centerX, centerY;
+	double scale;
+	int width, height;
+};
@@ -0,0 +1,700 @@
+#include "Earcut.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Intersection.hpp"
+
+namespace
+{
+	// Rings are circular lists. The z links chain the same nodes sorted along the z-order curve
+	struct Node {
+		int i;
+		double x, y;
+		uint32_t z = 0;
+		Node* prev = nullptr;
+		Node* next = nullptr;
+		Node* prevZ = nullptr;
+		Node* nextZ = nullptr;
+	};
+
+	// Twice the signed area of the triangle, negative for a convex corner of the outer ring
+	double Area(const Node* p, const Node* q, const Node* r)
+	{
+		return (q->y - p->y) * (r->x - q->x) - (q->x - p->x) * (r->y - q->y);
+	}
+
+	bool Equals(const Node* a, const Node* b)
+	{
+		return (a->x == b->x && a->y == b->y);
+	}
+
+	bool PointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+	{
+		return (cx - px) * (ay - py) >= (ax - px) * (cy - py) &&
+			(ax - px) * (by - py) >= (bx - px) * (ay - py) &&
+			(bx - px) * (cy - py) >= (cx - px) * (by - py);
+	}
+
+	int Sign(double value)
+	{
+		return (value > 0.0) - (value < 0.0);
+	}
+
+	// q is on segment p-r, given the three are collinear
+	bool OnSegment(const Node* p, const Node* q, const Node* r)
+	{
+		return q->x <= std::max(p->x, r->x) && q->x >= std::min(p->x, r->x) && q->y <= std::max(p->y, r->y) && q->y >= std::min(p->y, r->y);
+	}
+
+	bool Intersects(const Node* p1, const Node* q1, const Node* p2, const Node* q2)
+	{
+		int o1 = Sign(Area(p1, q1, p2));
+		int o2 = Sign(Area(p1, q1, q2));
+		int o3 = Sign(Area(p2, q2, p1));
+		int o4 = Sign(Area(p2, q2, q1));
+
+		if (o1 != o2 && o3 != o4)
+			return true;
+
+		return (o1 == 0 && OnSegment(p1, p2, q1)) || (o2 == 0 && OnSegment(p1, q2, q1)) ||
+			(o3 == 0 && OnSegment(p2, p1, q2)) || (o4 == 0 && OnSegment(p2, q1, q2));
+	}
+
+	// Diagonal a-b crosses an edge of the polygon
+	bool IntersectsPolygon(const Node* a, const Node* b)
+	{
+		const Node* p = a;
+		do
+		{
+			if (p->i != a->i && p->next->i != a->i && p->i != b->i && p->next->i != b->i && Intersects(p, p->next, a, b))
+				return true;
+
+			p = p->next;
+		} while (p != a);
+
+		return false;
+	}
+
+	// Diagonal a-b leaves a towards the inside of the polygon
+	bool LocallyInside(const Node* a, const Node* b)
+	{
+		if (Area(a->prev, a, a->next) < 0)
+			return Area(a, b, a->next) >= 0 && Area(a, a->prev, b) >= 0;
+
+		return Area(a, b, a->prev) < 0 || Area(a, a->next, b) < 0;
+	}
+
+	// The middle of diagonal a-b is inside the polygon
+	bool MiddleInside(const Node* a, const Node* b)
+	{
+		const Node* p = a;
+		bool inside = false;
+		double px = (a->x + b->x) / 2, py = (a->y + b->y) / 2;
+		do
+		{
+			if ((p->y > py) != (p->next->y > py) && p->next->y != p->y && px < (p->next->x - p->x) * (py - p->y) / (p->next->y - p->y) + p->x)
+				inside = !inside;
+
+			p = p->next;
+		} while (p != a);
+
+		return inside;
+	}
+
+	bool IsValidDiagonal(const Node* a, const Node* b)
+	{
+		if (a->next->i == b->i || a->prev->i == b->i || IntersectsPolygon(a, b))
+			return false;
+
+		if (LocallyInside(a, b) && LocallyInside(b, a) && MiddleInside(a, b))
+			return Area(a->prev, a, b->prev) != 0 || Area(a, b->prev, b) != 0;
+
+		// Both ends in the same spot, where a hole was bridged
+		return Equals(a, b) && Area(a->prev, a, a->next) > 0 && Area(b->prev, b, b->next) > 0;
+	}
+
+	Node* Leftmost(Node* start)
+	{
+		Node* p = start;
+		Node* leftmost = start;
+		do
+		{
+			if (p->x < leftmost->x || (p->x == leftmost->x && p->y < leftmost->y))
+				leftmost = p;
+
+			p = p->next;
+		} while (p != start);
+
+		return leftmost;
+	}
+
+	class EarClipper
+	{
+	public:
+		EarClipper(ScratchVector<int>& triangles) :
+			triangles(triangles)
+		{
+		}
+
+		void Run(Span<const Vector2d> points, Span<const int> ringStarts)
+		{
+			Node* outer = LinkedList(points, 0, RingEnd(points, ringStarts, 0), true);
+			if (!outer || outer->next == outer->prev)
+				return;
+
+			if (ringStarts.size() > 1)
+				outer = EliminateHoles(points, ringStarts, outer);
+
+			// Small polygons are faster to search point by point than to sort
+			if (points.size() > EARCUT_HASH_POINTS)
+			{
+				double maxX = points[0].x, maxY = points[0].y;
+				minX = maxX;
+				minY = maxY;
+				for (const Vector2d& point : points)
+				{
+					minX = std::min(minX, point.x);
+					minY = std::min(minY, point.y);
+					maxX = std::max(maxX, point.x);
+					maxY = std::max(maxY, point.y);
+				}
+
+				double size = std::max(maxX - minX, maxY - minY);
+				invSize = (size != 0.0) ? 32767.0 / size : 0.0;
+			}
+
+			EarcutLinked(outer, 0);
+		}
+
+	private:
+		static size_t RingEnd(Span<const Vector2d> points, Span<const int> ringStarts, size_t ring)
+		{
+			return (ring + 1 < ringStarts.size()) ? ringStarts[ring + 1] : points.size();
+		}
+
+		Node* Insert(int i, const Vector2d& point, Node* last)
+		{
+			Node* node = Scratch().Allocate<Node>(1);
+			*node = { i, point.x, point.y };
+			if (!last)
+			{
+				node->prev = node;
+				node->next = node;
+			}
+			else
+			{
+				node->next = last->next;
+				node->prev = last;
+				last->next->prev = node;
+				last->next = node;
+			}
+
+			return node;
+		}
+
+		static void Remove(Node* p)
+		{
+			p->next->prev = p->prev;
+			p->prev->next = p->next;
+
+			if (p->prevZ)
+				p->prevZ->nextZ = p->nextZ;
+			if (p->nextZ)
+				p->nextZ->prevZ = p->prevZ;
+		}
+
+		// The outer ring runs one way and holes the other, whichever way they were given
+		Node* LinkedList(Span<const Vector2d> points, size_t start, size_t end, bool outer)
+		{
+			double area = 0.0;
+			for (size_t i = start, j = end - 1; i < end; j = i++)
+				area += (points[j].x - points[i].x) * (points[i].y + points[j].y);
+
+			Node* last = nullptr;
+			if (outer == (area > 0))
+			{
+				for (size_t i = start; i < end; i++)
+					last = Insert((int)i, points[i], last);
+			}
+			else
+			{
+				for (size_t i = end; i-- > start;)
+					last = Insert((int)i, points[i], last);
+			}
+
+			if (last && Equals(last, last->next))
+			{
+				Remove(last);
+				last = last->next;
+			}
+
+			return last;
+		}
+
+		// Drops points in the same spot as the next one and points on a straight line
+		static Node* FilterPoints(Node* start, Node* end = nullptr)
+		{
+			if (!start)
+				return start;
+			if (!end)
+				end = start;
+
+			Node* p = start;
+			bool again;
+			do
+			{
+				again = false;
+				if (Equals(p, p->next) || Area(p->prev, p, p->next) == 0)
+				{
+					Remove(p);
+					p = end = p->prev;
+					if (p == p->next)
+						break;
+
+					again = true;
+				}
+				else
+					p = p->next;
+			} while (again || p != end);
+
+			return end;
+		}
+
+		// Cuts off ears until the ring is gone. Every time it goes around without finding one it tries harder
+		void EarcutLinked(Node* ear, int pass)
+		{
+			if (!ear)
+				return;
+
+			if (pass == 0 && invSize != 0.0)
+				IndexCurve(ear);
+
+			Node* stop = ear;
+			while (ear->prev != ear->next)
+			{
+				Node* prev = ear->prev;
+				Node* next = ear->next;
+				if (invSize != 0.0 ? IsEarHashed(ear) : IsEar(ear))
+				{
+					triangles.push_back(prev->i);
+					triangles.push_back(ear->i);
+					triangles.push_back(next->i);
+
+					Remove(ear);
+					ear = next->next;
+					stop = next->next;
+					continue;
+				}
+
+				ear = next;
+				if (ear == stop)
+				{
+					if (pass == 0)
+						EarcutLinked(FilterPoints(ear), 1);
+					else if (pass == 1)
+						EarcutLinked(CureLocalIntersections(FilterPoints(ear)), 2);
+					else
+						SplitEarcut(ear);
+
+					break;
+				}
+			}
+		}
+
+		// Convex corner without any other point of the polygon inside
+		static bool IsEar(const Node* ear)
+		{
+			const Node* a = ear->prev;
+			const Node* b = ear;
+			const Node* c = ear->next;
+			if (Area(a, b, c) >= 0)
+				return false;
+
+			double x0 = std::min({ a->x, b->x, c->x }), y0 = std::min({ a->y, b->y, c->y });
+			double x1 = std::max({ a->x, b->x, c->x }), y1 = std::max({ a->y, b->y, c->y });
+			for (const Node* p = c->next; p != a; p = p->next)
+			{
+				if (p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1 &&
+					PointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) && Area(p->prev, p, p->next) >= 0)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		// Same test, but only points whose z-order lies within the triangle's bounding box are looked at
+		bool IsEarHashed(const Node* ear) const
+		{
+			const Node* a = ear->prev;
+			const Node* b = ear;
+			const Node* c = ear->next;
+			if (Area(a, b, c) >= 0)
+				return false;
+
+			double x0 = std::min({ a->x, b->x, c->x }), y0 = std::min({ a->y, b->y, c->y });
+			double x1 = std::max({ a->x, b->x, c->x }), y1 = std::max({ a->y, b->y, c->y });
+			uint32_t minZ = ZOrder(x0, y0), maxZ = ZOrder(x1, y1);
+
+			auto inside = [&](const Node* p) {
+				return p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1 && p != a && p != c &&
+					PointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) && Area(p->prev, p, p->next) >= 0;
+			};
+
+			// Look both ways from the ear at once
+			const Node* p = ear->prevZ;
+			const Node* n = ear->nextZ;
+			while (p && p->z >= minZ && n && n->z <= maxZ)
+			{
+				if (inside(p) || inside(n))
+					return false;
+
+				p = p->prevZ;
+				n = n->nextZ;
+			}
+
+			for (; p && p->z >= minZ; p = p->prevZ)
+			{
+				if (inside(p))
+					return false;
+			}
+
+			for (; n && n->z <= maxZ; n = n->nextZ)
+			{
+				if (inside(n))
+					return false;
+			}
+
+			return true;
+		}
+
+		// Two edges crossing right next to each other, the small triangle between them is cut off
+		Node* CureLocalIntersections(Node* start)
+		{
+			Node* p = start;
+			do
+			{
+				Node* a = p->prev;
+				Node* b = p->next->next;
+				if (!Equals(a, b) && Intersects(a, p, p->next, b) && LocallyInside(a, b) && LocallyInside(b, a))
+				{
+					triangles.push_back(a->i);
+					triangles.push_back(p->i);
+					triangles.push_back(b->i);
+
+					Remove(p);
+					Remove(p->next);
+					p = start = b;
+				}
+
+				p = p->next;
+			} while (p != start);
+
+			return FilterPoints(p);
+		}
+
+		// Last resort, split the polygon in two along a diagonal and start over with both halves
+		void SplitEarcut(Node* start)
+		{
+			Node* a = start;
+			do
+			{
+				for (Node* b = a->next->next; b != a->prev; b = b->next)
+				{
+					if (a->i != b->i && IsValidDiagonal(a, b))
+					{
+						Node* c = SplitPolygon(a, b);
+						a = FilterPoints(a, a->next);
+						c = FilterPoints(c, c->next);
+
+						EarcutLinked(a, 0);
+						EarcutLinked(c, 0);
+						return;
+					}
+				}
+
+				a = a->next;
+			} while (a != start);
+		}
+
+		// Holes are joined into the outer ring one at a time, leftmost first
+		Node* EliminateHoles(Span<const Vector2d> points, Span<const int> ringStarts, Node* outer)
+		{
+			ScratchVector<Node*> queue;
+			for (size_t ring = 1; ring < ringStarts.size(); ring++)
+			{
+				Node* list = LinkedList(points, ringStarts[ring], RingEnd(points, ringStarts, ring), false);
+				if (list)
+					queue.push_back(Leftmost(list));
+			}
+
+			std::sort(queue.begin(), queue.end(), [](const Node* a, const Node* b) {
+				return (a->x != b->x) ? (a->x < b->x) : (a->y < b->y);
+			});
+
+			for (Node* hole : queue)
+				outer = EliminateHole(hole, outer);
+
+			return outer;
+		}
+
+		Node* EliminateHole(Node* hole, Node* outer)
+		{
+			Node* bridge = FindHoleBridge(hole, outer);
+			if (!bridge)
+				return outer;
+
+			Node* bridgeReverse = SplitPolygon(bridge, hole);
+			FilterPoints(bridgeReverse, bridgeReverse->next);
+			return FilterPoints(bridge, bridge->next);
+		}
+
+		// Point of the outer ring the hole's leftmost point can be connected to without crossing anything
+		static Node* FindHoleBridge(Node* hole, Node* outer)
+		{
+			// The closest edge to the left of the hole, on a ray going left from it
+			Node* p = outer;
+			double hx = hole->x, hy = hole->y;
+			double qx = -std::numeric_limits<double>::infinity();
+			Node* m = nullptr;
+			do
+			{
+				if (hy <= p->y && hy >= p->next->y && p->next->y != p->y)
+				{
+					double x = p->x + (hy - p->y) * (p->next->x - p->x) / (p->next->y - p->y);
+					if (x <= hx && x > qx)
+					{
+						qx = x;
+						m = (p->x < p->next->x) ? p : p->next;
+						if (x == hx)
+							return m;
+					}
+				}
+
+				p = p->next;
+			} while (p != outer);
+
+			if (!m)
+				return nullptr;
+
+			// Points inside the triangle between the hole, the hit and the edge's endpoint would be crossed,
+			// the one making the smallest angle with the ray is taken instead
+			Node* stop = m;
+			double mx = m->x, my = m->y;
+			double tanMin = std::numeric_limits<double>::infinity();
+			p = m;
+			do
+			{
+				if (hx >= p->x && p->x >= mx && hx != p->x &&
+					PointInTriangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, p->x, p->y))
+				{
+					double tan = std::abs(hy - p->y) / (hx - p->x);
+					if (LocallyInside(p, hole) && (tan < tanMin || (tan == tanMin && (p->x > m->x || (p->x == m->x && SectorContainsSector(m, p))))))
+					{
+						m = p;
+						tanMin = tan;
+					}
+				}
+
+				p = p->next;
+			} while (p != stop);
+
+			return m;
+		}
+
+		static bool SectorContainsSector(const Node* m, const Node* p)
+		{
+			return Area(m->prev, m, p->prev) < 0 && Area(p->next, m, m->next) < 0;
+		}
+
+		// Connects a and b with a diagonal. Both are duplicated, the copies form the second polygon
+		Node* SplitPolygon(Node* a, Node* b)
+		{
+			Node* a2 = Scratch().Allocate<Node>(1);
+			Node* b2 = Scratch().Allocate<Node>(1);
+			*a2 = { a->i, a->x, a->y };
+			*b2 = { b->i, b->x, b->y };
+			Node* an = a->next;
+			Node* bp = b->prev;
+
+			a->next = b;
+			b->prev = a;
+
+			a2->next = an;
+			an->prev = a2;
+
+			b2->next = a2;
+			a2->prev = b2;
+
+			bp->next = b2;
+			b2->prev = bp;
+
+			return b2;
+		}
+
+		// Interleaves the bits of both coordinates scaled to 15 bits
+		uint32_t ZOrder(double x, double y) const
+		{
+			uint32_t ix = (uint32_t)((x - minX) * invSize);
+			uint32_t iy = (uint32_t)((y - minY) * invSize);
+
+			ix = (ix | (ix << 8)) & 0x00FF00FF;
+			ix = (ix | (ix << 4)) & 0x0F0F0F0F;
+			ix = (ix | (ix << 2)) & 0x33333333;
+			ix = (ix | (ix << 1)) & 0x55555555;
+
+			iy = (iy | (iy << 8)) & 0x00FF00FF;
+			iy = (iy | (iy << 4)) & 0x0F0F0F0F;
+			iy = (iy | (iy << 2)) & 0x33333333;
+			iy = (iy | (iy << 1)) & 0x55555555;
+
+			return ix | (iy << 1);
+		}
+
+		void IndexCurve(Node* start)
+		{
+			Node* p = start;
+			do
+			{
+				if (p->z == 0)
+					p->z = ZOrder(p->x, p->y);
+
+				p->prevZ = p->prev;
+				p->nextZ = p->next;
+				p = p->next;
+			} while (p != start);
+
+			p->prevZ->nextZ = nullptr;
+			p->prevZ = nullptr;
+
+			SortLinked(p);
+		}
+
+		// Bottom up merge sort of the z links
+		static Node* SortLinked(Node* list)
+		{
+			size_t inSize = 1;
+			size_t merges;
+			do
+			{
+				Node* p = list;
+				Node* tail = nullptr;
+				list = nullptr;
+				merges = 0;
+
+				while (p)
+				{
+					merges++;
+					Node* q = p;
+					size_t pSize = 0;
+					for (size_t i = 0; i < inSize && q; i++)
+					{
+						pSize++;
+						q = q->nextZ;
+					}
+
+					size_t qSize = inSize;
+					while (pSize > 0 || (qSize > 0 && q))
+					{
+						Node* e;
+						if (pSize != 0 && (qSize == 0 || !q || p->z <= q->z))
+						{
+							e = p;
+							p = p->nextZ;
+							pSize--;
+						}
+						else
+						{
+							e = q;
+							q = q->nextZ;
+							qSize--;
+						}
+
+						if (tail)
+							tail->nextZ = e;
+						else
+							list = e;
+
+						e->prevZ = tail;
+						tail = e;
+					}
+
+					p = q;
+				}
+
+				tail->nextZ = nullptr;
+				inSize *= 2;
+			} while (merges > 1);
+
+			return list;
+		}
+
+		ScratchVector<int>& triangles;
+		double minX = 0.0, minY = 0.0;
+		double invSize = 0.0;	// Zero for small polygons, they don't use the z-order curve
+	};
+}
+
+static double RingArea(Span<const Vector2d> ring)
+{
+	double area = 0.0;
+	for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+		area += (ring[j].x - ring[i].x) * (ring[i].y + ring[j].y);
+
+	return std::abs(area) / 2.0;
+}
+
+bool Earcut(Span<const Vector2d> points, Span<const int> ringStarts, ScratchVector<int>& triangles)
+{
+	if (ringStarts.empty() || ringStarts.size() > EARCUT_MAX_HOLES + 1 || ringStarts[0] != 0)
+		return false;
+
+	ScratchVector<Span<const Vector2d>> rings;
+	double outerArea = 0.0, area = 0.0;
+	for (size_t i = 0; i < ringStarts.size(); i++)
+	{
+		size_t start = ringStarts[i];
+		size_t end = (i + 1 < ringStarts.size()) ? ringStarts[i + 1] : points.size();
+		if (end < start + 3 || end > points.size())
+			return false;
+
+		rings.push_back({ points.data + start, end - start });
+		double ringArea = RingArea(rings.back());
+		if (i == 0)
+			outerArea = ringArea;
+		area += (i == 0) ? ringArea : -ringArea;
+	}
+
+	// Ear clipping only works on rings that neither touch nor cross, points in the same spot are where they'd touch
+	ScratchVector<Vector2d> sorted(points.begin(), points.end());
+	std::sort(sorted.begin(), sorted.end(), [](const Vector2d& a, const Vector2d& b) { return (a.x != b.x) ? (a.x < b.x) : (a.y < b.y); });
+	if (std::adjacent_find(sorted.begin(), sorted.end(), [](const Vector2d& a, const Vector2d& b) { return (a.x == b.x && a.y == b.y); }) != sorted.end())
+		return false;
+
+	if (rings.size() == 1 ? SelfIntersecting(rings[0]) : RingsIntersecting({ rings.data(), rings.size() }))
+		return false;
+
+	// Clipped on the side, a polygon that has to go to Triangle leaves nothing behind
+	ScratchVector<int> clipped;
+	EarClipper clipper(clipped);
+	clipper.Run(points, ringStarts);
+
+	// Degenerate polygons can make ear clipping give up early and leave part of the area uncovered
+	double covered = 0.0;
+	for (size_t i = 0; i < clipped.size(); i += 3)
+	{
+		const Vector2d& a = points[clipped[i]];
+		const Vector2d& b = points[clipped[i + 1]];
+		const Vector2d& c = points[clipped[i + 2]];
+		covered += std::abs((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x)) / 2.0;
+	}
+
+	if (std::abs(covered - area) > 1e-9 * outerArea)
+		return false;
+
+	triangles.insert(triangles.end(), clipped.begin(), clipped.end());
+	return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Arena.hpp"
+#include "span.hpp"
+#include "vector2.hpp"
+
+#define EARCUT_MAX_HOLES 16		// Bridging every hole into the outer ring gets slower than Triangle beyond that
+#define EARCUT_HASH_POINTS 80	// Polygons with more points look for points inside an ear along a z-order curve
+
+// Ear clipping after Mapbox's earcut, for the plain polygons most of a map is made of: a small ring, maybe a few holes.
+// It never adds points and skips Triangle's whole Delaunay setup, which is most of the work for a ring of ten points.
+// The rings are back to back in points, ringStarts has the index of every ring's first point and the outer ring comes first.
+// Triangles are appended as indices into points, points on a straight edge might not be used by any of them.
+// Returns false if the polygon isn't one it can take: rings that touch or cross, points in the same spot, too many
+// holes, or triangles that don't add up to the polygon's area. The caller goes to Triangle then
+bool Earcut(Span<const Vector2d> points, Span<const int> ringStarts, ScratchVector<int>& triangles);
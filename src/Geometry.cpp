@@ -0,0 +1,170 @@
+#include "Geometry.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define GEOMETRY_BLOCK_SIZE (1 << 20)
+
+double SnapToGrid(double value)
+{
+	return std::round(value / GRID_STEP) * GRID_STEP;
+}
+
+// Plain loops over plain arrays, so the compiler can vectorize them
+template<typename T>
+static void UnpackOffsets(const T* offsets, uint32_t count, double originX, double originY, Vector2f* points)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		points[i].x = (float)((originX + offsets[2 * i]) * GRID_STEP);
+		points[i].y = (float)((originY + offsets[2 * i + 1]) * GRID_STEP);
+	}
+}
+
+// Deltas have to be summed up one after the other, so this one doesn't vectorize
+static void UnpackDeltas(const int16_t* deltas, uint32_t count, double originX, double originY, Vector2f* points)
+{
+	int32_t x = 0, y = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		x += deltas[2 * i];
+		y += deltas[2 * i + 1];
+		points[i].x = (float)((originX + x) * GRID_STEP);
+		points[i].y = (float)((originY + y) * GRID_STEP);
+	}
+}
+
+template<typename T>
+static void UnpackIndices(const T* data, uint32_t count, uint32_t* indices)
+{
+	for (uint32_t i = 0; i < count; i++)
+		indices[i] = data[i];
+}
+
+template<typename T>
+static void PackOffsets(const ScratchVector<Vector2i>& cells, int32_t originX, int32_t originY, T* offsets)
+{
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		offsets[2 * i] = (T)((int64_t)cells[i].x - originX);
+		offsets[2 * i + 1] = (T)((int64_t)cells[i].y - originY);
+	}
+}
+
+template<typename T>
+static void PackIndices(const int* indices, size_t count, T* data)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] = (T)indices[i];
+}
+
+void PackedPoints::Unpack(Vector2f* points) const
+{
+	switch (encoding)
+	{
+	case OFFSETS_16: UnpackOffsets((const uint16_t*)offsets, count, originX, originY, points); break;
+	case DELTAS_16: UnpackDeltas((const int16_t*)offsets, count, originX, originY, points); break;
+	case OFFSETS_32: UnpackOffsets((const uint32_t*)offsets, count, originX, originY, points); break;
+	}
+}
+
+void PackedIndices::Unpack(uint32_t* indices) const
+{
+	if (wide)
+		UnpackIndices((const uint32_t*)data, count, indices);
+	else
+		UnpackIndices((const uint16_t*)data, count, indices);
+}
+
+GeometryStore::GeometryStore() :
+	arena(GEOMETRY_BLOCK_SIZE)
+{
+}
+
+PackedPoints GeometryStore::AddPoints(const Vector2d* points, size_t count)
+{
+	PackedPoints packed = {};
+	packed.count = count;
+	if (count == 0)
+		return packed;
+
+	ScratchScope scope;
+	ScratchVector<Vector2i> cells(count);
+	Vector2i min = { INT32_MAX, INT32_MAX }, max = { INT32_MIN, INT32_MIN };
+	bool closeTogether = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		cells[i] = { (int)std::lround(points[i].x / GRID_STEP), (int)std::lround(points[i].y / GRID_STEP) };
+		min = { std::min(min.x, cells[i].x), std::min(min.y, cells[i].y) };
+		max = { std::max(max.x, cells[i].x), std::max(max.y, cells[i].y) };
+
+		if (i > 0)
+		{
+			int64_t dx = (int64_t)cells[i].x - cells[i - 1].x, dy = (int64_t)cells[i].y - cells[i - 1].y;
+			closeTogether &= (dx >= INT16_MIN && dx <= INT16_MAX && dy >= INT16_MIN && dy <= INT16_MAX);
+		}
+	}
+
+	if ((int64_t)max.x - min.x <= UINT16_MAX && (int64_t)max.y - min.y <= UINT16_MAX)
+		packed.encoding = PackedPoints::OFFSETS_16;
+	else if (closeTogether)
+		packed.encoding = PackedPoints::DELTAS_16;
+	else
+		packed.encoding = PackedPoints::OFFSETS_32;
+
+	packed.originX = min.x;
+	packed.originY = min.y;
+	uint8_t* offsets = Allocate(packed.Bytes());
+	switch (packed.encoding)
+	{
+	case PackedPoints::OFFSETS_16:
+		PackOffsets(cells, min.x, min.y, (uint16_t*)offsets);
+		break;
+
+	case PackedPoints::DELTAS_16:
+	{
+		packed.originX = cells[0].x;
+		packed.originY = cells[0].y;
+		int16_t* deltas = (int16_t*)offsets;
+		for (size_t i = 0; i < count; i++)
+		{
+			deltas[2 * i] = (int16_t)(i > 0 ? cells[i].x - cells[i - 1].x : 0);
+			deltas[2 * i + 1] = (int16_t)(i > 0 ? cells[i].y - cells[i - 1].y : 0);
+		}
+		break;
+	}
+
+	case PackedPoints::OFFSETS_32:
+		PackOffsets(cells, min.x, min.y, (uint32_t*)offsets);
+		break;
+	}
+
+	packed.offsets = offsets;
+	return packed;
+}
+
+PackedIndices GeometryStore::AddIndices(const int* indices, size_t count, size_t vertexCount)
+{
+	PackedIndices packed = {};
+	packed.count = count;
+	packed.wide = (vertexCount > (size_t)UINT16_MAX + 1);
+	if (count == 0)
+		return packed;
+
+	uint8_t* data = Allocate(packed.Bytes());
+	if (packed.wide)
+		PackIndices(indices, count, (uint32_t*)data);
+	else
+		PackIndices(indices, count, (uint16_t*)data);
+
+	packed.data = data;
+	return packed;
+}
+
+uint8_t* GeometryStore::Allocate(size_t size)
+{
+	// Only handing out the memory needs the lock, the caller fills it in on its own
+	std::lock_guard<std::mutex> lock(mutex);
+	bytes += size;
+	return (uint8_t*)arena.Allocate(size, 4);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+#include "Arena.hpp"
+#include "vector2.hpp"
+
+// Every coordinate is snapped to this grid, in world units (meters). About as fine as the 1e-7 degrees OSM stores,
+// and a power of two so grid cells turn back into the exact same floats no matter which feature they came from
+#define GRID_STEP (1.0 / 64.0)
+
+// Nearest point on the grid
+double SnapToGrid(double value);
+
+// The points of a single feature on the grid, as 16 bit offsets from the grid cell of the bounding box corner.
+// Features too big for that, like forests, usually still have their points close together, so they store 16 bit
+// steps from one point to the next. Only if that doesn't work either the offsets take 32 bits
+struct PackedPoints {
+	enum Encoding : uint32_t {
+		OFFSETS_16,
+		DELTAS_16,		// The first point is the origin
+		OFFSETS_32
+	};
+
+	int32_t originX, originY;
+	uint32_t count;
+	Encoding encoding;
+	const void* offsets;	// x and y of every point interleaved
+
+	size_t Bytes() const { return (size_t)count * 2 * (encoding == OFFSETS_32 ? 4 : 2); }
+
+	// Back into world space
+	void Unpack(Vector2f* points) const;
+};
+
+// Vertex indices of a single mesh, 16 bit if the mesh has no more than 65536 vertices
+struct PackedIndices {
+	uint32_t count;
+	uint32_t wide;
+	const void* data;
+
+	size_t Bytes() const { return (size_t)count * (wide ? 4 : 2); }
+	size_t size() const { return count; }
+
+	uint32_t operator[](size_t i) const {
+		return wide ? ((const uint32_t*)data)[i] : ((const uint16_t*)data)[i];
+	}
+
+	void Unpack(uint32_t* indices) const;
+};
+
+// Owns packed geometry in one long lived arena, so the packed features can point straight into it and all of it
+// is freed at once. Features can be added from several threads at the same time
+class GeometryStore
+{
+public:
+	GeometryStore();
+
+	PackedPoints AddPoints(const Vector2d* points, size_t count);
+	PackedIndices AddIndices(const int* indices, size_t count, size_t vertexCount);
+
+	size_t Bytes() const { return bytes; }
+
+private:
+	// 4 byte aligned, so 32 bit offsets can be read in place
+	uint8_t* Allocate(size_t size);
+
+private:
+	std::mutex mutex;
+	Arena arena;
+	size_t bytes = 0;
+};
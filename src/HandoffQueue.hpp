@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Hands values from one thread to exactly one other thread without locks. Pushing never blocks and popping never waits,
+// so neither side can stall the other, like a loader stalling the frame that is being drawn.
+// A linked list with a dummy node in front: the pushing thread only touches the tail, the popping thread only the head,
+// and the only thing both of them see is the next pointer of the node in between
+template<typename T>
+class HandoffQueue
+{
+public:
+	HandoffQueue() :
+		head(new Node), tail(head)
+	{
+	}
+
+	~HandoffQueue()
+	{
+		while (head)
+		{
+			Node* next = head->next.load(std::memory_order_relaxed);
+			delete head;
+			head = next;
+		}
+	}
+
+	HandoffQueue(const HandoffQueue&) = delete;
+	HandoffQueue& operator=(const HandoffQueue&) = delete;
+
+	// Only ever from the pushing thread
+	void Push(T value)
+	{
+		Node* node = new Node;
+		node->value = std::move(value);
+
+		// Releasing makes the value visible before the node is
+		tail->next.store(node, std::memory_order_release);
+		tail = node;
+	}
+
+	// Only ever from the popping thread. False if there's nothing to take
+	bool Pop(T& value)
+	{
+		Node* next = head->next.load(std::memory_order_acquire);
+		if (!next)
+			return false;
+
+		// The node that was popped becomes the dummy in front
+		value = std::move(next->value);
+		delete head;
+		head = next;
+		return true;
+	}
+
+private:
+	struct Node {
+		std::atomic<Node*> next{ nullptr };
+		T value;
+	};
+
+	// Each on its own cache line, so the two threads don't keep taking it from each other
+	alignas(64) Node* head;
+	alignas(64) Node* tail;
+};
@@ -0,0 +1,136 @@
+#include "Image.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+struct CrcTable {
+	uint32_t entries[256];
+
+	CrcTable()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+
+			entries[i] = c;
+		}
+	}
+};
+
+static uint32_t Crc32(const uint8_t* data, size_t length, uint32_t crc = 0)
+{
+	static const CrcTable table;	// Images are written from several threads at once
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++)
+		crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static void PutBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+}
+
+static void WriteChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data)
+{
+	std::vector<uint8_t> chunk;
+	PutBigEndian(chunk, data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	PutBigEndian(chunk, Crc32(chunk.data() + 4, chunk.size() - 4));
+
+	file.write((const char*)chunk.data(), chunk.size());
+}
+
+static bool WritePNG(std::ofstream& file, int width, int height, const uint8_t* rgba)
+{
+	static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write((const char*)signature, sizeof(signature));
+
+	std::vector<uint8_t> header;
+	PutBigEndian(header, width);
+	PutBigEndian(header, height);
+	header.push_back(8);	// Bit depth
+	header.push_back(6);	// RGBA
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	WriteChunk(file, "IHDR", header);
+
+	// Every row starts with its filter type, then everything goes into stored deflate blocks.
+	// There is no zlib around, the files are big but any viewer can open them
+	size_t rowSize = (size_t)width * 4;
+	std::vector<uint8_t> raw;
+	raw.reserve((rowSize + 1) * height);
+	for (int y = 0; y < height; y++)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+	}
+
+	std::vector<uint8_t> data = { 0x78, 0x01 };
+	for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 0xFFFF)
+	{
+		size_t length = std::min<size_t>(0xFFFF, raw.size() - offset);
+		data.push_back(offset + length == raw.size() ? 1 : 0);
+		data.push_back(length & 0xFF);
+		data.push_back(length >> 8);
+		data.push_back(~length & 0xFF);
+		data.push_back((~length >> 8) & 0xFF);
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + length);
+	}
+
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : raw)
+	{
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	PutBigEndian(data, (b << 16) | a);
+	WriteChunk(file, "IDAT", data);
+
+	WriteChunk(file, "IEND", {});
+	return (bool)file;
+}
+
+static bool WritePPM(std::ofstream& file, int width, int height, const uint8_t* rgba)
+{
+	file << "P6\n" << width << " " << height << "\n255\n";
+
+	std::vector<uint8_t> row((size_t)width * 3);
+	for (int y = 0; y < height; y++)
+	{
+		const uint8_t* pixel = rgba + (size_t)y * width * 4;
+		for (int x = 0; x < width; x++, pixel += 4)
+		{
+			row[x * 3 + 0] = pixel[0];
+			row[x * 3 + 1] = pixel[1];
+			row[x * 3 + 2] = pixel[2];
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+
+	return (bool)file;
+}
+
+bool WriteImage(const std::string& path, int width, int height, const uint8_t* rgba)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Failed to open " << path << " for writing" << std::endl;
+		return false;
+	}
+
+	bool png = (path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0);
+	return png ? WritePNG(file, width, height, rgba) : WritePPM(file, width, height, rgba);
+}
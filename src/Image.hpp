@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Writes 8 bit RGBA pixels, rows top to bottom. The format is picked by the file extension,
+// .png gets an uncompressed PNG and everything else a binary PPM without the alpha channel
+bool WriteImage(const std::string& path, int width, int height, const uint8_t* rgba);
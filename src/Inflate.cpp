@@ -0,0 +1,378 @@
+#include "Inflate.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Codes up to this long are decoded with a single table lookup, the rare longer ones a bit at a time
+#define FAST_BITS 10
+#define MAX_BITS 15
+
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Reads the stream least significant bit first, the way deflate packs it. Reading past the end gives zeros,
+// whoever reads has to check Overrun() before trusting what came out
+class BitReader
+{
+public:
+	BitReader(const uint8_t* data, size_t size) :
+		data(data), size(size), position(0), bits(0), count(0)
+	{
+	}
+
+	void Ensure(int needed)
+	{
+		if (count >= needed)
+			return;
+
+		while (count <= 56)
+		{
+			if (position < size)
+				bits |= (uint64_t)data[position] << count;
+
+			position++;
+			count += 8;
+		}
+	}
+
+	// Needs Ensure() first
+	uint32_t Peek(int n) const { return (uint32_t)(bits & ((1ull << n) - 1)); }
+	void Drop(int n) { bits >>= n; count -= n; }
+
+	uint32_t Read(int n)
+	{
+		Ensure(n);
+		uint32_t value = Peek(n);
+		Drop(n);
+		return value;
+	}
+
+	// Goes on at the next byte boundary, the whole bytes that were buffered go back to the stream
+	void Align()
+	{
+		Drop(count % 8);
+		position -= count / 8;
+		bits = 0;
+		count = 0;
+	}
+
+	// Only right after Align()
+	size_t Position() const { return position; }
+	void Skip(size_t bytes) { position += bytes; }
+
+	bool Overrun() const { return (position - count / 8 > size); }
+
+private:
+	const uint8_t* data;
+	size_t size;
+	size_t position;
+	uint64_t bits;
+	int count;
+};
+
+// Canonical Huffman code as deflate describes it, by the length of every symbol's code
+class Huffman
+{
+public:
+	// False if the lengths describe more codes than there are, incomplete codes are fine
+	bool Build(const uint8_t* lengths, int symbolCount)
+	{
+		memset(counts, 0, sizeof(counts));
+		for (int i = 0; i < symbolCount; i++)
+			counts[lengths[i]]++;
+		counts[0] = 0;
+
+		int left = 1;
+		for (int length = 1; length <= MAX_BITS; length++)
+		{
+			left = (left << 1) - counts[length];
+			if (left < 0)
+				return false;
+		}
+
+		// Symbols sorted by the length of their code, which is the order of the codes
+		uint16_t offsets[MAX_BITS + 2];
+		offsets[1] = 0;
+		for (int length = 1; length <= MAX_BITS; length++)
+			offsets[length + 1] = offsets[length] + counts[length];
+
+		for (int i = 0; i < symbolCount; i++)
+		{
+			if (lengths[i] != 0)
+				symbols[offsets[lengths[i]]++] = (uint16_t)i;
+		}
+
+		// Every short code fills all the table entries that start with it. The codes are stored with their bits reversed
+		memset(fast, 0, sizeof(fast));
+		uint32_t code = 0;
+		int index = 0;
+		for (int length = 1; length <= FAST_BITS; length++)
+		{
+			for (int i = 0; i < counts[length]; i++)
+			{
+				uint32_t reversed = 0;
+				for (int bit = 0; bit < length; bit++)
+					reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+
+				for (uint32_t entry = reversed; entry < (1u << FAST_BITS); entry += (1u << length))
+					fast[entry] = (uint16_t)((length << 9) | symbols[index]);
+
+				code++;
+				index++;
+			}
+
+			code <<= 1;
+		}
+
+		return true;
+	}
+
+	// -1 if the bits aren't a code
+	int Decode(BitReader& reader) const
+	{
+		reader.Ensure(MAX_BITS);
+		uint16_t entry = fast[reader.Peek(FAST_BITS)];
+		if (entry != 0)
+		{
+			reader.Drop(entry >> 9);
+			return entry & 511;
+		}
+
+		uint32_t bits = reader.Peek(MAX_BITS);
+		int code = 0, first = 0, index = 0;
+		for (int length = 1; length <= MAX_BITS; length++)
+		{
+			code |= (bits >> (length - 1)) & 1;
+			int count = counts[length];
+			if (code - first < count)
+			{
+				reader.Drop(length);
+				return symbols[index + code - first];
+			}
+
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+
+		return -1;
+	}
+
+private:
+	uint16_t fast[1 << FAST_BITS];	// Code length << 9 | symbol, 0 for codes longer than FAST_BITS
+	uint16_t counts[MAX_BITS + 1];
+	uint16_t symbols[288];
+};
+
+struct FixedCodes
+{
+	Huffman literals, distances;
+
+	FixedCodes()
+	{
+		uint8_t lengths[288];
+		std::fill(lengths, lengths + 144, 8);
+		std::fill(lengths + 144, lengths + 256, 9);
+		std::fill(lengths + 256, lengths + 280, 7);
+		std::fill(lengths + 280, lengths + 288, 8);
+		literals.Build(lengths, 288);
+
+		std::fill(lengths, lengths + 30, 5);
+		distances.Build(lengths, 30);
+	}
+};
+
+static bool ReadDynamicCodes(BitReader& reader, Huffman& literals, Huffman& distances)
+{
+	int literalCount = reader.Read(5) + 257;
+	int distanceCount = reader.Read(5) + 1;
+	int codeLengthCount = reader.Read(4) + 4;
+	if (literalCount > 286 || distanceCount > 30)
+		return false;
+
+	uint8_t lengths[286 + 30] = {};
+	for (int i = 0; i < codeLengthCount; i++)
+		lengths[CODE_LENGTH_ORDER[i]] = (uint8_t)reader.Read(3);
+
+	Huffman codeLengths;
+	if (!codeLengths.Build(lengths, 19))
+		return false;
+
+	// Both codes' lengths are one sequence, repeats can run from one into the other
+	int total = literalCount + distanceCount;
+	int index = 0;
+	while (index < total)
+	{
+		int symbol = codeLengths.Decode(reader);
+		if (symbol < 0)
+			return false;
+
+		if (symbol < 16)
+		{
+			lengths[index++] = (uint8_t)symbol;
+			continue;
+		}
+
+		uint8_t value = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (index == 0)
+				return false;
+
+			value = lengths[index - 1];
+			repeat = 3 + reader.Read(2);
+		}
+		else if (symbol == 17)
+			repeat = 3 + reader.Read(3);
+		else
+			repeat = 11 + reader.Read(7);
+
+		if (index + repeat > total)
+			return false;
+
+		std::fill(lengths + index, lengths + index + repeat, value);
+		index += repeat;
+	}
+
+	// Without an end of block code the block never ends
+	if (lengths[256] == 0)
+		return false;
+
+	return (literals.Build(lengths, literalCount) && distances.Build(lengths + literalCount, distanceCount));
+}
+
+static bool InflateBlock(BitReader& reader, const Huffman& literals, const Huffman& distances, uint8_t* out, size_t outSize, size_t& written)
+{
+	while (true)
+	{
+		int symbol = literals.Decode(reader);
+		if (symbol < 0)
+			return false;
+
+		if (symbol < 256)
+		{
+			if (written == outSize)
+				return false;
+
+			out[written++] = (uint8_t)symbol;
+			continue;
+		}
+
+		if (symbol == 256)
+			return !reader.Overrun();
+
+		symbol -= 257;
+		if (symbol >= 29)
+			return false;
+
+		size_t length = LENGTH_BASE[symbol] + reader.Read(LENGTH_EXTRA[symbol]);
+		int code = distances.Decode(reader);
+		if (code < 0 || code >= 30)
+			return false;
+
+		size_t distance = DISTANCE_BASE[code] + reader.Read(DISTANCE_EXTRA[code]);
+		if (distance > written || length > outSize - written)
+			return false;
+
+		// Matches may overlap what they copy, that's how runs are encoded
+		uint8_t* to = out + written;
+		const uint8_t* from = to - distance;
+		if (distance >= length)
+			memcpy(to, from, length);
+		else
+		{
+			for (size_t i = 0; i < length; i++)
+				to[i] = from[i];
+		}
+
+		written += length;
+	}
+}
+
+static uint32_t Adler32(const uint8_t* data, size_t size)
+{
+	uint32_t a = 1, b = 0;
+	while (size > 0)
+	{
+		// The longest run that can't overflow b before it is reduced
+		size_t run = std::min<size_t>(size, 5552);
+		for (size_t i = 0; i < run; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+
+		a %= 65521;
+		b %= 65521;
+		data += run;
+		size -= run;
+	}
+
+	return (b << 16) | a;
+}
+
+bool Inflate(const uint8_t* data, size_t size, uint8_t* out, size_t outSize)
+{
+	// Deflate with a window of at most 32 KB and no preset dictionary, then the Adler-32 of the output at the end
+	if (size < 6)
+		return false;
+
+	uint8_t method = data[0], flags = data[1];
+	if ((method & 0x0F) != 8 || (method >> 4) > 7 || ((method << 8) | flags) % 31 != 0 || (flags & 0x20))
+		return false;
+
+	static const FixedCodes fixed;
+	Huffman literals, distances;
+
+	BitReader reader(data + 2, size - 2);
+	size_t written = 0;
+	bool last = false;
+	while (!last)
+	{
+		last = (reader.Read(1) != 0);
+		uint32_t type = reader.Read(2);
+		if (type == 0)
+		{
+			// Stored as it is, after the length and its complement
+			reader.Align();
+			size_t position = reader.Position();
+			if (position + 4 > size - 2)
+				return false;
+
+			const uint8_t* header = data + 2 + position;
+			size_t length = header[0] | (header[1] << 8);
+			size_t complement = header[2] | (header[3] << 8);
+			if (complement != (~length & 0xFFFF) || position + 4 + length > size - 2 || length > outSize - written)
+				return false;
+
+			std::copy(header + 4, header + 4 + length, out + written);
+			written += length;
+			reader.Skip(4 + length);
+		}
+		else if (type == 1)
+		{
+			if (!InflateBlock(reader, fixed.literals, fixed.distances, out, outSize, written))
+				return false;
+		}
+		else if (type == 2)
+		{
+			if (!ReadDynamicCodes(reader, literals, distances) || !InflateBlock(reader, literals, distances, out, outSize, written))
+				return false;
+		}
+		else
+			return false;
+	}
+
+	reader.Align();
+	size_t position = reader.Position();
+	if (written != outSize || position + 4 > size - 2)
+		return false;
+
+	const uint8_t* checksum = data + 2 + position;
+	uint32_t expected = ((uint32_t)checksum[0] << 24) | ((uint32_t)checksum[1] << 16) | ((uint32_t)checksum[2] << 8) | checksum[3];
+	return (Adler32(out, outSize) == expected);
+}
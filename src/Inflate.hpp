@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Decompresses a zlib stream (RFC 1950 around RFC 1951 deflate data) whose decompressed size is known up front,
+// like the blobs of PBF files. Fails if the stream is broken, its checksum doesn't match or it doesn't decompress
+// to exactly outSize bytes. Safe to call from any number of threads at once
+bool Inflate(const uint8_t* data, size_t size, uint8_t* out, size_t outSize);
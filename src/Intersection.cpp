@@ -0,0 +1,274 @@
+#include "Intersection.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <set>
+
+#include "Arena.hpp"
+
+bool Intersect(double p0_x, double p0_y, double p1_x, double p1_y, double p2_x, double p2_y, double p3_x, double p3_y)
+{
+	if ((p0_x == p2_x && p0_y == p2_y) ||
+		(p0_x == p3_x && p0_y == p3_y) ||
+		(p1_x == p2_x && p1_y == p2_y) ||
+		(p1_x == p3_x && p1_y == p3_y))
+		return false;
+
+	float s1_x, s1_y, s2_x, s2_y;
+	s1_x = p1_x - p0_x;     s1_y = p1_y - p0_y;
+	s2_x = p3_x - p2_x;     s2_y = p3_y - p2_y;
+
+	float s, t;
+	s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y)) / (-s2_x * s1_y + s1_x * s2_y);
+	t = (s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x)) / (-s2_x * s1_y + s1_x * s2_y);
+
+	if (s >= 0 && s <= 1 && t >= 0 && t <= 1)
+	{
+		// Collision detected
+		return 1;
+	}
+
+	return 0; // No collision
+}
+
+namespace
+{
+	struct Segment {
+		Vector2d left, right;	// Left is the lexicographically smaller endpoint
+
+		double YAt(double x) const
+		{
+			if (left.x == right.x)
+				return left.y;
+
+			return left.y + (x - left.x) * (right.y - left.y) / (right.x - left.x);
+		}
+
+		double Slope() const
+		{
+			if (left.x == right.x)
+				return std::numeric_limits<double>::infinity();
+
+			return (right.y - left.y) / (right.x - left.x);
+		}
+	};
+
+	struct Event {
+		Vector2d point;
+		int segment;
+		bool insert;
+
+		bool operator<(const Event& other) const
+		{
+			if (point.x != other.point.x) return (point.x < other.point.x);
+			if (point.y != other.point.y) return (point.y < other.point.y);
+			if (insert != other.insert) return !insert;	// Segments ending in a point leave before new ones start there
+			return (segment < other.segment);
+		}
+	};
+
+	// The sweep only needs its memory until it's done, so all of it comes from the scratch arena
+	typedef ScratchVector<Segment> Segments;
+
+	// Orders the segments crossing the sweep line from bottom to top
+	struct SweepOrder {
+		const Segments* segments;
+		const double* sweepX;
+
+		bool operator()(int a, int b) const
+		{
+			if (a == b)
+				return false;
+
+			const Segment& sa = (*segments)[a];
+			const Segment& sb = (*segments)[b];
+
+			double ya = sa.YAt(*sweepX);
+			double yb = sb.YAt(*sweepX);
+			if (ya != yb)
+				return (ya < yb);
+
+			// Starting in the same point, so whichever rises slower is below
+			double slopeA = sa.Slope();
+			double slopeB = sb.Slope();
+			if (slopeA != slopeB)
+				return (slopeA < slopeB);
+
+			return (a < b);
+		}
+	};
+
+	bool Lexicographic(const Vector2d& a, const Vector2d& b)
+	{
+		return (a.x < b.x || (a.x == b.x && a.y < b.y));
+	}
+}
+
+static void AddEdges(Span<const Vector2d> ring, Segments& segments)
+{
+	for (size_t i = 0; i < ring.size(); i++)
+	{
+		const Vector2d& p1 = ring[i];
+		const Vector2d& p2 = ring[(i + 1) % ring.size()];
+
+		// Zero length edges share their endpoints with both neighbours, they can't intersect anything
+		if (p1.x == p2.x && p1.y == p2.y)
+			continue;
+
+		if (Lexicographic(p1, p2))
+			segments.push_back({ p1, p2 });
+		else
+			segments.push_back({ p2, p1 });
+	}
+}
+
+static bool AnyIntersection(const Segments& segments);
+
+bool SelfIntersecting(Span<const Vector2d> ring)
+{
+	ScratchScope scope;
+	Segments segments;
+	segments.reserve(ring.size());
+	AddEdges(ring, segments);
+
+	return AnyIntersection(segments);
+}
+
+bool SelfIntersecting(const std::vector<Vector2d>& ring)
+{
+	return SelfIntersecting(Span<const Vector2d>{ ring.data(), ring.size() });
+}
+
+bool RingsIntersecting(Span<const Span<const Vector2d>> rings)
+{
+	size_t edges = 0;
+	for (const Span<const Vector2d>& ring : rings)
+		edges += ring.size();
+
+	ScratchScope scope;
+	Segments segments;
+	segments.reserve(edges);
+	for (const Span<const Vector2d>& ring : rings)
+		AddEdges(ring, segments);
+
+	return AnyIntersection(segments);
+}
+
+static bool AnyIntersection(const Segments& segments)
+{
+	ScratchVector<Event> events;
+	events.reserve(segments.size() * 2);
+	for (int i = 0; i < (int)segments.size(); i++)
+	{
+		events.push_back({ segments[i].left, i, true });
+		events.push_back({ segments[i].right, i, false });
+	}
+	std::sort(events.begin(), events.end());
+
+	auto intersect = [&segments](int a, int b) {
+		const Segment& sa = segments[a];
+		const Segment& sb = segments[b];
+		return Intersect(sa.left.x, sa.left.y, sa.right.x, sa.right.y, sb.left.x, sb.left.y, sb.right.x, sb.right.y);
+	};
+
+	// Segments are only ever removed through their iterators, so the order of segments that meet in a common
+	// endpoint never has to be decided. The only other place the order changes is at intersections, and the
+	// sweep stops at the first one of those
+	double sweepX = 0.0;
+	typedef std::set<int, SweepOrder, ScratchAllocator<int>> SweepLine;
+	SweepLine sweepLine(SweepOrder{ &segments, &sweepX });
+	ScratchVector<SweepLine::iterator> positions(segments.size());
+
+	// Collinear overlapping segments sit in the same spot of the sweep line and can hide a neighbour
+	// from the segment next to them, so neighbours are compared against that whole run of segments
+	auto tied = [&segments, &sweepX](int a, int b) {
+		return (segments[a].YAt(sweepX) == segments[b].YAt(sweepX));
+	};
+
+	auto checkAbove = [&](int segment, SweepLine::iterator above) {
+		for (auto it = above; it != sweepLine.end(); it++)
+		{
+			if (intersect(segment, *it))
+				return true;
+
+			if (std::next(it) == sweepLine.end() || !tied(*it, *std::next(it)))
+				break;
+		}
+
+		return false;
+	};
+
+	auto checkBelow = [&](int segment, SweepLine::iterator below) {
+		for (auto it = below; ; it--)
+		{
+			if (intersect(segment, *it))
+				return true;
+
+			if (it == sweepLine.begin() || !tied(*it, *std::prev(it)))
+				break;
+		}
+
+		return false;
+	};
+
+	for (const Event& event : events)
+	{
+		sweepX = event.point.x;
+
+		if (event.insert)
+		{
+			auto it = sweepLine.insert(event.segment).first;
+			positions[event.segment] = it;
+
+			if (it != sweepLine.begin() && checkBelow(event.segment, std::prev(it)))
+				return true;
+
+			if (checkAbove(event.segment, std::next(it)))
+				return true;
+		}
+		else
+		{
+			// The segments around the one leaving become neighbours. The leaving one is compared again as well,
+			// in case its endpoint touches a run of segments that was hidden from it until now
+			auto it = positions[event.segment];
+			auto above = std::next(it);
+			if (above != sweepLine.end() && checkAbove(event.segment, above))
+				return true;
+
+			if (it != sweepLine.begin())
+			{
+				auto below = std::prev(it);
+				if (checkBelow(event.segment, below))
+					return true;
+
+				if (above != sweepLine.end() && (checkAbove(*below, above) || checkBelow(*above, below)))
+					return true;
+			}
+
+			sweepLine.erase(it);
+		}
+	}
+
+	return false;
+}
+
+bool SelfIntersectingBruteForce(const std::vector<Vector2d>& ring)
+{
+	for (size_t i = 0; i < ring.size(); i++)
+	{
+		const Vector2d& p1 = ring[i];
+		const Vector2d& p2 = ring[(i + 1) % ring.size()];
+
+		for (size_t j = 0; j < ring.size(); j++)
+		{
+			if (i == j) continue;
+
+			const Vector2d& q1 = ring[j];
+			const Vector2d& q2 = ring[(j + 1) % ring.size()];
+			if (Intersect(p1.x, p1.y, p2.x, p2.y, q1.x, q1.y, q2.x, q2.y))
+				return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+#include "span.hpp"
+#include "vector2.hpp"
+
+// Segment p0-p1 against segment p2-p3. Segments that share an endpoint never count as intersecting
+bool Intersect(double p0_x, double p0_y, double p1_x, double p1_y, double p2_x, double p2_y, double p3_x, double p3_y);
+
+// Tests if any two edges of the closed ring intersect, the last point connects back to the first one.
+// Shamos-Hoey sweep line, O(n log n), stops at the first intersection it finds
+bool SelfIntersecting(Span<const Vector2d> ring);
+bool SelfIntersecting(const std::vector<Vector2d>& ring);
+
+// Same sweep over the edges of several closed rings at once, rings touching in a shared point don't count
+bool RingsIntersecting(Span<const Span<const Vector2d>> rings);
+
+// Compares every edge with every other edge, O(n^2). Only kept around as a reference
+bool SelfIntersectingBruteForce(const std::vector<Vector2d>& ring);
@@ -0,0 +1,799 @@
+#include "MapArena.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <unordered_map>
+
+#include <triangle.h>
+#include "Arena.hpp"
+#include "Earcut.hpp"
+#include "Simplify.hpp"
+#include "Trace.hpp"
+
+namespace
+{
+	struct Mesh {
+		std::vector<MapArena::Vertex> vertices;
+		std::vector<uint32_t> indices[LOD_LEVELS];
+	};
+
+	// A single feature's share of a group
+	struct Piece {
+		enum Source {
+			POLYGON_TRIANGLES,
+			POLYGON_SEGMENTS,
+			BUILDING,
+			HIGHWAY
+		} source;
+		uint32_t feature, polygon;
+		uint32_t group;
+	};
+
+	// Vertices of every ring in order, the first ring is the outer one
+	typedef std::vector<std::vector<uint32_t>> Outline;
+}
+
+// The closing node and repeated nodes would make Triangle fail, so every spot only gets one vertex.
+// The outline is left with the vertices the building's ring visits
+static void TriangulateBuilding(const Area& area, Mesh& mesh, std::vector<uint32_t>& outline)
+{
+	ScratchVector<Vector2f> unpacked(area.points.count);
+	area.points.Unpack(unpacked.data());
+
+	ScratchVector<REAL> points;
+	std::unordered_map<uint64_t, int, std::hash<uint64_t>, std::equal_to<uint64_t>, ScratchAllocator<std::pair<const uint64_t, int>>> seen;
+	for (const Vector2f& point : unpacked)
+	{
+		// Adding zero turns -0 into 0, so both end up with the same bits
+		float fx = point.x + 0.0f, fy = point.y + 0.0f;
+		uint32_t x, y;
+		memcpy(&x, &fx, sizeof(x));
+		memcpy(&y, &fy, sizeof(y));
+
+		uint64_t key = ((uint64_t)x << 32) | y;
+		auto it = seen.emplace(key, (int)seen.size());
+		if (it.second)
+		{
+			points.push_back(point.x);
+			points.push_back(point.y);
+		}
+
+		if (outline.empty() || outline.back() != it.first->second)
+			outline.push_back(it.first->second);
+	}
+
+	if (outline.size() > 1 && outline.back() == outline.front())
+		outline.pop_back();
+
+	ScratchVector<int> segments;
+	for (size_t i = 0; i < outline.size() && outline.size() > 1; i++)
+	{
+		segments.push_back(outline[i]);
+		segments.push_back(outline[(i + 1) % outline.size()]);
+	}
+
+	if (points.size() < 6 || segments.size() < 6)
+		return;
+
+	// Most buildings visit every spot once, then the points are already in ring order and ear clipping can take them
+	if (outline.size() == points.size() / 2)
+	{
+		ScratchVector<Vector2d> ring(outline.size());
+		for (size_t i = 0; i < ring.size(); i++)
+			ring[i] = { points[i * 2], points[i * 2 + 1] };
+
+		int start = 0;
+		ScratchVector<int> triangles;
+		if (Earcut({ ring.data(), ring.size() }, { &start, 1 }, triangles))
+		{
+			mesh.vertices.resize(ring.size());
+			for (size_t i = 0; i < ring.size(); i++)
+				mesh.vertices[i] = { (float)ring[i].x, (float)ring[i].y };
+
+			mesh.indices[0].assign(triangles.begin(), triangles.end());
+			return;
+		}
+	}
+
+	triangulateio in = {};
+	in.numberofpoints = points.size() / 2;
+	in.pointlist = points.data();
+	in.numberofsegments = segments.size() / 2;
+	in.segmentlist = segments.data();
+
+	// Triangle adds vertices where edges cross, so the output points are used instead of the input
+	triangulateio out = {};
+	char switches[] = "pzPBQ";
+	triangulate(switches, &in, &out, NULL);
+
+	mesh.vertices.resize(out.numberofpoints);
+	for (int i = 0; i < out.numberofpoints; i++)
+		mesh.vertices[i] = { (float)out.pointlist[i * 2], (float)out.pointlist[i * 2 + 1] };
+
+	mesh.indices[0].assign(out.trianglelist, out.trianglelist + out.numberoftriangles * 3);
+
+	trifree((VOID*)out.pointlist);
+	trifree(out.trianglelist);
+}
+
+// Triangulates rings made of mesh vertices without adding any new ones, false if Triangle had to
+static bool TriangulateRings(const Mesh& mesh, const Outline& outline, std::vector<uint32_t>& indices)
+{
+	indices.clear();
+
+	// Rings that don't share any vertices are in ring order, ready for ear clipping
+	ScratchVector<REAL> points, holes;
+	ScratchVector<int> segments, ringStarts;
+	ScratchVector<uint32_t> vertices;
+	std::unordered_map<uint32_t, int, std::hash<uint32_t>, std::equal_to<uint32_t>, ScratchAllocator<std::pair<const uint32_t, int>>> local;
+	bool shared = false;
+	for (size_t i = 0; i < outline.size(); i++)
+	{
+		const std::vector<uint32_t>& ring = outline[i];
+		if (ring.empty())
+			continue;
+
+		ringStarts.push_back((int)vertices.size());
+		double holeX = 0.0, holeY = 0.0;
+		for (uint32_t vertex : ring)
+		{
+			if (local.emplace(vertex, (int)vertices.size()).second)
+			{
+				vertices.push_back(vertex);
+				points.push_back(mesh.vertices[vertex].x);
+				points.push_back(mesh.vertices[vertex].y);
+			}
+			else
+				shared = true;
+
+			holeX += mesh.vertices[vertex].x;
+			holeY += mesh.vertices[vertex].y;
+		}
+
+		for (size_t j = 0; j < ring.size(); j++)
+		{
+			int a = local[ring[j]], b = local[ring[(j + 1) % ring.size()]];
+			if (a == b)
+				continue;
+
+			segments.push_back(a);
+			segments.push_back(b);
+		}
+
+		// Same guess at a point inside the hole as the multipolygon itself makes
+		if (i > 0)
+		{
+			holes.push_back(holeX / ring.size());
+			holes.push_back(holeY / ring.size());
+		}
+	}
+
+	if (points.size() < 6)
+		return true;
+
+	if (!shared)
+	{
+		ScratchVector<Vector2d> ring(vertices.size());
+		for (size_t i = 0; i < ring.size(); i++)
+			ring[i] = { points[i * 2], points[i * 2 + 1] };
+
+		ScratchVector<int> triangles;
+		if (Earcut({ ring.data(), ring.size() }, { ringStarts.data(), ringStarts.size() }, triangles))
+		{
+			indices.reserve(triangles.size());
+			for (int vertex : triangles)
+				indices.push_back(vertices[vertex]);
+
+			return true;
+		}
+	}
+
+	triangulateio in = {};
+	in.numberofpoints = points.size() / 2;
+	in.pointlist = points.data();
+	in.numberofsegments = segments.size() / 2;
+	in.segmentlist = segments.data();
+	in.numberofholes = holes.size() / 2;
+	in.holelist = holes.data();
+
+	triangulateio out = {};
+	char switches[] = "pzNBQ";
+	triangulate(switches, &in, &out, NULL);
+
+	bool valid = true;
+	indices.reserve(out.numberoftriangles * 3);
+	for (int i = 0; i < out.numberoftriangles * 3 && valid; i++)
+	{
+		valid = (out.trianglelist[i] >= 0 && out.trianglelist[i] < (int)vertices.size());
+		if (valid)
+			indices.push_back(vertices[out.trianglelist[i]]);
+	}
+
+	trifree(out.trianglelist);
+	trifree(out.segmentlist);
+	return valid;
+}
+
+// Rings of mesh vertices simplified together, a level without an outer ring left is empty
+static void SimplifyOutline(const Mesh& mesh, const Outline& outline, double tolerance, Outline& simplified)
+{
+	ScratchVector<Vector2d> points;
+	for (const std::vector<uint32_t>& ring : outline)
+	{
+		for (uint32_t vertex : ring)
+			points.push_back({ mesh.vertices[vertex].x, mesh.vertices[vertex].y });
+	}
+
+	ScratchVector<Span<const Vector2d>> rings;
+	const Vector2d* start = points.data();
+	for (const std::vector<uint32_t>& ring : outline)
+	{
+		rings.push_back({ start, ring.size() });
+		start += ring.size();
+	}
+
+	SimplifyRings({ rings.data(), rings.size() }, tolerance, simplified);
+	if (simplified.empty() || simplified.front().empty())
+	{
+		simplified.clear();
+		return;
+	}
+
+	for (size_t i = 0; i < simplified.size(); i++)
+	{
+		for (uint32_t& vertex : simplified[i])
+			vertex = outline[i][vertex];
+	}
+}
+
+static void AddRingSegments(const Outline& outline, std::vector<uint32_t>& indices)
+{
+	for (const std::vector<uint32_t>& ring : outline)
+	{
+		for (size_t i = 0; i < ring.size(); i++)
+		{
+			indices.push_back(ring[i]);
+			indices.push_back(ring[(i + 1) % ring.size()]);
+		}
+	}
+}
+
+// Fills in the coarser levels of a piece whose full detail mesh is done.
+// Levels that can't be simplified without breaking get the finer level's indices
+static void BuildLevels(Piece::Source source, const Outline& outline, Mesh& mesh)
+{
+	if (mesh.indices[0].empty())
+		return;
+
+	if (source == Piece::HIGHWAY)
+	{
+		ScratchVector<Vector2d> points;
+		points.reserve(mesh.vertices.size());
+		for (const MapArena::Vertex& vertex : mesh.vertices)
+			points.push_back({ vertex.x, vertex.y });
+
+		std::vector<uint32_t> kept;
+		for (int level = 1; level < LOD_LEVELS; level++)
+		{
+			SimplifyPolyline({ points.data(), points.size() }, MapArena::Tolerance(level), kept);
+			for (size_t i = 1; i < kept.size(); i++)
+			{
+				mesh.indices[level].push_back(kept[i - 1]);
+				mesh.indices[level].push_back(kept[i]);
+			}
+		}
+		return;
+	}
+
+	Outline simplified;
+	for (int level = 1; level < LOD_LEVELS; level++)
+	{
+		bool valid = !outline.empty();
+		if (valid)
+		{
+			SimplifyOutline(mesh, outline, MapArena::Tolerance(level), simplified);
+			if (source == Piece::POLYGON_SEGMENTS)
+				AddRingSegments(simplified, mesh.indices[level]);
+			else
+				valid = TriangulateRings(mesh, simplified, mesh.indices[level]);
+		}
+
+		if (!valid)
+			mesh.indices[level] = mesh.indices[level - 1];
+	}
+}
+
+double MapArena::Tolerance(int level)
+{
+	return (level == 0) ? 0.0 : std::ldexp(LOD_TOLERANCE, level - 1);
+}
+
+int MapArena::LevelFor(double pixelsPerUnit)
+{
+	int level = 0;
+	while (level + 1 < LOD_LEVELS && Tolerance(level + 1) * pixelsPerUnit <= LOD_PIXEL_ERROR)
+		level++;
+
+	return level;
+}
+
+Span<const MapArena::DrawRange> MapArena::Ranges(int level) const
+{
+	return { ranges.data() + level * rangeCount, rangeCount };
+}
+
+Span<const MapArena::Feature> MapArena::Features(int level) const
+{
+	return { features.data() + level * featureCount, featureCount };
+}
+
+size_t MapArena::Bytes() const
+{
+	return vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t) + ranges.size() * sizeof(DrawRange) +
+		features.size() * sizeof(Feature) + sources.size() * sizeof(Source) + spatialIndex.Bytes();
+}
+
+void MapArena::Build(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, ThreadPool& pool)
+{
+	Build(multipolygons, buildings, highways, nullptr, nullptr, pool);
+}
+
+void MapArena::Update(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, const Changes& changes, ThreadPool& pool)
+{
+	MapArena previous;
+	previous.vertices.swap(vertices);
+	previous.indices.swap(indices);
+	previous.features.swap(features);
+	previous.sources.swap(sources);
+	previous.featureCount = featureCount;
+
+	Build(multipolygons, buildings, highways, &changes, &previous, pool);
+}
+
+void MapArena::Update(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, const Changes& changes, const MapArena& previous, ThreadPool& pool)
+{
+	Build(multipolygons, buildings, highways, &changes, &previous, pool);
+}
+
+void MapArena::BuildProgressively(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, ThreadPool& pool,
+	const std::function<void(std::shared_ptr<MapArena> arena, bool complete)>& publish)
+{
+	TraceZone zone("build progressively");
+
+	// Everything that draws anything, with the size of its bounding box
+	struct Item {
+		Piece::Source kind;
+		uint32_t feature;
+		double extent;
+	};
+	std::vector<Item> items;
+	for (uint32_t i = 0; i < multipolygons.size(); i++)
+	{
+		if (multipolygons[i].visible && !multipolygons[i].polygons.empty())
+			items.push_back({ Piece::POLYGON_TRIANGLES, i, 0.0 });
+	}
+	for (uint32_t i = 0; i < buildings.size(); i++)
+	{
+		if (buildings[i].points.count > 0)
+			items.push_back({ Piece::BUILDING, i, 0.0 });
+	}
+	for (uint32_t i = 0; i < highways.size(); i++)
+	{
+		if (highways[i].points.count >= 2)
+			items.push_back({ Piece::HIGHWAY, i, 0.0 });
+	}
+
+	pool.ParallelFor(items.size(), [&](size_t i) {
+		ScratchScope scope;
+		Box box = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+		auto extend = [&box](const PackedPoints& points) {
+			ScratchVector<Vector2f> unpacked(points.count);
+			points.Unpack(unpacked.data());
+			for (const Vector2f& point : unpacked)
+			{
+				box.minX = std::min(box.minX, (double)point.x);
+				box.minY = std::min(box.minY, (double)point.y);
+				box.maxX = std::max(box.maxX, (double)point.x);
+				box.maxY = std::max(box.maxY, (double)point.y);
+			}
+		};
+
+		Item& item = items[i];
+		if (item.kind == Piece::POLYGON_TRIANGLES)
+		{
+			for (const Multipolygon::Polygon& polygon : multipolygons[item.feature].polygons)
+				extend(polygon.vertices);
+		}
+		else
+			extend(item.kind == Piece::BUILDING ? buildings[item.feature].points : highways[item.feature].points);
+
+		item.extent = std::max(box.maxX - box.minX, box.maxY - box.minY);
+	});
+
+	// Large areas and long roads are what the map looks like from afar, the rest fills in around them
+	std::stable_sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return (a.extent > b.extent); });
+
+	// Every batch is as big as everything before it, so all the copying adds up to building the arena about twice
+	std::shared_ptr<MapArena> arena = std::make_shared<MapArena>();
+	size_t published = 0;
+	do
+	{
+		size_t end = std::min(items.size(), published + std::max<size_t>(PROGRESSIVE_BATCH, published));
+		Changes batch;
+		for (size_t i = published; i < end; i++)
+		{
+			const Item& item = items[i];
+			(item.kind == Piece::BUILDING ? batch.buildings : (item.kind == Piece::HIGHWAY ? batch.highways : batch.multipolygons)).insert(item.feature);
+		}
+
+		// The last arena is still being drawn, the next one only takes meshes out of it
+		std::shared_ptr<MapArena> next = std::make_shared<MapArena>();
+		next->Update(multipolygons, buildings, highways, batch, *arena, pool);
+		arena = std::move(next);
+		published = end;
+
+		publish(arena, published == items.size());
+	} while (published < items.size());
+}
+
+void MapArena::Build(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, const Changes* changes,
+	const MapArena* previous, ThreadPool& pool)
+{
+	TraceZone zone(changes ? "update arena" : "build arena");
+
+	// An update takes the meshes of the features that didn't change out of the previous buffers
+	std::unordered_map<uint64_t, uint32_t> oldPieces;	// Feature of every source
+	auto sourceKey = [](uint32_t kind, uint32_t feature, uint32_t polygon) { return ((uint64_t)kind << 62) | ((uint64_t)polygon << 32) | feature; };
+	if (previous)
+	{
+		for (uint32_t i = 0; i < previous->sources.size(); i++)
+			oldPieces[sourceKey(previous->sources[i].kind, previous->sources[i].feature, previous->sources[i].polygon)] = i;
+	}
+
+	vertices.clear();
+	indices.clear();
+	ranges.clear();
+	features.clear();
+	sources.clear();
+
+	// First decide which layer and color every piece goes to
+	struct Group {
+		Layer layer;
+		DrawRange range;
+		size_t vertexCount, indexCount[LOD_LEVELS];
+		size_t vertexCursor, indexCursor[LOD_LEVELS];
+	};
+	std::vector<Group> groups;
+	std::unordered_map<uint32_t, uint32_t> groupIds;
+	std::vector<Piece> pieces;
+
+	auto add = [&groups, &groupIds, &pieces](Layer layer, DrawRange::Primitive primitive, int r, int g, int b, Piece piece) {
+		uint32_t key = ((uint32_t)layer << 24) | ((uint32_t)(uint8_t)r << 16) | ((uint32_t)(uint8_t)g << 8) | (uint8_t)b;
+		auto it = groupIds.emplace(key, (uint32_t)groups.size());
+		if (it.second)
+			groups.push_back({ layer, { primitive, (uint8_t)r, (uint8_t)g, (uint8_t)b, 0, 0, layer } });
+
+		piece.group = it.first->second;
+		pieces.push_back(piece);
+	};
+
+	for (uint32_t i = 0; i < multipolygons.size(); i++)
+	{
+		const Multipolygon& multipolygon = multipolygons[i];
+		if (!multipolygon.visible)
+			continue;
+
+		for (uint32_t j = 0; j < multipolygon.polygons.size(); j++)
+		{
+			switch (multipolygon.rendering)
+			{
+			case Multipolygon::RenderType::FILL:
+				add(FILLED_AREAS, DrawRange::TRIANGLES, multipolygon.r, multipolygon.g, multipolygon.b, { Piece::POLYGON_TRIANGLES, i, j });
+				break;
+
+			case Multipolygon::RenderType::OUTLINE:
+				add(OUTLINES, DrawRange::LINES, multipolygon.r, multipolygon.g, multipolygon.b, { Piece::POLYGON_SEGMENTS, i, j });
+				break;
+
+			case Multipolygon::RenderType::INDOOR:
+				add(INDOOR, DrawRange::TRIANGLES, multipolygon.r, multipolygon.g, multipolygon.b, { Piece::POLYGON_TRIANGLES, i, j });
+				break;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < buildings.size(); i++)
+		add(BUILDINGS, DrawRange::TRIANGLES, buildings[i].r, buildings[i].g, buildings[i].b, { Piece::BUILDING, i, 0 });
+
+	for (uint32_t i = 0; i < highways.size(); i++)
+	{
+		if (highways[i].points.count >= 2)
+			add(HIGHWAYS, DrawRange::LINES, highways[i].r, highways[i].g, highways[i].b, { Piece::HIGHWAY, i, 0 });
+	}
+
+	// Triangulating buildings and simplifying everything is the expensive part, the pieces don't depend on each other.
+	// Only the meshes are kept, everything else lives in the scratch arena until the piece is done
+	std::vector<Mesh> meshes(pieces.size());
+	pool.ParallelFor(pieces.size(), [&](size_t i) {
+		ScratchScope scope;
+		const Piece& piece = pieces[i];
+		Mesh& mesh = meshes[i];
+
+		if (changes)
+		{
+			const std::unordered_set<uint32_t>& changed = (piece.source == Piece::BUILDING) ? changes->buildings :
+				((piece.source == Piece::HIGHWAY) ? changes->highways : changes->multipolygons);
+
+			// Unchanged pieces that aren't in the buffers had nothing to draw
+			if (!changed.count(piece.feature))
+			{
+				auto it = oldPieces.find(sourceKey(piece.source, piece.feature, piece.polygon));
+				if (it == oldPieces.end())
+					return;
+
+				const Feature& old = previous->features[it->second];
+				mesh.vertices.assign(previous->vertices.begin() + old.firstVertex, previous->vertices.begin() + old.firstVertex + old.vertexCount);
+				for (int level = 0; level < LOD_LEVELS; level++)
+				{
+					const Feature& oldLevel = previous->features[level * previous->featureCount + it->second];
+					mesh.indices[level].reserve(oldLevel.count);
+					for (uint32_t j = oldLevel.first; j < oldLevel.first + oldLevel.count; j++)
+						mesh.indices[level].push_back(previous->indices[j] - oldLevel.firstVertex);
+				}
+				return;
+			}
+		}
+
+		Outline outline;
+		switch (piece.source)
+		{
+		case Piece::POLYGON_TRIANGLES:
+		case Piece::POLYGON_SEGMENTS:
+		{
+			const Multipolygon::Polygon& polygon = multipolygons[piece.feature].polygons[piece.polygon];
+			mesh.vertices.resize(polygon.vertices.count);
+			polygon.vertices.Unpack(mesh.vertices.data());
+
+			const PackedIndices& elements = (piece.source == Piece::POLYGON_TRIANGLES) ? polygon.indices : polygon.segments;
+			mesh.indices[0].resize(elements.count);
+			elements.Unpack(mesh.indices[0].data());
+
+			// Segments run around every ring in order, so the rings fall right out of them
+			for (size_t j = 0; j < polygon.rings.size(); j++)
+			{
+				size_t end = (j + 1 < polygon.rings.size()) ? polygon.rings[j + 1] : polygon.segments.size();
+				outline.push_back({});
+				for (size_t k = polygon.rings[j]; k < end; k += 2)
+					outline.back().push_back(polygon.segments[k]);
+			}
+			break;
+		}
+
+		case Piece::BUILDING:
+			outline.push_back({});
+			TriangulateBuilding(buildings[piece.feature], mesh, outline.back());
+			break;
+
+		case Piece::HIGHWAY:
+		{
+			const Highway& highway = highways[piece.feature];
+			mesh.vertices.resize(highway.points.count);
+			highway.points.Unpack(mesh.vertices.data());
+			for (uint32_t j = 1; j < highway.points.count; j++)
+			{
+				mesh.indices[0].push_back(j - 1);
+				mesh.indices[0].push_back(j);
+			}
+			break;
+		}
+		}
+
+		BuildLevels(piece.source, outline, mesh);
+	});
+
+	// Pieces without anything to draw at full detail are left out completely
+	size_t kept = 0;
+	for (size_t i = 0; i < pieces.size(); i++)
+	{
+		if (meshes[i].indices[0].empty())
+			continue;
+
+		Group& group = groups[pieces[i].group];
+		group.vertexCount += meshes[i].vertices.size();
+		for (int level = 0; level < LOD_LEVELS; level++)
+			group.indexCount[level] += meshes[i].indices[level].size();
+
+		if (kept != i)
+		{
+			pieces[kept] = pieces[i];
+			meshes[kept] = std::move(meshes[i]);
+		}
+		kept++;
+	}
+	pieces.resize(kept);
+	meshes.resize(kept);
+
+	// Groups stay in the order they showed up in within their layer, empty ones don't get a range
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < groups.size(); i++)
+	{
+		if (groups[i].indexCount[0] > 0)
+			order.push_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&groups](uint32_t a, uint32_t b) { return (groups[a].layer < groups[b].layer); });
+
+	std::vector<uint32_t> rangeOf(groups.size());
+	size_t vertexCount = 0;
+	for (uint32_t i = 0; i < order.size(); i++)
+	{
+		groups[order[i]].vertexCursor = vertexCount;
+		vertexCount += groups[order[i]].vertexCount;
+		rangeOf[order[i]] = i;
+	}
+
+	rangeCount = order.size();
+	ranges.reserve(rangeCount * LOD_LEVELS);
+	size_t indexCount = 0;
+	for (int level = 0; level < LOD_LEVELS; level++)
+	{
+		for (uint32_t i : order)
+		{
+			Group& group = groups[i];
+			group.indexCursor[level] = indexCount;
+			group.range.first = indexCount;
+			group.range.count = group.indexCount[level];
+			ranges.push_back(group.range);
+
+			indexCount += group.indexCount[level];
+		}
+	}
+
+	vertices.resize(vertexCount);
+	indices.resize(indexCount);
+
+	featureCount = pieces.size();
+	features.resize(featureCount * LOD_LEVELS);
+	std::vector<Box> bounds(featureCount);
+	for (size_t i = 0; i < pieces.size(); i++)
+	{
+		Group& group = groups[pieces[i].group];
+		const Mesh& mesh = meshes[i];
+		uint32_t base = group.vertexCursor;
+		std::copy(mesh.vertices.begin(), mesh.vertices.end(), vertices.begin() + base);
+		group.vertexCursor += mesh.vertices.size();
+
+		for (int level = 0; level < LOD_LEVELS; level++)
+		{
+			uint32_t* index = indices.data() + group.indexCursor[level];
+			for (uint32_t element : mesh.indices[level])
+				*index++ = base + element;
+
+			features[level * featureCount + i] = { rangeOf[pieces[i].group], (uint32_t)group.indexCursor[level], (uint32_t)mesh.indices[level].size(), base, (uint32_t)mesh.vertices.size() };
+			group.indexCursor[level] += mesh.indices[level].size();
+		}
+
+		// Simplified geometry only ever uses a subset of the vertices, so this box holds for every level
+		Box box = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+		for (const Vertex& v : mesh.vertices)
+		{
+			box.minX = std::min(box.minX, (double)v.x);
+			box.minY = std::min(box.minY, (double)v.y);
+			box.maxX = std::max(box.maxX, (double)v.x);
+			box.maxY = std::max(box.maxY, (double)v.y);
+		}
+		bounds[i] = box;
+	}
+
+	// Pieces were added in load order, bring the features into draw order. Every level is laid out in the same
+	// order of groups and pieces, so sorting by the full detail level sorts all of them
+	std::vector<uint32_t> sorted(featureCount);
+	std::iota(sorted.begin(), sorted.end(), 0);
+	std::sort(sorted.begin(), sorted.end(), [this](uint32_t a, uint32_t b) { return (features[a].first < features[b].first); });
+
+	std::vector<Feature> sortedFeatures(features.size());
+	std::vector<Box> sortedBounds(featureCount);
+	sources.resize(featureCount);
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		for (int level = 0; level < LOD_LEVELS; level++)
+			sortedFeatures[level * featureCount + i] = features[level * featureCount + sorted[i]];
+
+		sortedBounds[i] = bounds[sorted[i]];
+		sources[i] = { (uint32_t)pieces[sorted[i]].source, pieces[sorted[i]].feature, pieces[sorted[i]].polygon };
+	}
+	features = std::move(sortedFeatures);
+
+	spatialIndex.Build(sortedBounds);
+}
+
+void MapArena::Visible(const Box& view, std::vector<uint32_t>& result) const
+{
+	size_t first = result.size();
+	spatialIndex.Query(view, result);
+
+	// The tree hands them out in whatever order its leaves are in
+	std::sort(result.begin() + first, result.end());
+}
+
+bool MapArena::Check() const
+{
+	if (ranges.size() != rangeCount * LOD_LEVELS || features.size() != featureCount * LOD_LEVELS)
+	{
+		std::cerr << "There should be " << LOD_LEVELS << " levels of " << rangeCount << " ranges and " << featureCount << " features" << std::endl;
+		return false;
+	}
+
+	// Levels follow each other in the index buffer, so all of them together have to tile it as well
+	size_t next = 0;
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		const DrawRange& range = ranges[i];
+		if (range.first != next)
+		{
+			std::cerr << "Draw range starting at " << range.first << " should start at " << next << std::endl;
+			return false;
+		}
+
+		if ((range.count == 0 && i < rangeCount) || range.count % (range.primitive == DrawRange::TRIANGLES ? 3 : 2) != 0)
+		{
+			std::cerr << "Draw range starting at " << range.first << " has " << range.count << " indices, that's not a whole number of primitives" << std::endl;
+			return false;
+		}
+
+		next += range.count;
+	}
+
+	if (next != indices.size())
+	{
+		std::cerr << "Draw ranges cover " << next << " of " << indices.size() << " indices" << std::endl;
+		return false;
+	}
+
+	next = 0;
+	for (size_t i = 0; i < features.size(); i++)
+	{
+		const Feature& feature = features[i];
+		const DrawRange& range = ranges[i / featureCount * rangeCount + feature.range];
+		if (feature.first != next || feature.first < range.first || feature.first + feature.count > range.first + range.count)
+		{
+			std::cerr << "Feature " << i << " doesn't line up with the ones before it or isn't inside its draw range" << std::endl;
+			return false;
+		}
+
+		next += feature.count;
+	}
+
+	if (next != indices.size() || spatialIndex.Size() != featureCount)
+	{
+		std::cerr << "Features cover " << next << " of " << indices.size() << " indices, " << spatialIndex.Size() << " of them are indexed" << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (indices[i] >= vertices.size())
+		{
+			std::cerr << "Index " << i << " points at vertex " << indices[i] << ", there are only " << vertices.size() << std::endl;
+			return false;
+		}
+	}
+
+	// Culling only transforms the vertices of visible features, so features must not reach into each other's vertices
+	for (size_t i = 0; i < features.size(); i++)
+	{
+		const Feature& feature = features[i];
+		for (uint32_t j = feature.first; j < feature.first + feature.count; j++)
+		{
+			if (indices[j] < feature.firstVertex || indices[j] >= feature.firstVertex + feature.vertexCount)
+			{
+				std::cerr << "Feature " << i << " uses vertex " << indices[j] << " outside of its own vertices" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "span.hpp"
+#include "vector2.hpp"
+#include "multipolygon.hpp"
+#include "features.hpp"
+#include "ThreadPool.hpp"
+#include "SpatialIndex.hpp"
+
+// Detail levels, every level halves the scale it's meant for, so there is one level per zoom level
+#define LOD_LEVELS 8
+
+// How far the first simplified level may stray from the original, in world units (meters)
+#define LOD_TOLERANCE 0.5
+
+// How far simplified geometry may stray from the original, in pixels on screen
+#define LOD_PIXEL_ERROR 0.5
+
+// Features in the first arena BuildProgressively hands out, every later batch is as big as all batches before it
+#define PROGRESSIVE_BATCH 1024
+
+// All renderable geometry of the map in a single vertex and a single index buffer, ready to be uploaded as is.
+// Geometry with the same primitive and color sits back to back in both buffers, so a whole group is one draw call.
+// Rings and lines are simplified for every detail level up front, the levels share the vertices and
+// each get their own slice of the index buffer with the same ranges and features in it
+class MapArena
+{
+public:
+	typedef Vector2f Vertex;	// In world units
+
+	// Later layers are drawn on top of earlier ones
+	enum Layer {
+		FILLED_AREAS,
+		OUTLINES,
+		INDOOR,
+		BUILDINGS,
+		HIGHWAYS,
+		LAYER_COUNT
+	};
+
+	struct DrawRange {
+		enum Primitive {
+			TRIANGLES,
+			LINES
+		} primitive;
+		uint8_t r, g, b;
+		uint32_t first, count;	// Into the index buffer
+		Layer layer;
+	};
+
+	// The indices a single multipolygon part, building or highway got, empty if it vanished at that level
+	struct Feature {
+		uint32_t range;			// Into the ranges of the same level
+		uint32_t first, count;
+		uint32_t firstVertex, vertexCount;	// The same on every level
+	};
+
+	// Positions of the features an update touched in the vectors handed to Build
+	struct Changes {
+		std::unordered_set<uint32_t> multipolygons, buildings, highways;
+	};
+
+public:
+	// Multipolygons are expected in render order. Building outlines are triangulated on the pool
+	void Build(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, ThreadPool& pool);
+
+	// Builds again after some features changed. Every other feature has to be where it was in the vectors the last time,
+	// its meshes are taken from the current buffers instead of being triangulated and simplified again
+	void Update(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, const Changes& changes, ThreadPool& pool);
+
+	// The same with the meshes taken from another arena, which is left alone. Features neither in it nor in changes are left out,
+	// so an arena can grow a few features at a time while the last one is still being drawn
+	void Update(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, const Changes& changes,
+		const MapArena& previous, ThreadPool& pool);
+
+	// Builds the arena in batches, the features with the largest bounding boxes first. Every batch makes a new arena with everything
+	// so far, which goes to publish right away. The last one has every feature and is the same arena Build makes
+	static void BuildProgressively(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, ThreadPool& pool,
+		const std::function<void(std::shared_ptr<MapArena> arena, bool complete)>& publish);
+
+	// Verifies that the ranges and the features of every level tile its slice of the index buffer
+	// and every index points at a vertex
+	bool Check() const;
+
+	// Largest distance between simplified and original geometry on a level, in world units
+	static double Tolerance(int level);
+
+	// The coarsest level that still looks right when one map unit is drawn this many pixels wide
+	static int LevelFor(double pixelsPerUnit);
+
+	// Memory the buffers and the index take up
+	size_t Bytes() const;
+
+	const std::vector<Vertex>& Vertices() const { return vertices; }
+	const std::vector<uint32_t>& Indices() const { return indices; }	// All levels back to back
+	Span<const DrawRange> Ranges(int level = 0) const;		// In draw order
+	Span<const Feature> Features(int level = 0) const;		// In draw order, the same features on every level
+
+	// Bounding boxes of the features, queries return positions in Features()
+	const SpatialIndex& Index() const { return spatialIndex; }
+
+	// Appends the features overlapping the view, in draw order
+	void Visible(const Box& view, std::vector<uint32_t>& result) const;
+
+private:
+	// Where a feature came from, a part of a multipolygon, a building or a highway
+	struct Source {
+		uint32_t kind;
+		uint32_t feature, polygon;
+	};
+
+	void Build(const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, const Changes* changes,
+		const MapArena* previous, ThreadPool& pool);
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<DrawRange> ranges;		// LOD_LEVELS blocks of rangeCount
+	std::vector<Feature> features;		// LOD_LEVELS blocks of featureCount
+	std::vector<Source> sources;		// Of every feature, in draw order
+	size_t rangeCount = 0, featureCount = 0;
+	SpatialIndex spatialIndex;
+};
@@ -0,0 +1,184 @@
+#include "MapBuilder.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "MapArena.hpp"
+#include "Trace.hpp"
+
+MapBuilder::MapBuilder(std::vector<Multipolygon>& multipolygons, std::vector<Area>& buildings, std::vector<Highway>& highways, GeometryStore& geometry, const StyleTable& style, ThreadPool& pool) :
+	multipolygons(multipolygons), buildings(buildings), highways(highways), geometry(geometry), style(style), pool(pool), sorted(multipolygons.size()), bounds{}
+{
+}
+
+MapBuilder::~MapBuilder()
+{
+	Cancel();
+}
+
+void MapBuilder::SetBounds(const osmp::Bounds& bounds)
+{
+	this->bounds = bounds;
+	world = World(bounds);
+}
+
+MapBuilder::WayFeature MapBuilder::AddWay(const NodeList& nodes, const Tags& tags, bool area)
+{
+	Style wayStyle = { 0, 0, 0, Style::FILL, true };
+	bool styled;
+	{
+		TraceZone zone("style");
+		styled = style.Resolve(area ? StyleTable::AREA : StyleTable::LINE, tags, wayStyle);
+	}
+
+	if (!styled || !wayStyle.visible)
+		return {};
+
+	// Turn them into renderable ways in world space
+	ScratchScope scope;
+	ScratchVector<Vector2d> points(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+		points[i] = world.ToWorld(nodes[i].lon, nodes[i].lat);
+
+	if (area)
+	{
+		Area area;
+		area.points = geometry.AddPoints(points.data(), points.size());
+
+		area.r = wayStyle.r;
+		area.g = wayStyle.g;
+		area.b = wayStyle.b;
+
+		buildings.push_back(area);
+		Progress();
+		return { WayFeature::BUILDING, (uint32_t)buildings.size() - 1 };
+	}
+	else
+	{
+		Highway highway;
+		highway.points = geometry.AddPoints(points.data(), points.size());
+
+		highway.r = wayStyle.r;
+		highway.g = wayStyle.g;
+		highway.b = wayStyle.b;
+
+		highways.push_back(highway);
+		Progress();
+		return { WayFeature::HIGHWAY, (uint32_t)highways.size() - 1 };
+	}
+}
+
+void MapBuilder::AddMultipolygon(uint64_t id, const Tags& tags, const std::vector<RelationMember>& members)
+{
+	// Relations no rule matches stay magenta, so they stand out
+	Style relationStyle = { 255, 0, 255, Style::FILL, true };
+	bool styled;
+	{
+		TraceZone zone("style");
+		zone.Arg("id", id);
+		styled = style.Resolve(StyleTable::MULTIPOLYGON, tags, relationStyle);
+	}
+
+	if (!styled)
+		std::cout << "No style matches multipolygon " << id << std::endl;
+
+	// The member nodes belong to the caller, so the task needs its own copy
+	struct Relation {
+		uint64_t id;
+		Style style;
+		std::vector<NodeList> nodes;
+		std::vector<RelationMember> members;
+	};
+
+	std::shared_ptr<Relation> relation = std::make_shared<Relation>();
+	relation->id = id;
+	relation->style = relationStyle;
+	relation->nodes.reserve(members.size());
+	for (const RelationMember& member : members)
+	{
+		relation->nodes.push_back(*member.nodes);
+		relation->members.push_back({ &relation->nodes.back(), member.inner });
+	}
+
+	// Deque elements stay where they are when more are added, so the task can hold on to its slot
+	pending.emplace_back();
+	Pending* slot = &pending.back();
+
+	World mapWorld = world;
+	GeometryStore* store = &geometry;
+	TriangulationCache* cache = triangulations;
+	pool.Submit([relation, slot, mapWorld, store, cache]() {
+		slot->multipolygon = std::make_unique<Multipolygon>(relation->id, relation->style, relation->members, mapWorld, *store, cache);
+		slot->done.store(true, std::memory_order_release);
+	}, tasks);
+
+	Progress();
+}
+
+void MapBuilder::RemoveWay(const WayFeature& feature)
+{
+	// Nothing is drawn for features without points
+	if (feature.kind == WayFeature::BUILDING)
+		buildings[feature.index].points = {};
+	else if (feature.kind == WayFeature::HIGHWAY)
+		highways[feature.index].points = {};
+}
+
+void MapBuilder::RemoveMultipolygon(uint32_t index)
+{
+	multipolygons[index].Clear();
+}
+
+size_t MapBuilder::Finish()
+{
+	{
+		TraceZone zone("wait for multipolygons");
+		zone.Arg("multipolygons", pending.size());
+		pool.Wait(tasks);
+	}
+
+	multipolygons.reserve(multipolygons.size() + pending.size());
+	for (Pending& multipolygon : pending)
+		multipolygons.push_back(std::move(*multipolygon.multipolygon));
+	pending.clear();
+
+	// The ones progress handed over early are sorted along with the rest, so the order is the same as without progress
+	size_t first = sorted;
+	std::stable_sort(multipolygons.begin() + first, multipolygons.end());
+	sorted = multipolygons.size();
+	return first;
+}
+
+void MapBuilder::Cancel()
+{
+	// Nobody is left to hear about a task that threw
+	try
+	{
+		pool.Wait(tasks);
+	}
+	catch (...)
+	{
+	}
+
+	pending.clear();
+}
+
+void MapBuilder::Progress()
+{
+	if (!progress)
+		return;
+
+	// Deque elements after the front stay where they are, the tasks still building them aren't disturbed
+	while (!pending.empty() && pending.front().done.load(std::memory_order_acquire))
+	{
+		multipolygons.push_back(std::move(*pending.front().multipolygon));
+		pending.pop_front();
+	}
+
+	size_t features = multipolygons.size() + buildings.size() + highways.size();
+	if (features < reported + std::max<size_t>(PROGRESSIVE_BATCH, reported))
+		return;
+
+	reported = features;
+	progress();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <osmp.hpp>
+#include "OsmData.hpp"
+#include "multipolygon.hpp"
+#include "features.hpp"
+#include "Geometry.hpp"
+#include "ThreadPool.hpp"
+#include "Style.hpp"
+#include "Projection.hpp"
+#include "TriangulationCache.hpp"
+
+// Turns map data into renderable features, no matter where the data comes from.
+// Geometry is projected into world space around the center of the map bounds.
+// Features are styled by the style table, ways without a matching rule are dropped.
+// All geometry is packed into the geometry store, which has to outlive the features.
+// Multipolygons are built on the thread pool in the background, they only show up after Finish() or with the progress
+class MapBuilder
+{
+public:
+	MapBuilder(std::vector<Multipolygon>& multipolygons, std::vector<Area>& buildings, std::vector<Highway>& highways, GeometryStore& geometry, const StyleTable& style, ThreadPool& pool);
+	~MapBuilder();	// Waits for the multipolygons still being built
+
+	MapBuilder(const MapBuilder&) = delete;
+	MapBuilder& operator=(const MapBuilder&) = delete;
+
+	// Has to be called before any features are added
+	void SetBounds(const osmp::Bounds& bounds);
+
+	// Optional, multipolygons triangulated in earlier runs are taken from the cache. It has to outlive Finish()
+	void SetTriangulationCache(TriangulationCache* cache) { triangulations = cache; }
+
+	// Optional, called while features are added, once there are PROGRESSIVE_BATCH of them and then whenever there are as many
+	// new ones as there were before. Multipolygons that are done by then are appended first, in the order they were added
+	// but not in render order yet, which Finish() takes care of. The features are only appended to until Finish()
+	void SetProgress(std::function<void()> progress) { this->progress = std::move(progress); }
+
+	// Where a way ended up, if anywhere
+	struct WayFeature {
+		enum Kind : uint8_t {
+			NONE,
+			BUILDING,
+			HIGHWAY
+		} kind = NONE;
+		uint32_t index = 0;	// Into buildings or highways
+	};
+
+	// Closed ways are areas, open ways become highways or railways
+	WayFeature AddWay(const NodeList& nodes, const Tags& tags, bool area);
+	void AddMultipolygon(uint64_t id, const Tags& tags, const std::vector<RelationMember>& members);
+
+	// Empty the feature where it is, so every other feature keeps its position
+	void RemoveWay(const WayFeature& feature);
+	void RemoveMultipolygon(uint32_t index);
+
+	// Waits for all multipolygons added since the last call, appends them and brings them into render order.
+	// The order only depends on the order they were added in, not on which thread finished first.
+	// Multipolygons that were already there stay where they are. Returns where the first of the new ones ended up
+	size_t Finish();
+
+	// Waits for the multipolygons still being built and drops them, for loads that give up halfway. They point into
+	// the geometry store and the triangulation cache, so those have to stay around until this returns
+	void Cancel();
+
+	const osmp::Bounds& Bounds() const { return bounds; }
+	const World& WorldSpace() const { return world; }
+	const StyleTable& Styles() const { return style; }
+	ThreadPool& Pool() const { return pool; }
+	const std::vector<Multipolygon>& Multipolygons() const { return multipolygons; }
+
+private:
+	struct Pending {
+		std::unique_ptr<Multipolygon> multipolygon;
+		std::atomic<bool> done{ false };
+	};
+
+	// Hands the multipolygons that are done at the front of pending over, and reports progress if it's time to
+	void Progress();
+
+private:
+	std::vector<Multipolygon>& multipolygons;
+	std::vector<Area>& buildings;
+	std::vector<Highway>& highways;
+	GeometryStore& geometry;
+
+	const StyleTable& style;
+	ThreadPool& pool;
+	TriangulationCache* triangulations = nullptr;
+
+	std::deque<Pending> pending;	// In the order they were added
+	ThreadPool::Group tasks;	// Building the pending multipolygons
+	size_t sorted;	// Multipolygons before this one are in render order
+
+	std::function<void()> progress;
+	size_t reported = 0;	// Features there were at the last progress
+
+	osmp::Bounds bounds;
+	World world;
+};
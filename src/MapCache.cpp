@@ -0,0 +1,441 @@
+#include "MapCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+#define CACHE_MAGIC "MVCACHE"
+#define CACHE_VERSION 6
+
+namespace fs = std::filesystem;
+
+struct Section {
+	uint64_t offset;
+	uint64_t count;
+};
+
+struct Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	MapCache::Fingerprint source;
+	uint64_t style;			// StyleTable::Hash() of the rules the features were styled with
+
+	uint32_t projection;	// World::Projection::Id the geometry is in
+	uint32_t padding;
+	double minlat, minlon, maxlat, maxlon;
+
+	Section multipolygons;	// MultipolygonRecord
+	Section polygons;		// PolygonRecord
+	Section areas;			// FeatureRecord
+	Section highways;		// FeatureRecord
+	Section geometry;		// Bytes of packed points and indices, every one of them 4 byte aligned
+};
+
+// Packed geometry is stored as is, the offsets are into the geometry section
+struct PointsRecord {
+	uint64_t offset;
+	int32_t originX, originY;
+	uint32_t count;
+	uint32_t encoding;
+};
+
+struct IndicesRecord {
+	uint64_t offset;
+	uint32_t count;
+	uint32_t wide;
+};
+
+struct MultipolygonRecord {
+	uint64_t id;
+	uint32_t firstPolygon;
+	uint32_t polygonCount;
+	int32_t r, g, b;
+	uint8_t visible;
+	uint8_t rendering;
+	uint8_t padding[2];
+};
+
+struct PolygonRecord {
+	PointsRecord vertices;
+	IndicesRecord indices;
+	IndicesRecord segments;
+	IndicesRecord rings;
+};
+
+struct FeatureRecord {
+	PointsRecord points;
+	uint8_t r, g, b;
+	uint8_t padding[5];
+};
+
+// 64 bit FNV-1a
+static uint64_t Hash(const char* data, size_t length, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (uint8_t)data[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+bool MapCache::TakeFingerprint(const std::string& path, Fingerprint& fingerprint)
+{
+	std::error_code error;
+	fingerprint.size = fs::file_size(path, error);
+	if (error)
+		return false;
+
+	fingerprint.modified = fs::last_write_time(path, error).time_since_epoch().count();
+	if (error)
+		return false;
+
+	// Hash the start, middle and end of the file
+	const size_t blockSize = 64 * 1024;
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::vector<char> block(blockSize);
+	fingerprint.sample = 0xcbf29ce484222325ull;
+	uint64_t positions[3] = { 0, fingerprint.size / 2, (fingerprint.size > blockSize) ? fingerprint.size - blockSize : 0 };
+	for (uint64_t position : positions)
+	{
+		file.seekg(position);
+		file.read(block.data(), blockSize);
+		fingerprint.sample = Hash(block.data(), (size_t)file.gcount(), fingerprint.sample);
+		file.clear();
+	}
+
+	return true;
+}
+
+// Collects all sections in memory before they're written out back to back
+class SectionWriter
+{
+public:
+	template<typename T>
+	Section Append(const T* data, size_t count)
+	{
+		Align();
+
+		Section section = { buffer.size(), count };
+		const char* bytes = (const char*)data;
+		buffer.insert(buffer.end(), bytes, bytes + sizeof(T) * count);
+		return section;
+	}
+
+	template<typename T>
+	Section Append(const std::vector<T>& data)
+	{
+		return Append(data.data(), data.size());
+	}
+
+	std::vector<char> buffer;
+
+private:
+	void Align()
+	{
+		buffer.resize((buffer.size() + 7) & ~(size_t)7);
+	}
+};
+
+// Collects the packed geometry of all features
+class GeometryWriter
+{
+public:
+	PointsRecord Append(const PackedPoints& points)
+	{
+		return { Append(points.offsets, points.Bytes()), points.originX, points.originY, points.count, points.encoding };
+	}
+
+	IndicesRecord Append(const PackedIndices& indices)
+	{
+		return { Append(indices.data, indices.Bytes()), indices.count, indices.wide };
+	}
+
+	std::vector<uint8_t> buffer;
+
+private:
+	uint64_t Append(const void* data, size_t size)
+	{
+		uint64_t offset = buffer.size();
+		buffer.insert(buffer.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+		buffer.resize((buffer.size() + 3) & ~(size_t)3);
+		return offset;
+	}
+};
+
+// Points packed geometry at the mapped geometry section, false if the record reaches past it
+static bool MapPoints(const PointsRecord& record, const uint8_t* geometry, uint64_t size, PackedPoints& points)
+{
+	points = { record.originX, record.originY, record.count, (PackedPoints::Encoding)record.encoding, nullptr };
+	if (record.encoding > PackedPoints::OFFSETS_32 || record.offset % 4 != 0 || record.offset > size || points.Bytes() > size - record.offset)
+		return false;
+
+	points.offsets = geometry + record.offset;
+	return true;
+}
+
+// Every index has to be below limit, the arena reads whatever they point at without checking
+static bool MapIndices(const IndicesRecord& record, const uint8_t* geometry, uint64_t size, size_t limit, PackedIndices& indices)
+{
+	indices = { record.count, record.wide, nullptr };
+	if (record.offset % 4 != 0 || record.offset > size || indices.Bytes() > size - record.offset)
+		return false;
+
+	indices.data = geometry + record.offset;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (indices[i] >= limit)
+			return false;
+	}
+
+	return true;
+}
+
+template<typename T>
+static bool CheckSection(const Section& section, size_t fileSize)
+{
+	return (section.offset % alignof(T) == 0 && section.offset <= fileSize && section.count <= (fileSize - section.offset) / sizeof(T));
+}
+
+std::string MapCache::PathFor(const std::string& source)
+{
+	return source + ".cache";
+}
+
+bool MapCache::Write(const std::string& source, uint64_t style, const osmp::Bounds& bounds,
+	const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways)
+{
+	Fingerprint fingerprint;
+	if (!TakeFingerprint(source, fingerprint))
+	{
+		std::cerr << "Failed to read source file " << source << " for caching" << std::endl;
+		return false;
+	}
+
+	return Write(PathFor(source), fingerprint, style, bounds, multipolygons, buildings, highways);
+}
+
+bool MapCache::Write(const std::string& path, const Fingerprint& source, uint64_t style, const osmp::Bounds& bounds,
+	const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways)
+{
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.headerSize = sizeof(Header);
+	header.style = style;
+	header.projection = World::Projection::Id;
+	header.minlat = bounds.minlat;
+	header.minlon = bounds.minlon;
+	header.maxlat = bounds.maxlat;
+	header.maxlon = bounds.maxlon;
+	header.source = source;
+
+	// Flatten multipolygons
+	GeometryWriter geometry;
+	std::vector<MultipolygonRecord> multipolygonRecords;
+	std::vector<PolygonRecord> polygonRecords;
+	for (const Multipolygon& multipolygon : multipolygons)
+	{
+		MultipolygonRecord record = {};
+		record.id = multipolygon.id;
+		record.firstPolygon = polygonRecords.size();
+		record.polygonCount = multipolygon.polygons.size();
+		record.r = multipolygon.r;
+		record.g = multipolygon.g;
+		record.b = multipolygon.b;
+		record.visible = multipolygon.visible;
+		record.rendering = multipolygon.rendering;
+		multipolygonRecords.push_back(record);
+
+		for (const Multipolygon::Polygon& polygon : multipolygon.polygons)
+		{
+			polygonRecords.push_back({
+				geometry.Append(polygon.vertices),
+				geometry.Append(polygon.indices),
+				geometry.Append(polygon.segments),
+				geometry.Append(polygon.rings)
+			});
+		}
+	}
+
+	// Flatten buildings and highways
+	std::vector<FeatureRecord> areaRecords;
+	for (const Area& area : buildings)
+		areaRecords.push_back({ geometry.Append(area.points), area.r, area.g, area.b });
+
+	std::vector<FeatureRecord> highwayRecords;
+	for (const Highway& highway : highways)
+		highwayRecords.push_back({ geometry.Append(highway.points), highway.r, highway.g, highway.b });
+
+	SectionWriter writer;
+	writer.Append(&header, 1);
+	header.multipolygons = writer.Append(multipolygonRecords);
+	header.polygons = writer.Append(polygonRecords);
+	header.areas = writer.Append(areaRecords);
+	header.highways = writer.Append(highwayRecords);
+	header.geometry = writer.Append(geometry.buffer);
+	memcpy(writer.buffer.data(), &header, sizeof(Header));
+
+	// Write to a temporary file first so a crash never leaves a half written cache behind
+	std::string temporary = path + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file)
+	{
+		std::cerr << "Failed to create map cache " << temporary << std::endl;
+		return false;
+	}
+
+	bool success = (fwrite(writer.buffer.data(), 1, writer.buffer.size(), file) == writer.buffer.size());
+	success &= (fclose(file) == 0);
+
+	std::error_code error;
+	if (success)
+		fs::rename(temporary, path, error);
+
+	if (!success || error)
+	{
+		std::cerr << "Failed to write map cache " << path << std::endl;
+		fs::remove(temporary, error);
+		return false;
+	}
+
+	return true;
+}
+
+bool MapCache::Load(const std::string& source, uint64_t style,
+	std::vector<Multipolygon>& multipolygons, std::vector<Area>& buildings, std::vector<Highway>& highways)
+{
+	Fingerprint fingerprint;
+	if (!TakeFingerprint(source, fingerprint))
+		return false;
+
+	return Load(PathFor(source), fingerprint, style, multipolygons, buildings, highways);
+}
+
+bool MapCache::Load(const std::string& path, const Fingerprint& source, uint64_t style,
+	std::vector<Multipolygon>& multipolygons, std::vector<Area>& buildings, std::vector<Highway>& highways)
+{
+	if (!file.Open(path))
+		return false;
+
+	const Header* header = (const Header*)file.Data();
+	if (file.Size() < sizeof(Header) ||
+		memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+		header->version != CACHE_VERSION ||
+		header->headerSize != sizeof(Header))
+	{
+		file.Close();
+		return false;
+	}
+
+	// Stale cache
+	if (memcmp(&header->source, &source, sizeof(Fingerprint)) != 0 || header->style != style || header->projection != World::Projection::Id)
+	{
+		file.Close();
+		return false;
+	}
+
+	if (!CheckSection<MultipolygonRecord>(header->multipolygons, file.Size()) ||
+		!CheckSection<PolygonRecord>(header->polygons, file.Size()) ||
+		!CheckSection<FeatureRecord>(header->areas, file.Size()) ||
+		!CheckSection<FeatureRecord>(header->highways, file.Size()) ||
+		!CheckSection<uint8_t>(header->geometry, file.Size()) || header->geometry.offset % 4 != 0)
+	{
+		std::cerr << "Map cache " << path << " is corrupted" << std::endl;
+		file.Close();
+		return false;
+	}
+
+	bounds.minlat = header->minlat;
+	bounds.minlon = header->minlon;
+	bounds.maxlat = header->maxlat;
+	bounds.maxlon = header->maxlon;
+
+	uint8_t* base = file.Data();
+	const MultipolygonRecord* multipolygonRecords = (const MultipolygonRecord*)(base + header->multipolygons.offset);
+	const PolygonRecord* polygonRecords = (const PolygonRecord*)(base + header->polygons.offset);
+	const uint8_t* geometry = base + header->geometry.offset;
+	uint64_t geometrySize = header->geometry.count;
+
+	// A corrupted record fails the whole load, the features that were there before are all that's left afterwards
+	size_t multipolygonCount = multipolygons.size(), buildingCount = buildings.size(), highwayCount = highways.size();
+	auto corrupted = [&]() {
+		std::cerr << "Map cache " << path << " is corrupted" << std::endl;
+		multipolygons.erase(multipolygons.begin() + multipolygonCount, multipolygons.end());
+		buildings.erase(buildings.begin() + buildingCount, buildings.end());
+		highways.erase(highways.begin() + highwayCount, highways.end());
+		file.Close();
+		return false;
+	};
+
+	multipolygons.reserve(multipolygons.size() + header->multipolygons.count);
+	for (uint64_t i = 0; i < header->multipolygons.count; i++)
+	{
+		const MultipolygonRecord& record = multipolygonRecords[i];
+		if ((uint64_t)record.firstPolygon + record.polygonCount > header->polygons.count || record.rendering > Multipolygon::RenderType::INDOOR)
+			return corrupted();
+
+		Multipolygon multipolygon;
+		multipolygon.id = record.id;
+		multipolygon.r = record.r;
+		multipolygon.g = record.g;
+		multipolygon.b = record.b;
+		multipolygon.visible = record.visible;
+		multipolygon.rendering = (Multipolygon::RenderType)record.rendering;
+
+		for (uint32_t j = record.firstPolygon; j < record.firstPolygon + record.polygonCount; j++)
+		{
+			const PolygonRecord& polygonRecord = polygonRecords[j];
+			Multipolygon::Polygon polygon;
+			// Triangles and segments point at vertices, rings at where they start in the segments
+			if (!MapPoints(polygonRecord.vertices, geometry, geometrySize, polygon.vertices) ||
+				!MapIndices(polygonRecord.indices, geometry, geometrySize, polygon.vertices.count, polygon.indices) ||
+				!MapIndices(polygonRecord.segments, geometry, geometrySize, polygon.vertices.count, polygon.segments) ||
+				!MapIndices(polygonRecord.rings, geometry, geometrySize, polygon.segments.count, polygon.rings) ||
+				polygon.indices.count % 3 != 0 || polygon.segments.count % 2 != 0)
+				return corrupted();
+
+			multipolygon.polygons.push_back(polygon);
+		}
+
+		multipolygons.push_back(std::move(multipolygon));
+	}
+
+	const FeatureRecord* areaRecords = (const FeatureRecord*)(base + header->areas.offset);
+	buildings.reserve(buildings.size() + header->areas.count);
+	for (uint64_t i = 0; i < header->areas.count; i++)
+	{
+		Area area;
+		if (!MapPoints(areaRecords[i].points, geometry, geometrySize, area.points))
+			return corrupted();
+
+		area.r = areaRecords[i].r;
+		area.g = areaRecords[i].g;
+		area.b = areaRecords[i].b;
+		buildings.push_back(area);
+	}
+
+	const FeatureRecord* highwayRecords = (const FeatureRecord*)(base + header->highways.offset);
+	highways.reserve(highways.size() + header->highways.count);
+	for (uint64_t i = 0; i < header->highways.count; i++)
+	{
+		Highway highway;
+		if (!MapPoints(highwayRecords[i].points, geometry, geometrySize, highway.points))
+			return corrupted();
+
+		highway.r = highwayRecords[i].r;
+		highway.g = highwayRecords[i].g;
+		highway.b = highwayRecords[i].b;
+		highways.push_back(highway);
+	}
+
+	return true;
+}
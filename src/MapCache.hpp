@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <osmp.hpp>
+#include "MappedFile.hpp"
+#include "multipolygon.hpp"
+#include "features.hpp"
+
+// Binary cache of the fully processed map, stored next to the source file.
+// The cache is memory mapped when loading, the geometry of all loaded features
+// points straight into the mapping, so the MapCache must outlive them.
+class MapCache
+{
+public:
+	// Identifies the exact source file a cache was built from. Size and modification time catch almost everything,
+	// the sampled hash catches same-sized rewrites that happen within the timestamp resolution
+	struct Fingerprint {
+		uint64_t size;
+		int64_t modified;
+		uint64_t sample;
+	};
+
+	static bool TakeFingerprint(const std::string& source, Fingerprint& fingerprint);
+
+	static std::string PathFor(const std::string& source);
+
+	// Writes the processed map for the given source file, styled by the style table with the given hash
+	static bool Write(const std::string& source, uint64_t style, const osmp::Bounds& bounds,
+		const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways);
+
+	// The same for caches that aren't next to their source, like the regions of a RegionStore
+	static bool Write(const std::string& path, const Fingerprint& source, uint64_t style, const osmp::Bounds& bounds,
+		const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways);
+
+public:
+	// Maps the cache of the source file. Fails if there is none, or if the source, the style or the projection
+	// the viewer was built with has changed since it was written
+	bool Load(const std::string& source, uint64_t style,
+		std::vector<Multipolygon>& multipolygons, std::vector<Area>& buildings, std::vector<Highway>& highways);
+
+	// Maps the cache at the path, which has to be of the source file with the fingerprint
+	bool Load(const std::string& path, const Fingerprint& source, uint64_t style,
+		std::vector<Multipolygon>& multipolygons, std::vector<Area>& buildings, std::vector<Highway>& highways);
+
+	const osmp::Bounds& Bounds() const { return bounds; }
+
+private:
+	MappedFile file;
+	osmp::Bounds bounds;
+};
@@ -0,0 +1,290 @@
+#include "MapLoader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+
+#include <osmp.hpp>
+#include "OsmStream.hpp"
+#include "OsmPbf.hpp"
+#include "Trace.hpp"
+
+class StreamingIngest : public OsmHandler
+{
+public:
+	StreamingIngest(MapBuilder& builder) :
+		builder(builder), hasBounds(false), nodesSorted(true), nodesSealed(false), sortedNodes(0)
+	{
+	}
+
+	void OnBounds(const osmp::Bounds& bounds) override
+	{
+		builder.SetBounds(bounds);
+		hasBounds = true;
+	}
+
+	void OnNode(uint64_t id, double lon, double lat, const Tags& tags) override
+	{
+		// Ways point into the sorted table by position, so nodes after the first way go behind it and are found by id
+		if (nodesSealed)
+			lateNodes[id] = (uint32_t)nodes.size();
+		else if (!nodes.empty() && nodes.back().id >= id)
+			nodesSorted = false;
+
+		nodes.push_back({ id, (int32_t)std::lround(lon * COORD_SCALE), (int32_t)std::lround(lat * COORD_SCALE) });
+	}
+
+	void OnWay(uint64_t id, const std::vector<uint64_t>& refs, const Tags& tags) override
+	{
+		if (!nodesSealed)
+			SealNodes();
+
+		// Resolve the node refs, ways with missing nodes are dropped
+		size_t first = wayNodes.size();
+		for (uint64_t ref : refs)
+		{
+			uint32_t node;
+			if (!FindNode(ref, node))
+			{
+				wayNodes.resize(first);
+				return;
+			}
+
+			wayNodes.push_back(node);
+		}
+
+		// Any way might still be needed by a multipolygon later on, even one too short to be drawn by itself
+		ways[id] = { first, refs.size() };
+		if (refs.size() < 2)
+			return;
+
+		Resolve(ways[id], scratch);
+		bool closed = (refs.front() == refs.back());
+		builder.AddWay(scratch, tags, IsArea(tags, closed));
+	}
+
+	void OnRelation(uint64_t id, const std::vector<OsmMember>& members, const Tags& tags) override
+	{
+		if (GetTag(tags, "type") != "multipolygon")
+			return;
+
+		// Relations referencing anything outside of the file are skipped, like the ones with null members in osmp
+		size_t count = 0;
+		for (const OsmMember& member : members)
+		{
+			if (member.type != 'w')
+				continue;
+
+			auto it = ways.find(member.ref);
+			if (it == ways.end())
+				return;
+
+			if (memberNodes.size() <= count)
+				memberNodes.resize(count + 1);
+
+			Resolve(it->second, memberNodes[count]);
+			count++;
+		}
+
+		relationMembers.clear();
+		count = 0;
+		for (const OsmMember& member : members)
+		{
+			if (member.type != 'w')
+				continue;
+
+			relationMembers.push_back({ &memberNodes[count++], member.role == "inner" });
+		}
+
+		builder.AddMultipolygon(id, tags, relationMembers);
+	}
+
+private:
+	struct NodeEntry {
+		uint64_t id;
+		int32_t lon, lat;
+	};
+
+	struct WayEntry {
+		size_t first, count;
+	};
+
+	// Nodes normally come before ways, so by the first way the node table is usually complete
+	void SealNodes()
+	{
+		if (!nodesSorted)
+		{
+			std::sort(nodes.begin(), nodes.end(), [](const NodeEntry& a, const NodeEntry& b) { return (a.id < b.id); });
+			nodesSorted = true;
+		}
+
+		nodes.shrink_to_fit();
+		nodesSealed = true;
+		sortedNodes = nodes.size();
+
+		if (!hasBounds)
+		{
+			// Without any nodes there is nothing to fit, the map is an empty box at 0, 0 rather than an inverted one
+			osmp::Bounds bounds = { 0.0, 0.0, 0.0, 0.0 };
+			if (!nodes.empty())
+			{
+				bounds.minlat = 90.0;
+				bounds.minlon = 180.0;
+				bounds.maxlat = -90.0;
+				bounds.maxlon = -180.0;
+			}
+
+			for (const NodeEntry& node : nodes)
+			{
+				bounds.minlat = std::min(bounds.minlat, node.lat / COORD_SCALE);
+				bounds.minlon = std::min(bounds.minlon, node.lon / COORD_SCALE);
+				bounds.maxlat = std::max(bounds.maxlat, node.lat / COORD_SCALE);
+				bounds.maxlon = std::max(bounds.maxlon, node.lon / COORD_SCALE);
+			}
+
+			OnBounds(bounds);
+		}
+	}
+
+	// Position of the node in the table
+	bool FindNode(uint64_t id, uint32_t& node) const
+	{
+		auto end = nodes.begin() + sortedNodes;
+		auto it = std::lower_bound(nodes.begin(), end, id, [](const NodeEntry& node, uint64_t id) { return (node.id < id); });
+		if (it != end && it->id == id)
+		{
+			node = (uint32_t)(it - nodes.begin());
+			return true;
+		}
+
+		auto late = lateNodes.find(id);
+		if (late == lateNodes.end())
+			return false;
+
+		node = late->second;
+		return true;
+	}
+
+	void Resolve(const WayEntry& way, NodeList& out) const
+	{
+		out.clear();
+		for (size_t i = way.first; i < way.first + way.count; i++)
+		{
+			const NodeEntry& node = nodes[wayNodes[i]];
+			out.push_back({ node.id, node.lon / COORD_SCALE, node.lat / COORD_SCALE });
+		}
+	}
+
+private:
+	MapBuilder& builder;
+	bool hasBounds;
+
+	std::vector<NodeEntry> nodes;
+	bool nodesSorted, nodesSealed;
+	size_t sortedNodes;		// The table is sorted up to here, the rest came after the first way
+	std::unordered_map<uint64_t, uint32_t> lateNodes;	// Position of every node after the first way
+
+	std::unordered_map<uint64_t, WayEntry> ways;
+	std::vector<uint32_t> wayNodes;
+
+	// Reused between features
+	NodeList scratch;
+	std::vector<NodeList> memberNodes;
+	std::vector<RelationMember> relationMembers;
+};
+
+bool LoadOsmStreaming(const std::string& path, MapBuilder& builder)
+{
+	StreamingIngest ingest(builder);
+	bool parsed = IsOsmPbf(path) ? StreamOsmPbf(path, ingest, builder.Pool()) : StreamOsm(path, ingest);
+	if (!parsed)
+	{
+		// Relations that were read before the file went bad are still being built
+		builder.Cancel();
+		return false;
+	}
+
+	builder.Finish();
+	return true;
+}
+
+static void ToNodeList(const osmp::Nodes& nodes, NodeList& out)
+{
+	out.clear();
+	for (const osmp::Node& node : nodes)
+		out.push_back({ node->id, node->lon, node->lat });
+}
+
+// Only copies the tags the style table looks at
+template<typename Member>
+static void ToTags(const Member& member, const std::vector<std::string>& keys, Tags& out)
+{
+	out.clear();
+	for (const std::string& key : keys)
+	{
+		std::string value = member->GetTag(key);
+		if (value != "")
+			out.push_back({ key, value });
+	}
+}
+
+bool LoadOsmObject(const std::string& path, MapBuilder& builder)
+{
+	if (IsOsmPbf(path))
+	{
+		std::cerr << "osmp only reads OSM XML, load " << path << " without --dom" << std::endl;
+		return false;
+	}
+
+	osmp::Object* obj;
+	{
+		TraceZone zone("parse");
+		obj = new osmp::Object(path);
+	}
+
+	builder.SetBounds(obj->bounds);
+
+	NodeList nodes;
+	Tags tags;
+
+	// Fetch all the ways
+	osmp::Ways ways = obj->GetWays();
+	for (osmp::Way way : ways)
+	{
+		ToNodeList(way->GetNodes(), nodes);
+		ToTags(way, builder.Styles().Keys(), tags);
+		builder.AddWay(nodes, tags, way->area);
+	}
+
+	// Fetch all relations
+	osmp::Relations relations = obj->GetRelations();
+	std::vector<NodeList> memberNodes;
+	std::vector<RelationMember> members;
+	for (const osmp::Relation& relation : relations)
+	{
+		if (relation->GetRelationType() == "multipolygon" && !relation->HasNullMembers())
+		{
+			const osmp::MemberWays& memberWays = relation->GetWays();
+			memberNodes.resize(memberWays.size());
+			members.clear();
+			for (size_t i = 0; i < memberWays.size(); i++)
+			{
+				ToNodeList(memberWays[i].way->GetNodes(), memberNodes[i]);
+				members.push_back({ &memberNodes[i], memberWays[i].role == "inner" });
+			}
+
+			ToTags(relation, builder.Styles().Keys(), tags);
+			builder.AddMultipolygon(relation->id, tags, members);
+		}
+	}
+
+	builder.Finish();
+
+	// Release map data
+	relations.clear();
+	ways.clear();
+	delete obj;
+
+	return true;
+}
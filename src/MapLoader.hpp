@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+#include "MapBuilder.hpp"
+
+// Reads the file in a single pass and hands every feature to the builder as soon as its data is complete.
+// Only node coordinates and the node lists of ways are kept around, both in a compact form.
+// OSM XML and PBF files both work, PBF files are decoded on the builder's pool
+bool LoadOsmStreaming(const std::string& path, MapBuilder& builder);
+
+// Loads the entire file into an osmp::Object first and builds the features from there
+bool LoadOsmObject(const std::string& path, MapBuilder& builder);
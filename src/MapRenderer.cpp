@@ -0,0 +1,168 @@
+#include "MapRenderer.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <glad/glad.h>
+
+#include "Trace.hpp"
+
+static const char* vertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in vec2 position;
+uniform vec2 origin;
+uniform vec2 size;
+
+void main()
+{
+	vec2 view = (position - origin) / size;
+	gl_Position = vec4(view.x * 2.0 - 1.0, 1.0 - view.y * 2.0, 0.0, 1.0);
+}
+)";
+
+static const char* fragmentShaderSource = R"(
+#version 330 core
+uniform vec3 color;
+out vec4 fragColor;
+
+void main()
+{
+	fragColor = vec4(color, 1.0);
+}
+)";
+
+static GLuint CompileShader(GLenum type, const char* source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint success;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		char log[512];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		glDeleteShader(shader);
+		throw std::runtime_error(std::string("Failed to compile shader: ") + log);
+	}
+
+	return shader;
+}
+
+MapRenderer::MapRenderer(const MapArena& arena) :
+	arena(arena)
+{
+	GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexShaderSource);
+	GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+
+	program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		char log[512];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		glDeleteProgram(program);
+		throw std::runtime_error(std::string("Failed to link shader program: ") + log);
+	}
+
+	originLocation = glGetUniformLocation(program, "origin");
+	sizeLocation = glGetUniformLocation(program, "size");
+	colorLocation = glGetUniformLocation(program, "color");
+
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, arena.Vertices().size() * sizeof(MapArena::Vertex), arena.Vertices().data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, arena.Indices().size() * sizeof(uint32_t), arena.Indices().data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(MapArena::Vertex), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindVertexArray(0);
+}
+
+MapRenderer::~MapRenderer()
+{
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteVertexArrays(1, &vertexArray);
+	glDeleteProgram(program);
+}
+
+void MapRenderer::Draw(const Box& view, MapArena::Layer first, MapArena::Layer last)
+{
+	double width = view.maxX - view.minX, height = view.maxY - view.minY;
+	glUseProgram(program);
+	glUniform2f(originLocation, (float)view.minX, (float)view.minY);
+	glUniform2f(sizeLocation, (float)width, (float)height);
+	glBindVertexArray(vertexArray);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	int level = MapArena::LevelFor(std::min(viewport[2] / width, viewport[3] / height));
+	Span<const MapArena::Feature> features = arena.Features(level);
+	Span<const MapArena::DrawRange> ranges = arena.Ranges(level);
+
+	{
+		TraceZone zone("cull");
+		visible.clear();
+		arena.Visible(view, visible);
+		zone.Arg("visible", visible.size());
+	}
+
+	// Visible features that follow each other in the index buffer become one run, every range is one draw call
+	TraceZone zone("draw calls");
+	size_t i = 0;
+	while (i < visible.size())
+	{
+		uint32_t range = features[visible[i]].range;
+		if (ranges[range].layer < first || ranges[range].layer > last)
+		{
+			while (i < visible.size() && features[visible[i]].range == range)
+				i++;
+			continue;
+		}
+
+		counts.clear();
+		offsets.clear();
+		uint32_t end = 0;
+		for (; i < visible.size() && features[visible[i]].range == range; i++)
+		{
+			const MapArena::Feature& feature = features[visible[i]];
+			if (feature.count == 0)
+				continue;
+
+			if (!counts.empty() && feature.first == end)
+				counts.back() += feature.count;
+			else
+			{
+				counts.push_back(feature.count);
+				offsets.push_back((const void*)(feature.first * sizeof(uint32_t)));
+			}
+
+			end = feature.first + feature.count;
+		}
+
+		if (counts.empty())
+			continue;
+
+		glUniform3f(colorLocation, ranges[range].r / 255.0f, ranges[range].g / 255.0f, ranges[range].b / 255.0f);
+		GLenum mode = (ranges[range].primitive == MapArena::DrawRange::TRIANGLES) ? GL_TRIANGLES : GL_LINES;
+		glMultiDrawElements(mode, counts.data(), GL_UNSIGNED_INT, offsets.data(), counts.size());
+	}
+
+	glBindVertexArray(0);
+}
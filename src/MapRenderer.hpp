@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "MapArena.hpp"
+
+// Draws a MapArena with OpenGL, one draw call per range. Needs a current GL context,
+// the geometry is uploaded once when the renderer is created
+class MapRenderer
+{
+public:
+	MapRenderer(const MapArena& arena);
+	~MapRenderer();
+
+	MapRenderer(const MapRenderer&) = delete;
+	MapRenderer& operator=(const MapRenderer&) = delete;
+
+	// Stretches the part of the map inside the view box over the viewport, with the detail level that fits the viewport's size.
+	// Only the features overlapping the view are drawn. Maps split into several arenas are drawn a layer at a time,
+	// so the roads of one arena don't end up underneath the areas of the next
+	void Draw(const Box& view, MapArena::Layer first = MapArena::FILLED_AREAS, MapArena::Layer last = MapArena::HIGHWAYS);
+
+private:
+	unsigned int vertexArray, vertexBuffer, indexBuffer;
+	unsigned int program;
+	int originLocation, sizeLocation, colorLocation;
+
+	const MapArena& arena;
+	std::vector<uint32_t> visible;
+	std::vector<int> counts;				// Of the runs of the range being drawn
+	std::vector<const void*> offsets;
+};
@@ -0,0 +1,325 @@
+#include "MapUpdater.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "OsmPbf.hpp"
+#include "Trace.hpp"
+
+template<typename Map>
+static void Link(Map& index, uint64_t from, uint64_t to)
+{
+	std::vector<uint64_t>& list = index[from];
+	if (std::find(list.begin(), list.end(), to) == list.end())
+		list.push_back(to);
+}
+
+template<typename Map>
+static void Unlink(Map& index, uint64_t from, uint64_t to)
+{
+	auto it = index.find(from);
+	if (it == index.end())
+		return;
+
+	it->second.erase(std::remove(it->second.begin(), it->second.end(), to), it->second.end());
+	if (it->second.empty())
+		index.erase(it);
+}
+
+MapUpdater::MapUpdater(MapBuilder& builder) :
+	builder(builder), keys(builder.Styles().Keys().begin(), builder.Styles().Keys().end())
+{
+	keys.insert("area");
+	keys.insert("highway");
+	keys.insert("type");
+}
+
+bool MapUpdater::Load(const std::string& path)
+{
+	bool parsed = IsOsmPbf(path) ? StreamOsmPbf(path, *this, builder.Pool()) : StreamOsm(path, *this);
+	if (!parsed)
+	{
+		builder.Cancel();
+		return false;
+	}
+
+	FinishMultipolygons();
+	return true;
+}
+
+bool MapUpdater::Apply(const std::string& path, MapArena::Changes& changes)
+{
+	TraceZone zone("apply changes");
+
+	// Read it through once without changing anything, a file that's cut off is left alone until it's complete
+	OsmHandler check;
+	if (!StreamOsm(path, check))
+		return false;
+
+	this->changes = &changes;
+	action = OsmAction::NONE;
+	changedNodes.clear();
+	changedWays.clear();
+	changedRelations.clear();
+
+	// Whatever could be read has changed the data already, so it's built even if reading fails the second time around
+	bool parsed = StreamOsm(path, *this);
+
+	// Follow the reverse indices, a moved node changes every way using it and those change their relations
+	for (uint64_t node : changedNodes)
+	{
+		auto it = nodeWays.find(node);
+		if (it != nodeWays.end())
+			changedWays.insert(it->second.begin(), it->second.end());
+	}
+
+	for (uint64_t way : changedWays)
+	{
+		auto it = wayRelations.find(way);
+		if (it != wayRelations.end())
+			changedRelations.insert(it->second.begin(), it->second.end());
+	}
+
+	zone.Arg("ways", changedWays.size());
+	zone.Arg("relations", changedRelations.size());
+
+	// Sorted, so the new features come out in the same order no matter how the sets are laid out
+	std::vector<uint64_t> ids(changedWays.begin(), changedWays.end());
+	std::sort(ids.begin(), ids.end());
+	for (uint64_t id : ids)
+	{
+		auto it = ways.find(id);
+		if (it == ways.end())
+			continue;
+
+		RemoveWay(it->second);
+		BuildWay(it->second);
+	}
+
+	ids.assign(changedRelations.begin(), changedRelations.end());
+	std::sort(ids.begin(), ids.end());
+	for (uint64_t id : ids)
+	{
+		auto it = relations.find(id);
+		if (it == relations.end())
+			continue;
+
+		RemoveRelation(it->second);
+		BuildRelation(id, it->second);
+	}
+
+	FinishMultipolygons();
+	this->changes = nullptr;
+	return parsed;
+}
+
+void MapUpdater::OnBounds(const osmp::Bounds& bounds)
+{
+	// The map stays in the world space it was loaded into
+	if (changes)
+		return;
+
+	builder.SetBounds(bounds);
+	hasBounds = true;
+}
+
+void MapUpdater::OnNode(uint64_t id, double lon, double lat, const Tags& tags)
+{
+	if (changes)
+		changedNodes.push_back(id);
+
+	if (action == OsmAction::DELETED)
+		nodes.erase(id);
+	else
+		nodes[id] = { (int32_t)std::lround(lon * COORD_SCALE), (int32_t)std::lround(lat * COORD_SCALE) };
+}
+
+void MapUpdater::OnWay(uint64_t id, const std::vector<uint64_t>& refs, const Tags& tags)
+{
+	// Nodes always come before ways, so by the first way all of them are known
+	if (!hasBounds && !changes)
+		SetBoundsFromNodes();
+
+	auto it = ways.find(id);
+	if (it != ways.end())
+	{
+		RemoveWay(it->second);
+		for (uint64_t ref : it->second.refs)
+			Unlink(nodeWays, ref, id);
+	}
+
+	if (changes)
+		changedWays.insert(id);
+
+	if (action == OsmAction::DELETED)
+	{
+		if (it != ways.end())
+			ways.erase(it);
+		return;
+	}
+
+	Way& way = ways[id];
+	way.refs = refs;
+	KeepTags(tags, way.tags);
+	for (uint64_t ref : refs)
+		Link(nodeWays, ref, id);
+
+	if (!changes)
+		BuildWay(way);
+}
+
+void MapUpdater::OnRelation(uint64_t id, const std::vector<OsmMember>& members, const Tags& tags)
+{
+	auto it = relations.find(id);
+	if (it != relations.end())
+	{
+		RemoveRelation(it->second);
+		for (const Member& member : it->second.members)
+			Unlink(wayRelations, member.way, id);
+	}
+
+	if (changes)
+		changedRelations.insert(id);
+
+	// A relation that stopped being a multipolygon is gone as well
+	if (action == OsmAction::DELETED || GetTag(tags, "type") != "multipolygon")
+	{
+		if (it != relations.end())
+			relations.erase(it);
+		return;
+	}
+
+	Relation& relation = relations[id];
+	relation.members.clear();
+	for (const OsmMember& member : members)
+	{
+		if (member.type != 'w')
+			continue;
+
+		relation.members.push_back({ member.ref, member.role == "inner" });
+		Link(wayRelations, member.ref, id);
+	}
+	KeepTags(tags, relation.tags);
+
+	if (!changes)
+		BuildRelation(id, relation);
+}
+
+void MapUpdater::SetBoundsFromNodes()
+{
+	// An empty file still gets bounds that make sense, just a point at 0, 0
+	osmp::Bounds bounds = { 0.0, 0.0, 0.0, 0.0 };
+	if (!nodes.empty())
+	{
+		bounds.minlat = 90.0;
+		bounds.minlon = 180.0;
+		bounds.maxlat = -90.0;
+		bounds.maxlon = -180.0;
+	}
+
+	for (const auto& node : nodes)
+	{
+		bounds.minlat = std::min(bounds.minlat, node.second.lat / COORD_SCALE);
+		bounds.minlon = std::min(bounds.minlon, node.second.lon / COORD_SCALE);
+		bounds.maxlat = std::max(bounds.maxlat, node.second.lat / COORD_SCALE);
+		bounds.maxlon = std::max(bounds.maxlon, node.second.lon / COORD_SCALE);
+	}
+
+	OnBounds(bounds);
+}
+
+void MapUpdater::KeepTags(const Tags& tags, Tags& kept) const
+{
+	kept.clear();
+	for (const Tag& tag : tags)
+	{
+		if (keys.count(tag.key))
+			kept.push_back(tag);
+	}
+}
+
+void MapUpdater::RemoveWay(Way& way)
+{
+	if (way.feature.kind == MapBuilder::WayFeature::NONE)
+		return;
+
+	builder.RemoveWay(way.feature);
+	if (changes)
+		(way.feature.kind == MapBuilder::WayFeature::BUILDING ? changes->buildings : changes->highways).insert(way.feature.index);
+
+	way.feature = {};
+}
+
+void MapUpdater::RemoveRelation(Relation& relation)
+{
+	if (relation.multipolygon < 0)
+		return;
+
+	builder.RemoveMultipolygon((uint32_t)relation.multipolygon);
+	if (changes)
+		changes->multipolygons.insert((uint32_t)relation.multipolygon);
+
+	relation.multipolygon = -1;
+}
+
+void MapUpdater::BuildWay(Way& way)
+{
+	if (way.refs.size() < 2 || !Resolve(way.refs, scratch))
+		return;
+
+	bool closed = (way.refs.front() == way.refs.back());
+	way.feature = builder.AddWay(scratch, way.tags, IsArea(way.tags, closed));
+	if (changes && way.feature.kind != MapBuilder::WayFeature::NONE)
+		(way.feature.kind == MapBuilder::WayFeature::BUILDING ? changes->buildings : changes->highways).insert(way.feature.index);
+}
+
+void MapUpdater::BuildRelation(uint64_t id, Relation& relation)
+{
+	// Relations with members that aren't there, or have nodes that aren't there, are skipped like when loading
+	if (memberNodes.size() < relation.members.size())
+		memberNodes.resize(relation.members.size());
+
+	for (size_t i = 0; i < relation.members.size(); i++)
+	{
+		auto it = ways.find(relation.members[i].way);
+		if (it == ways.end() || !Resolve(it->second.refs, memberNodes[i]))
+			return;
+	}
+
+	relationMembers.clear();
+	for (size_t i = 0; i < relation.members.size(); i++)
+		relationMembers.push_back({ &memberNodes[i], relation.members[i].inner });
+
+	builder.AddMultipolygon(id, relation.tags, relationMembers);
+}
+
+bool MapUpdater::Resolve(const std::vector<uint64_t>& refs, NodeList& out) const
+{
+	out.clear();
+	for (uint64_t ref : refs)
+	{
+		auto it = nodes.find(ref);
+		if (it == nodes.end())
+			return false;
+
+		out.push_back({ ref, it->second.lon / COORD_SCALE, it->second.lat / COORD_SCALE });
+	}
+
+	return true;
+}
+
+void MapUpdater::FinishMultipolygons()
+{
+	size_t first = builder.Finish();
+
+	const std::vector<Multipolygon>& multipolygons = builder.Multipolygons();
+	for (size_t i = first; i < multipolygons.size(); i++)
+	{
+		auto it = relations.find(multipolygons[i].Id());
+		if (it != relations.end())
+			it->second.multipolygon = (int64_t)i;
+
+		if (changes)
+			changes->multipolygons.insert((uint32_t)i);
+	}
+}
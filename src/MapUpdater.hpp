@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "MapBuilder.hpp"
+#include "MapArena.hpp"
+#include "OsmStream.hpp"
+
+// Keeps the map data the features were built from, so osmChange files (.osc) like OSM's minutely diffs can be
+// applied to a loaded map. Reverse indices lead from a node to the ways using it and from a way to the relations
+// it's a member of, so only the features whose nodes, ways or relations changed are built again.
+// Features that are gone are emptied where they are and rebuilt ones are appended, every other feature keeps
+// its position, which is what MapArena::Update needs. Geometry of replaced features stays in the store
+class MapUpdater : private OsmHandler
+{
+public:
+	MapUpdater(MapBuilder& builder);
+
+	// Loads the map like LoadOsmStreaming does, the features come out the same
+	bool Load(const std::string& path);
+
+	// Applies the file's changes in order and builds the features they touched again, which are added to changes.
+	// A file that can't be read to its end changes nothing and returns false
+	bool Apply(const std::string& path, MapArena::Changes& changes);
+
+	size_t Nodes() const { return nodes.size(); }
+	size_t Ways() const { return ways.size(); }
+	size_t Relations() const { return relations.size(); }
+
+private:
+	struct Coord {
+		int32_t lon, lat;
+	};
+
+	struct Way {
+		std::vector<uint64_t> refs;
+		Tags tags;
+		MapBuilder::WayFeature feature;
+	};
+
+	struct Member {
+		uint64_t way;
+		bool inner;
+	};
+
+	// Only multipolygons are kept
+	struct Relation {
+		std::vector<Member> members;
+		Tags tags;
+		int64_t multipolygon = -1;	// Into the builder's multipolygons
+	};
+
+	void OnBounds(const osmp::Bounds& bounds) override;
+	void OnAction(OsmAction action) override { this->action = action; }
+	void OnNode(uint64_t id, double lon, double lat, const Tags& tags) override;
+	void OnWay(uint64_t id, const std::vector<uint64_t>& refs, const Tags& tags) override;
+	void OnRelation(uint64_t id, const std::vector<OsmMember>& members, const Tags& tags) override;
+
+	void SetBoundsFromNodes();
+	void KeepTags(const Tags& tags, Tags& kept) const;
+
+	// Empty the feature and forget it
+	void RemoveWay(Way& way);
+	void RemoveRelation(Relation& relation);
+
+	void BuildWay(Way& way);
+	void BuildRelation(uint64_t id, Relation& relation);
+
+	// False if any of the nodes is missing
+	bool Resolve(const std::vector<uint64_t>& refs, NodeList& out) const;
+
+	// Multipolygons are built on the pool, they only get their position once they're done
+	void FinishMultipolygons();
+
+	MapBuilder& builder;
+	std::unordered_set<std::string> keys;	// Tags anything looks at
+
+	std::unordered_map<uint64_t, Coord> nodes;
+	std::unordered_map<uint64_t, Way> ways;
+	std::unordered_map<uint64_t, Relation> relations;
+	std::unordered_map<uint64_t, std::vector<uint64_t>> nodeWays, wayRelations;
+
+	bool hasBounds = false;
+	OsmAction action = OsmAction::NONE;
+
+	// While applying a change file
+	MapArena::Changes* changes = nullptr;
+	std::vector<uint64_t> changedNodes;
+	std::unordered_set<uint64_t> changedWays, changedRelations;
+
+	// Reused between features
+	NodeList scratch;
+	std::vector<NodeList> memberNodes;
+	std::vector<RelationMember> relationMembers;
+};
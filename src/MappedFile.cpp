@@ -0,0 +1,123 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() :
+	data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(NULL)
+{
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (data == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+
+	if (mapping != NULL)
+		CloseHandle(mapping);
+
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	data = nullptr;
+	size = 0;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() :
+	data(nullptr), size(0), file(-1)
+{
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	file = open(path.c_str(), O_RDONLY);
+	if (file == -1)
+		return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* address = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	if (address == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	data = (uint8_t*)address;
+	size = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		munmap(data, size);
+
+	if (file != -1)
+		close(file);
+
+	data = nullptr;
+	size = 0;
+	file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Read-only view of a file mapped into memory.
+// The mapping is copy-on-write, pages are only ever copied if someone writes to them
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::string& path);
+	void Close();
+
+	uint8_t* Data() const { return data; }
+	size_t Size() const { return size; }
+
+	operator bool() const { return (data != nullptr); }
+
+private:
+	uint8_t* data;
+	size_t size;
+
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int file;
+#endif
+};
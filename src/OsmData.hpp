@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Plain map data that the feature builders work on, independent of where it was loaded from
+
+// OSM stores coordinates with 7 decimal places, so they fit into 32 bit fixed point numbers
+#define COORD_SCALE 10000000.0
+
+struct NodeCoord
+{
+	uint64_t id;
+	double lon, lat;
+
+	// Nodes are identified by their id, just like osmp compares its node pointers
+	bool operator==(const NodeCoord& other) const { return (id == other.id); }
+	bool operator!=(const NodeCoord& other) const { return (id != other.id); }
+};
+typedef std::vector<NodeCoord> NodeList;
+
+struct Tag
+{
+	std::string key, value;
+};
+typedef std::vector<Tag> Tags;
+
+// Returns an empty string if the key doesn't exist, like osmp's GetTag()
+inline std::string GetTag(const Tags& tags, const std::string& key)
+{
+	for (const Tag& tag : tags)
+	{
+		if (tag.key == key)
+			return tag.value;
+	}
+
+	return "";
+}
+
+// Closed ways are areas unless they're tagged area=no. Closed highways like roundabouts stay roads unless they're tagged area=yes
+inline bool IsArea(const Tags& tags, bool closed)
+{
+	if (!closed)
+		return false;
+
+	std::string area = GetTag(tags, "area");
+	return (area == "yes" || (area != "no" && GetTag(tags, "highway").empty()));
+}
+
+// A way that is part of a multipolygon relation. The nodes are owned by whoever assembled the relation
+struct RelationMember
+{
+	const NodeList* nodes;
+	bool inner;
+};
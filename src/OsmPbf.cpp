@@ -0,0 +1,732 @@
+#include "OsmPbf.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+#include "Inflate.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+
+// Limits from the format's specification, anything bigger is a broken file
+#define MAX_BLOB_HEADER_SIZE (64 * 1024)
+#define MAX_BLOB_SIZE (32 * 1024 * 1024)
+
+// Blocks decoded ahead of the one the handler is at, per thread of the pool
+#define BLOCKS_PER_THREAD 2
+
+// Just enough of the protocol buffer wire format to walk through the messages of a PBF file
+class ProtoReader
+{
+public:
+	enum WireType {
+		VARINT = 0,
+		FIXED64 = 1,
+		BYTES = 2,
+		FIXED32 = 5
+	};
+
+	ProtoReader(const uint8_t* data, size_t size) :
+		it(data), end(data + size), field(0), type(0), failed(false)
+	{
+	}
+
+	// Moves on to the next field, false at the end of the message
+	bool Next()
+	{
+		if (it >= end || failed)
+			return false;
+
+		uint64_t key = Varint();
+		field = (uint32_t)(key >> 3);
+		type = (int)(key & 7);
+		return !failed;
+	}
+
+	uint32_t Field() const { return field; }
+
+	uint64_t Varint()
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64 && it < end; shift += 7)
+		{
+			uint8_t byte = *it++;
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return value;
+		}
+
+		failed = true;
+		return 0;
+	}
+
+	int64_t Signed() { return Zigzag(Varint()); }
+	static int64_t Zigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+	// The field's bytes, a nested message, a string or a packed array
+	ProtoReader Bytes()
+	{
+		uint64_t size = (type == BYTES) ? Varint() : 0;
+		if (type != BYTES || failed || size > (uint64_t)(end - it))
+		{
+			failed = true;
+			return ProtoReader(end, 0);
+		}
+
+		ProtoReader bytes(it, (size_t)size);
+		it += size;
+		return bytes;
+	}
+
+	void Skip()
+	{
+		switch (type)
+		{
+		case VARINT: Varint(); break;
+		case FIXED64: Advance(8); break;
+		case BYTES: Bytes(); break;
+		case FIXED32: Advance(4); break;
+		default: failed = true; break;
+		}
+	}
+
+	// Repeated numbers may be packed or not, writers are free to pick
+	template<typename Func>
+	void Repeated(Func func)
+	{
+		if (type == VARINT)
+		{
+			func(Varint());
+			return;
+		}
+
+		ProtoReader packed = Bytes();
+		while (packed.it < packed.end && !packed.failed)
+			func(packed.Varint());
+
+		failed |= packed.failed;
+	}
+
+	const uint8_t* Data() const { return it; }
+	size_t Size() const { return end - it; }
+	bool Failed() const { return failed; }
+
+private:
+	void Advance(size_t bytes)
+	{
+		if (bytes > (size_t)(end - it))
+			failed = true;
+		else
+			it += bytes;
+	}
+
+	const uint8_t* it;
+	const uint8_t* end;
+	uint32_t field;
+	int type;
+	bool failed;
+};
+
+// One blob of the file and everything decoded from it. Blocks are reused, so the vectors keep their capacity
+struct PbfBlock
+{
+	enum Kind : uint8_t {
+		NODE,
+		WAY,
+		RELATION
+	};
+
+	struct Element {
+		Kind kind;
+		uint64_t id;
+		double lon, lat;
+		uint32_t firstTag, tagCount;	// Into tags
+		uint32_t first, count;			// Into refs for ways, into the members for relations
+	};
+
+	struct String {
+		const char* data;
+		size_t size;
+	};
+
+	struct TagIds {
+		uint32_t key, value;			// Into strings
+	};
+
+	// Set by the reading thread before the block is decoded
+	enum Type {
+		HEADER,
+		DATA,
+		UNKNOWN
+	} type;
+	const uint8_t* blob;
+	size_t blobSize;
+
+	// Set by the decoding task
+	bool done;
+	bool failed;				// Threw while decoding, error may not be set
+	std::string error;			// Empty if the block was fine
+	std::vector<uint8_t> inflated;
+	bool hasBounds;
+	osmp::Bounds bounds;
+
+	std::vector<String> strings;
+	std::vector<Element> elements;
+	std::vector<TagIds> tags;
+	std::vector<uint64_t> refs;		// Node refs of ways and member refs of relations
+	std::vector<uint32_t> roles;	// Into strings
+	std::vector<char> types;
+
+	// Scratch space while decoding
+	std::vector<ProtoReader> groups;
+	std::vector<uint32_t> keys, values;
+};
+
+// Coordinates are stored in units of granularity nanodegrees from the offset. Doubles hold every valid coordinate exactly
+// on the way, and can't overflow in broken files
+static double ToDegrees(int64_t offset, int64_t granularity, int64_t value)
+{
+	return (offset + (double)granularity * value) / 1e9;
+}
+
+static bool DecodeHeader(ProtoReader message, PbfBlock& block)
+{
+	while (message.Next())
+	{
+		if (message.Field() == 1)
+		{
+			// Bounding box in nanodegrees
+			ProtoReader box = message.Bytes();
+			int64_t left = 0, right = 0, top = 0, bottom = 0;
+			while (box.Next())
+			{
+				switch (box.Field())
+				{
+				case 1: left = box.Signed(); break;
+				case 2: right = box.Signed(); break;
+				case 3: top = box.Signed(); break;
+				case 4: bottom = box.Signed(); break;
+				default: box.Skip(); break;
+				}
+			}
+
+			if (box.Failed())
+				return false;
+
+			block.hasBounds = true;
+			block.bounds.minlon = left / 1e9;
+			block.bounds.maxlon = right / 1e9;
+			block.bounds.maxlat = top / 1e9;
+			block.bounds.minlat = bottom / 1e9;
+		}
+		else if (message.Field() == 4)
+		{
+			// Features the reader must know to make sense of the file, history files with several versions of an element aren't supported
+			ProtoReader feature = message.Bytes();
+			std::string name((const char*)feature.Data(), feature.Size());
+			if (name != "OsmSchema-V0.6" && name != "DenseNodes")
+			{
+				block.error = "needs \"" + name + "\", which isn't supported";
+				return true;
+			}
+		}
+		else
+			message.Skip();
+	}
+
+	return !message.Failed();
+}
+
+// Keys and values of plain nodes, ways and relations come as two arrays of string ids
+static bool ReadTags(PbfBlock& block, PbfBlock::Element& element)
+{
+	if (block.keys.size() != block.values.size())
+		return false;
+
+	element.firstTag = (uint32_t)block.tags.size();
+	element.tagCount = (uint32_t)block.keys.size();
+	for (size_t i = 0; i < block.keys.size(); i++)
+		block.tags.push_back({ block.keys[i], block.values[i] });
+
+	return true;
+}
+
+static bool DecodeDenseNodes(ProtoReader dense, PbfBlock& block, int64_t granularity, int64_t lonOffset, int64_t latOffset)
+{
+	// The ids and coordinates are delta coded, each in an array of its own. Any of them may come first
+	size_t first = block.elements.size();
+	size_t ids = 0, lons = 0, lats = 0;
+	auto node = [&block, first](size_t i) -> PbfBlock::Element& {
+		if (first + i == block.elements.size())
+			block.elements.push_back({ PbfBlock::NODE, 0, 0.0, 0.0, (uint32_t)block.tags.size(), 0, 0, 0 });
+
+		return block.elements[first + i];
+	};
+
+	// Unpacked arrays come one value per field, so the deltas run on from one field to the next.
+	// Sums wrap around instead of overflowing in broken files
+	uint64_t id = 0, lon = 0, lat = 0;
+	size_t index = 0;
+	bool key = true;
+	uint32_t keyId = 0;
+	bool valid = true;
+	while (dense.Next())
+	{
+		switch (dense.Field())
+		{
+		case 1:
+		{
+			dense.Repeated([&](uint64_t value) {
+				id += (uint64_t)ProtoReader::Zigzag(value);
+				node(ids++).id = id;
+			});
+			break;
+		}
+		case 8:
+		{
+			dense.Repeated([&](uint64_t value) {
+				lat += (uint64_t)ProtoReader::Zigzag(value);
+				node(lats++).lat = ToDegrees(latOffset, granularity, (int64_t)lat);
+			});
+			break;
+		}
+		case 9:
+		{
+			dense.Repeated([&](uint64_t value) {
+				lon += (uint64_t)ProtoReader::Zigzag(value);
+				node(lons++).lon = ToDegrees(lonOffset, granularity, (int64_t)lon);
+			});
+			break;
+		}
+		case 10:
+		{
+			// Key and value ids of every node one after the other, a 0 ends the node's tags
+			dense.Repeated([&](uint64_t value) {
+				if (key && value == 0)
+				{
+					index++;
+					return;
+				}
+
+				if (key)
+					keyId = (uint32_t)value;
+				else if (first + index < block.elements.size())
+				{
+					PbfBlock::Element& element = block.elements[first + index];
+					if (element.tagCount == 0)
+						element.firstTag = (uint32_t)block.tags.size();
+
+					block.tags.push_back({ keyId, (uint32_t)value });
+					element.tagCount++;
+				}
+				else
+					valid = false;
+
+				key = !key;
+			});
+			break;
+		}
+		default:
+			dense.Skip();
+			break;
+		}
+	}
+
+	size_t count = block.elements.size() - first;
+	return (valid && !dense.Failed() && ids == count && lons == count && lats == count);
+}
+
+static bool DecodeGroup(ProtoReader group, PbfBlock& block, int64_t granularity, int64_t lonOffset, int64_t latOffset)
+{
+	while (group.Next())
+	{
+		uint32_t kind = group.Field();
+		if (kind == 2)
+		{
+			if (!DecodeDenseNodes(group.Bytes(), block, granularity, lonOffset, latOffset))
+				return false;
+
+			continue;
+		}
+
+		if (kind != 1 && kind != 3 && kind != 4)
+		{
+			group.Skip();
+			continue;
+		}
+
+		ProtoReader message = group.Bytes();
+		PbfBlock::Element element = { (kind == 1) ? PbfBlock::NODE : ((kind == 3) ? PbfBlock::WAY : PbfBlock::RELATION), 0, 0.0, 0.0, 0, 0, 0, 0 };
+		element.first = (uint32_t)block.refs.size();
+		block.keys.clear();
+		block.values.clear();
+
+		size_t roles = 0, types = 0;
+		uint64_t delta = 0;
+		while (message.Next())
+		{
+			uint32_t field = message.Field();
+			if (field == 1)
+				element.id = (uint64_t)(kind == 1 ? message.Signed() : (int64_t)message.Varint());
+			else if (field == 2)
+				message.Repeated([&block](uint64_t value) { block.keys.push_back((uint32_t)value); });
+			else if (field == 3)
+				message.Repeated([&block](uint64_t value) { block.values.push_back((uint32_t)value); });
+			else if (kind == 1 && field == 8)
+				element.lat = ToDegrees(latOffset, granularity, message.Signed());
+			else if (kind == 1 && field == 9)
+				element.lon = ToDegrees(lonOffset, granularity, message.Signed());
+			else if ((kind == 3 && field == 8) || (kind == 4 && field == 9))
+			{
+				// Node refs and member ids are delta coded
+				message.Repeated([&block, &delta](uint64_t value) {
+					delta += (uint64_t)ProtoReader::Zigzag(value);
+					block.refs.push_back(delta);
+				});
+			}
+			else if (kind == 4 && field == 8)
+				message.Repeated([&block, &roles](uint64_t value) { block.roles.push_back((uint32_t)value); roles++; });
+			else if (kind == 4 && field == 10)
+				message.Repeated([&block, &types](uint64_t value) { block.types.push_back("nwr?"[std::min<uint64_t>(value, 3)]); types++; });
+			else
+				message.Skip();
+		}
+
+		element.count = (uint32_t)(block.refs.size() - element.first);
+		if (message.Failed() || !ReadTags(block, element) || (kind == 4 && (roles != element.count || types != element.count)))
+			return false;
+
+		block.elements.push_back(element);
+	}
+
+	return !group.Failed();
+}
+
+static bool DecodePrimitives(ProtoReader message, PbfBlock& block)
+{
+	// The granularity and the offsets may follow the groups, so the groups are only decoded once the whole block was read
+	int64_t granularity = 100, lonOffset = 0, latOffset = 0;
+	while (message.Next())
+	{
+		switch (message.Field())
+		{
+		case 1:
+		{
+			ProtoReader table = message.Bytes();
+			while (table.Next())
+			{
+				if (table.Field() != 1)
+				{
+					table.Skip();
+					continue;
+				}
+
+				ProtoReader string = table.Bytes();
+				block.strings.push_back({ (const char*)string.Data(), string.Size() });
+			}
+
+			if (table.Failed())
+				return false;
+
+			break;
+		}
+		case 2: block.groups.push_back(message.Bytes()); break;
+		case 17: granularity = (int64_t)message.Varint(); break;
+		case 19: latOffset = (int64_t)message.Varint(); break;
+		case 20: lonOffset = (int64_t)message.Varint(); break;
+		default: message.Skip(); break;
+		}
+	}
+
+	if (message.Failed())
+		return false;
+
+	for (const ProtoReader& group : block.groups)
+	{
+		if (!DecodeGroup(group, block, granularity, lonOffset, latOffset))
+			return false;
+	}
+
+	// Every string id has to point into the table
+	for (const PbfBlock::TagIds& tag : block.tags)
+	{
+		if (tag.key >= block.strings.size() || tag.value >= block.strings.size())
+			return false;
+	}
+
+	for (uint32_t role : block.roles)
+	{
+		if (role >= block.strings.size())
+			return false;
+	}
+
+	return true;
+}
+
+// Runs on the pool
+static void Decode(PbfBlock& block)
+{
+	TraceZone zone("decode block");
+
+	block.error.clear();
+	block.hasBounds = false;
+	block.strings.clear();
+	block.elements.clear();
+	block.tags.clear();
+	block.refs.clear();
+	block.roles.clear();
+	block.types.clear();
+	block.groups.clear();
+
+	if (block.type == PbfBlock::UNKNOWN)
+		return;
+
+	// The data is either stored as it is or compressed in one of several ways
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	const uint8_t* compressed = nullptr;
+	size_t compressedSize = 0, rawSize = 0;
+	ProtoReader blob(block.blob, block.blobSize);
+	while (blob.Next())
+	{
+		switch (blob.Field())
+		{
+		case 1:
+		{
+			ProtoReader raw = blob.Bytes();
+			data = raw.Data();
+			size = raw.Size();
+			break;
+		}
+		case 2: rawSize = (size_t)blob.Varint(); break;
+		case 3:
+		{
+			ProtoReader zlib = blob.Bytes();
+			compressed = zlib.Data();
+			compressedSize = zlib.Size();
+			break;
+		}
+		case 4: block.error = "has LZMA compressed blocks, only zlib is supported"; return;
+		case 5: block.error = "has bzip2 compressed blocks, only zlib is supported"; return;
+		case 6: block.error = "has LZ4 compressed blocks, only zlib is supported"; return;
+		case 7: block.error = "has Zstandard compressed blocks, only zlib is supported"; return;
+		default: blob.Skip(); break;
+		}
+	}
+
+	if (compressed)
+	{
+		// The size comes from the file, so it is checked before anything is allocated for it
+		zone.Arg("bytes", rawSize);
+		if (rawSize > MAX_BLOB_SIZE)
+		{
+			block.error = "is corrupted, a block is too big";
+			return;
+		}
+
+		block.inflated.resize(rawSize);
+		if (!Inflate(compressed, compressedSize, block.inflated.data(), rawSize))
+		{
+			block.error = "is corrupted, a block doesn't inflate";
+			return;
+		}
+
+		data = block.inflated.data();
+		size = rawSize;
+	}
+
+	if (blob.Failed() || !data)
+	{
+		block.error = "is corrupted, a block has no data";
+		return;
+	}
+
+	bool valid = (block.type == PbfBlock::HEADER) ? DecodeHeader(ProtoReader(data, size), block) : DecodePrimitives(ProtoReader(data, size), block);
+	if (!valid)
+		block.error = "is corrupted, a block doesn't decode";
+}
+
+// Every blob comes with a header saying what it holds and how long it is
+static bool ReadBlobHeader(const uint8_t* data, size_t size, size_t& position, PbfBlock& block)
+{
+	if (size - position < 4)
+		return false;
+
+	size_t headerSize = ((size_t)data[position] << 24) | ((size_t)data[position + 1] << 16) | ((size_t)data[position + 2] << 8) | data[position + 3];
+	position += 4;
+	if (headerSize > MAX_BLOB_HEADER_SIZE || headerSize > size - position)
+		return false;
+
+	ProtoReader header(data + position, headerSize);
+	position += headerSize;
+
+	std::string type;
+	uint64_t blobSize = 0;
+	while (header.Next())
+	{
+		if (header.Field() == 1)
+		{
+			ProtoReader name = header.Bytes();
+			type.assign((const char*)name.Data(), name.Size());
+		}
+		else if (header.Field() == 3)
+			blobSize = header.Varint();
+		else
+			header.Skip();
+	}
+
+	if (header.Failed() || blobSize > MAX_BLOB_SIZE || blobSize > size - position)
+		return false;
+
+	// Blobs of other types are for other readers
+	block.type = (type == "OSMHeader") ? PbfBlock::HEADER : ((type == "OSMData") ? PbfBlock::DATA : PbfBlock::UNKNOWN);
+	block.blob = data + position;
+	block.blobSize = (size_t)blobSize;
+	position += blobSize;
+	return true;
+}
+
+// Runs on the reading thread, the same as the XML reader would call the handler
+static void Deliver(const PbfBlock& block, OsmHandler& handler, Tags& tags, std::vector<uint64_t>& refs, std::vector<OsmMember>& members)
+{
+	if (block.hasBounds)
+		handler.OnBounds(block.bounds);
+
+	for (const PbfBlock::Element& element : block.elements)
+	{
+		tags.resize(element.tagCount);
+		for (uint32_t i = 0; i < element.tagCount; i++)
+		{
+			const PbfBlock::TagIds& ids = block.tags[element.firstTag + i];
+			tags[i].key.assign(block.strings[ids.key].data, block.strings[ids.key].size);
+			tags[i].value.assign(block.strings[ids.value].data, block.strings[ids.value].size);
+		}
+
+		switch (element.kind)
+		{
+		case PbfBlock::NODE:
+			handler.OnNode(element.id, element.lon, element.lat, tags);
+			break;
+		case PbfBlock::WAY:
+			refs.assign(block.refs.begin() + element.first, block.refs.begin() + element.first + element.count);
+			handler.OnWay(element.id, refs, tags);
+			break;
+		case PbfBlock::RELATION:
+			members.resize(element.count);
+			for (uint32_t i = 0; i < element.count; i++)
+			{
+				const PbfBlock::String& role = block.strings[block.roles[element.first + i]];
+				members[i].type = block.types[element.first + i];
+				members[i].ref = block.refs[element.first + i];
+				members[i].role.assign(role.data, role.size);
+			}
+
+			handler.OnRelation(element.id, members, tags);
+			break;
+		}
+	}
+}
+
+bool IsOsmPbf(const std::string& path)
+{
+	return (path.size() >= 4 && path.compare(path.size() - 4, 4, ".pbf") == 0);
+}
+
+bool StreamOsmPbf(const std::string& path, OsmHandler& handler, ThreadPool& pool)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		std::cerr << "Failed to open " << path << std::endl;
+		return false;
+	}
+
+	// Covers the handlers as well, whatever they do with the elements shows up inside
+	TraceZone zone("parse");
+
+	// Blocks are decoded in the order of the file and handed to the handler in that order. The blocks in flight point into
+	// this function's state, so it only returns once all of them are done, even if one of them failed
+	std::mutex mutex;
+	std::condition_variable decoded;
+	std::deque<std::unique_ptr<PbfBlock>> inFlight;
+	std::vector<std::unique_ptr<PbfBlock>> spare;
+	ThreadPool::Group decoders;
+	size_t window = BLOCKS_PER_THREAD * std::max(1u, pool.Size()) + 1;
+
+	size_t position = 0;
+	bool failed = false;
+	Tags tags;
+	std::vector<uint64_t> refs;
+	std::vector<OsmMember> members;
+	while (true)
+	{
+		while (!failed && inFlight.size() < window && position < file.Size())
+		{
+			std::unique_ptr<PbfBlock> block;
+			if (spare.empty())
+				block = std::make_unique<PbfBlock>();
+			else
+			{
+				block = std::move(spare.back());
+				spare.pop_back();
+			}
+
+			if (!ReadBlobHeader(file.Data(), file.Size(), position, *block))
+			{
+				std::cerr << path << " is corrupted or cut off at byte " << position << std::endl;
+				failed = true;
+				break;
+			}
+
+			block->done = false;
+			block->failed = false;
+			PbfBlock* decoding = block.get();
+			inFlight.push_back(std::move(block));
+			pool.Submit([decoding, &mutex, &decoded]() {
+				// Whatever happens, the block is done afterwards, the reading thread waits for it
+				try
+				{
+					Decode(*decoding);
+				}
+				catch (...)
+				{
+					decoding->failed = true;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					decoding->done = true;
+				}
+				decoded.notify_all();
+			}, decoders);
+		}
+
+		if (inFlight.empty())
+			break;
+
+		PbfBlock& block = *inFlight.front();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			decoded.wait(lock, [&block]() { return block.done; });
+		}
+
+		if (!failed && (block.failed || !block.error.empty()))
+		{
+			std::cerr << path << " " << (block.failed ? "has a block that couldn't be decoded" : block.error) << std::endl;
+			failed = true;
+		}
+		else if (!failed)
+			Deliver(block, handler, tags, refs, members);
+
+		spare.push_back(std::move(inFlight.front()));
+		inFlight.pop_front();
+		Trace::Counter("bytes read", position);
+	}
+
+	// The last tasks may still be on their way out after marking their block done
+	pool.Wait(decoders);
+	return !failed;
+}
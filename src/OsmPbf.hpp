@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+#include "OsmStream.hpp"
+#include "ThreadPool.hpp"
+
+// PBF files by their extension, .osm.pbf or just .pbf
+bool IsOsmPbf(const std::string& path);
+
+// Reads an OSM PBF file. Its blocks are inflated and decoded on the pool, several at a time, while the handler
+// works through the ones before them on the calling thread. The handler sees the elements in file order like with XML
+bool StreamOsmPbf(const std::string& path, OsmHandler& handler, ThreadPool& pool);
@@ -0,0 +1,445 @@
+#include "OsmStream.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "Trace.hpp"
+
+#define CHUNK_SIZE (4 * 1024 * 1024)
+
+struct Attribute
+{
+	std::string name, value;
+};
+
+struct Element
+{
+	std::string name;
+	bool closing;		// </name>
+	bool selfClosing;	// <name/>
+
+	// Attribute strings are reused between elements to keep their capacity
+	std::vector<Attribute> attributes;
+	size_t attributeCount;
+
+	const std::string* Get(const char* attribute) const
+	{
+		for (size_t i = 0; i < attributeCount; i++)
+		{
+			if (attributes[i].name == attribute)
+				return &attributes[i].value;
+		}
+
+		return nullptr;
+	}
+};
+
+// Minimal pull parser that's just good enough for OSM files. It only ever holds one chunk of the file in memory
+class XmlReader
+{
+public:
+	XmlReader(FILE* file) :
+		file(file), buffer(CHUNK_SIZE), begin(0), end(0), bytesRead(0), eof(false), broken(false)
+	{
+	}
+
+	// Next() returns false at the end of the file as well as when the file ends in the middle of an element or can't be read
+	bool Broken() const { return broken; }
+
+	bool Next(Element& element)
+	{
+		while (true)
+		{
+			// Skip text content, OSM doesn't have any we care about
+			while (true)
+			{
+				const char* open = (const char*)memchr(buffer.data() + begin, '<', end - begin);
+				if (open)
+				{
+					begin = open - buffer.data();
+					break;
+				}
+
+				begin = end;
+				if (!Fill())
+					return false;
+			}
+
+			size_t close;
+			if (!FindElementEnd(close))
+				return false;
+
+			const char* start = buffer.data() + begin;
+			size_t length = close - begin;
+			begin = close + 1;
+
+			// Declarations, comments and doctypes
+			if (length > 1 && (start[1] == '?' || start[1] == '!'))
+				continue;
+
+			Parse(start + 1, length - 1, element);
+			return true;
+		}
+	}
+
+private:
+	// Makes sure there's more data behind the current position, keeping everything from begin onwards
+	bool Fill()
+	{
+		if (eof)
+			return false;
+
+		if (begin > 0)
+		{
+			memmove(buffer.data(), buffer.data() + begin, end - begin);
+			end -= begin;
+			begin = 0;
+		}
+
+		if (end == buffer.size())
+			buffer.resize(buffer.size() * 2);
+
+		size_t read = fread(buffer.data() + end, 1, buffer.size() - end, file);
+		if (read == 0)
+		{
+			eof = true;
+			if (ferror(file))
+				broken = true;
+			return false;
+		}
+
+		end += read;
+		bytesRead += read;
+		Trace::Counter("bytes read", bytesRead);
+		return true;
+	}
+
+	// Finds the closing > of the element starting at begin. Quoted attribute values may contain a >
+	bool FindElementEnd(size_t& close)
+	{
+		size_t position = begin + 1;
+		char quote = 0;
+		bool comment = false;
+		while (true)
+		{
+			if (position >= end)
+			{
+				size_t offset = position - begin;
+				if (!Fill())
+				{
+					broken = true;
+					return false;
+				}
+
+				position = begin + offset;
+				continue;
+			}
+
+			if (position == begin + 3 && memcmp(buffer.data() + begin, "<!--", 4) == 0)
+				comment = true;
+
+			char c = buffer[position];
+			if (comment)
+			{
+				if (c == '>' && position - begin >= 6 && buffer[position - 1] == '-' && buffer[position - 2] == '-')
+					break;
+			}
+			else if (quote)
+			{
+				if (c == quote)
+					quote = 0;
+			}
+			else if (c == '"' || c == '\'')
+			{
+				quote = c;
+			}
+			else if (c == '>')
+			{
+				break;
+			}
+
+			position++;
+		}
+
+		close = position;
+		return true;
+	}
+
+	static bool IsSpace(char c)
+	{
+		return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+	}
+
+	static void Decode(const char* value, size_t length, std::string& out)
+	{
+		out.clear();
+		for (size_t i = 0; i < length; i++)
+		{
+			if (value[i] != '&')
+			{
+				out.push_back(value[i]);
+				continue;
+			}
+
+			const char* semicolon = (const char*)memchr(value + i, ';', length - i);
+			if (!semicolon)
+			{
+				out.push_back(value[i]);
+				continue;
+			}
+
+			std::string entity(value + i + 1, semicolon);
+			if (entity == "amp") out.push_back('&');
+			else if (entity == "lt") out.push_back('<');
+			else if (entity == "gt") out.push_back('>');
+			else if (entity == "quot") out.push_back('"');
+			else if (entity == "apos") out.push_back('\'');
+			else if (!entity.empty() && entity[0] == '#')
+			{
+				unsigned long codepoint = (entity.size() > 1 && entity[1] == 'x') ? strtoul(entity.c_str() + 2, nullptr, 16) : strtoul(entity.c_str() + 1, nullptr, 10);
+
+				// UTF-8 encode
+				if (codepoint < 0x80) {
+					out.push_back((char)codepoint);
+				}
+				else if (codepoint < 0x800) {
+					out.push_back((char)(0xC0 | (codepoint >> 6)));
+					out.push_back((char)(0x80 | (codepoint & 0x3F)));
+				}
+				else if (codepoint < 0x10000) {
+					out.push_back((char)(0xE0 | (codepoint >> 12)));
+					out.push_back((char)(0x80 | ((codepoint >> 6) & 0x3F)));
+					out.push_back((char)(0x80 | (codepoint & 0x3F)));
+				}
+				else {
+					out.push_back((char)(0xF0 | (codepoint >> 18)));
+					out.push_back((char)(0x80 | ((codepoint >> 12) & 0x3F)));
+					out.push_back((char)(0x80 | ((codepoint >> 6) & 0x3F)));
+					out.push_back((char)(0x80 | (codepoint & 0x3F)));
+				}
+			}
+			else
+			{
+				// Unknown entity, keep it as it is
+				out.append(value + i, semicolon + 1);
+			}
+
+			i = semicolon - value;
+		}
+	}
+
+	// Parses everything between < and >
+	static void Parse(const char* data, size_t length, Element& element)
+	{
+		const char* it = data;
+		const char* last = data + length;
+
+		element.closing = (it < last && *it == '/');
+		if (element.closing)
+			it++;
+
+		element.selfClosing = (last > it && *(last - 1) == '/');
+		if (element.selfClosing)
+			last--;
+
+		const char* nameStart = it;
+		while (it < last && !IsSpace(*it))
+			it++;
+		element.name.assign(nameStart, it);
+
+		element.attributeCount = 0;
+		while (it < last)
+		{
+			while (it < last && IsSpace(*it))
+				it++;
+
+			const char* attributeStart = it;
+			while (it < last && *it != '=' && !IsSpace(*it))
+				it++;
+			const char* attributeEnd = it;
+
+			while (it < last && *it != '"' && *it != '\'')
+				it++;
+			if (it == last)
+				break;
+
+			char quote = *it++;
+			const char* valueStart = it;
+			while (it < last && *it != quote)
+				it++;
+
+			if (element.attributeCount == element.attributes.size())
+				element.attributes.push_back({});
+
+			Attribute& attribute = element.attributes[element.attributeCount++];
+			attribute.name.assign(attributeStart, attributeEnd);
+			Decode(valueStart, it - valueStart, attribute.value);
+
+			if (it < last)
+				it++;
+		}
+	}
+
+private:
+	FILE* file;
+	std::vector<char> buffer;
+	size_t begin, end;
+	size_t bytesRead;
+	bool eof;
+	bool broken;
+};
+
+static uint64_t ToId(const std::string* value)
+{
+	return (value ? strtoull(value->c_str(), nullptr, 10) : 0);
+}
+
+static double ToDouble(const std::string* value)
+{
+	return (value ? strtod(value->c_str(), nullptr) : 0.0);
+}
+
+bool StreamOsm(const std::string& path, OsmHandler& handler)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		std::cerr << "Failed to open " << path << std::endl;
+		return false;
+	}
+
+	// Covers the handlers as well, whatever they do with the elements shows up inside
+	TraceZone zone("parse");
+
+	XmlReader reader(file);
+	Element element;
+
+	enum class Parent {
+		NONE, NODE, WAY, RELATION
+	} parent = Parent::NONE;
+
+	uint64_t id = 0;
+	double lon = 0.0, lat = 0.0;
+	Tags tags;
+	std::vector<uint64_t> refs;
+	std::vector<OsmMember> members;
+
+	auto emit = [&]() {
+		switch (parent)
+		{
+		case Parent::NODE: handler.OnNode(id, lon, lat, tags); break;
+		case Parent::WAY: handler.OnWay(id, refs, tags); break;
+		case Parent::RELATION: handler.OnRelation(id, members, tags); break;
+		default: break;
+		}
+
+		parent = Parent::NONE;
+	};
+
+	// Files that are cut off, like change files that are still being written, often end between two elements.
+	// Only a closed root element says the file is complete
+	std::string root;
+	bool rootClosed = false;
+
+	auto action = [](const std::string& name) {
+		if (name == "create") return OsmAction::CREATED;
+		if (name == "modify") return OsmAction::MODIFIED;
+		if (name == "delete") return OsmAction::DELETED;
+		return OsmAction::NONE;
+	};
+
+	while (!rootClosed && reader.Next(element))
+	{
+		const std::string& name = element.name;
+		if (root.empty())
+		{
+			if (element.closing || (name != "osm" && name != "osmChange"))
+			{
+				std::cerr << path << " isn't an OSM file" << std::endl;
+				fclose(file);
+				return false;
+			}
+
+			root = name;
+			rootClosed = element.selfClosing;
+			continue;
+		}
+
+		if (element.closing && name == root)
+		{
+			rootClosed = true;
+			continue;
+		}
+
+		if (element.closing)
+		{
+			if ((name == "node" && parent == Parent::NODE) ||
+				(name == "way" && parent == Parent::WAY) ||
+				(name == "relation" && parent == Parent::RELATION))
+			{
+				emit();
+			}
+			else if (action(name) != OsmAction::NONE)
+				handler.OnAction(OsmAction::NONE);
+
+			continue;
+		}
+
+		if (action(name) != OsmAction::NONE)
+		{
+			handler.OnAction(element.selfClosing ? OsmAction::NONE : action(name));
+			continue;
+		}
+
+		if (name == "node" || name == "way" || name == "relation")
+		{
+			parent = (name == "node") ? Parent::NODE : ((name == "way") ? Parent::WAY : Parent::RELATION);
+			id = ToId(element.Get("id"));
+			lon = ToDouble(element.Get("lon"));
+			lat = ToDouble(element.Get("lat"));
+			tags.clear();
+			refs.clear();
+			members.clear();
+
+			if (element.selfClosing)
+				emit();
+		}
+		else if (name == "tag" && parent != Parent::NONE)
+		{
+			const std::string* key = element.Get("k");
+			const std::string* value = element.Get("v");
+			if (key && value)
+				tags.push_back({ *key, *value });
+		}
+		else if (name == "nd" && parent == Parent::WAY)
+		{
+			refs.push_back(ToId(element.Get("ref")));
+		}
+		else if (name == "member" && parent == Parent::RELATION)
+		{
+			const std::string* type = element.Get("type");
+			const std::string* role = element.Get("role");
+			members.push_back({ (type && !type->empty()) ? (*type)[0] : '?', ToId(element.Get("ref")), role ? *role : "" });
+		}
+		else if (name == "bounds")
+		{
+			osmp::Bounds bounds;
+			bounds.minlat = ToDouble(element.Get("minlat"));
+			bounds.minlon = ToDouble(element.Get("minlon"));
+			bounds.maxlat = ToDouble(element.Get("maxlat"));
+			bounds.maxlon = ToDouble(element.Get("maxlon"));
+			handler.OnBounds(bounds);
+		}
+	}
+
+	fclose(file);
+	if (reader.Broken() || !rootClosed)
+	{
+		std::cerr << path << " is cut off or couldn't be read" << std::endl;
+		return false;
+	}
+
+	return true;
+}
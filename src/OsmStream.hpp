@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <osmp.hpp>
+#include "OsmData.hpp"
+
+struct OsmMember
+{
+	char type;	// 'n'ode, 'w'ay or 'r'elation
+	uint64_t ref;
+	std::string role;
+};
+
+// The blocks of an osmChange file (.osc), the elements inside say what happened to them
+enum class OsmAction
+{
+	NONE,
+	CREATED,
+	MODIFIED,
+	DELETED
+};
+
+// Receives the elements of an OSM file in the order they appear in, one at a time.
+// None of the passed data outlives the call
+class OsmHandler
+{
+public:
+	virtual ~OsmHandler() = default;
+
+	virtual void OnBounds(const osmp::Bounds& bounds) {}
+	virtual void OnAction(OsmAction action) {}	// Entering or leaving a block of an osmChange file
+	virtual void OnNode(uint64_t id, double lon, double lat, const Tags& tags) {}
+	virtual void OnWay(uint64_t id, const std::vector<uint64_t>& refs, const Tags& tags) {}
+	virtual void OnRelation(uint64_t id, const std::vector<OsmMember>& members, const Tags& tags) {}
+};
+
+// Reads an OSM XML or osmChange file front to back in small chunks without ever building a document
+bool StreamOsm(const std::string& path, OsmHandler& handler);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <osmp.hpp>
+#include "vector2.hpp"
+#include "SpatialIndex.hpp"
+
+#define EARTH_RADIUS 6378137.0
+#define DEGREES_TO_RADIANS (3.14159265358979323846 / 180.0)
+#define MERCATOR_MAX_LATITUDE 85.0511287798
+
+// Projections turn longitude and latitude into meters on a flat map, north is up.
+// Which one the viewer uses is decided at compile time, see MAP_PROJECTION below
+
+// Longitude and latitude scaled the same, like the viewer always drew maps
+struct Equirectangular
+{
+	static constexpr uint32_t Id = 1;
+
+	static Vector2d Project(double lon, double lat)
+	{
+		return { EARTH_RADIUS * lon * DEGREES_TO_RADIANS, EARTH_RADIUS * lat * DEGREES_TO_RADIANS };
+	}
+};
+
+// Spherical Mercator, the projection of web map tiles
+struct WebMercator
+{
+	static constexpr uint32_t Id = 2;
+
+	static Vector2d Project(double lon, double lat)
+	{
+		lat = std::clamp(lat, -MERCATOR_MAX_LATITUDE, MERCATOR_MAX_LATITUDE) * DEGREES_TO_RADIANS;
+		return { EARTH_RADIUS * lon * DEGREES_TO_RADIANS, EARTH_RADIUS * std::asinh(std::tan(lat)) };
+	}
+};
+
+// World space all geometry is stored in: projected meters relative to the center of the map bounds,
+// with y pointing south like on screen. Keeping the numbers small keeps float vertices precise
+template<typename ProjectionType>
+class BasicWorld
+{
+public:
+	typedef ProjectionType Projection;
+
+	BasicWorld() :
+		origin{ 0.0, 0.0 }, bounds{ 0.0, 0.0, 0.0, 0.0 }
+	{
+	}
+
+	BasicWorld(const osmp::Bounds& map)
+	{
+		Vector2d min = Projection::Project(map.minlon, map.minlat);
+		Vector2d max = Projection::Project(map.maxlon, map.maxlat);
+		origin = { (min.x + max.x) / 2.0, (min.y + max.y) / 2.0 };
+		bounds = { min.x - origin.x, origin.y - max.y, max.x - origin.x, origin.y - min.y };
+	}
+
+	Vector2d ToWorld(double lon, double lat) const
+	{
+		return FromProjected(Projection::Project(lon, lat));
+	}
+
+	// Between world space and plain projected meters, which don't depend on the map bounds
+	Vector2d FromProjected(const Vector2d& projected) const { return { projected.x - origin.x, origin.y - projected.y }; }
+	Vector2d ToProjected(const Vector2d& point) const { return { point.x + origin.x, origin.y - point.y }; }
+
+	// The map bounds in world space
+	const Box& Bounds() const { return bounds; }
+
+private:
+	Vector2d origin;
+	Box bounds;
+};
+
+// Pick the projection by defining MAP_PROJECTION, the build exposes it as a CMake option
+#ifndef MAP_PROJECTION
+#define MAP_PROJECTION Equirectangular
+#endif
+
+typedef BasicWorld<MAP_PROJECTION> World;
@@ -0,0 +1,464 @@
+#include "RegionStore.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+#include "Arena.hpp"
+#include "Trace.hpp"
+
+#define INDEX_MAGIC "MVREGNS"
+#define INDEX_VERSION 1
+#define INDEX_NAME "regions.index"
+#define OVERVIEW_NAME "overview.region"
+#define REGION_EXTENSION ".region"
+
+namespace fs = std::filesystem;
+
+struct IndexHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	MapCache::Fingerprint source;	// Every region is a cache of this source file
+	uint64_t style;
+	uint32_t projection;
+	uint32_t regionCount;
+	double minlat, minlon, maxlat, maxlon;
+	double regionSize;
+};
+
+struct RegionRecord {
+	int32_t x, y;
+	double minX, minY, maxX, maxY;
+};
+
+static void Extend(Box& box, const PackedPoints& points)
+{
+	ScratchScope scope;
+	ScratchVector<Vector2f> unpacked(points.count);
+	points.Unpack(unpacked.data());
+	for (const Vector2f& point : unpacked)
+	{
+		box.minX = std::min(box.minX, (double)point.x);
+		box.minY = std::min(box.minY, (double)point.y);
+		box.maxX = std::max(box.maxX, (double)point.x);
+		box.maxY = std::max(box.maxY, (double)point.y);
+	}
+}
+
+static void Extend(Box& box, const Box& other)
+{
+	box.minX = std::min(box.minX, other.minX);
+	box.minY = std::min(box.minY, other.minY);
+	box.maxX = std::max(box.maxX, other.maxX);
+	box.maxY = std::max(box.maxY, other.maxY);
+}
+
+bool RegionStore::Write(const std::string& directory, const std::string& source, uint64_t style, const osmp::Bounds& bounds,
+	const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, size_t& regions)
+{
+	TraceZone zone("write regions");
+
+	MapCache::Fingerprint fingerprint;
+	if (!MapCache::TakeFingerprint(source, fingerprint))
+	{
+		std::cerr << "Failed to read source file " << source << " for the regions" << std::endl;
+		return false;
+	}
+
+	// The index goes first, an index left from before would point at a mix of old and new regions
+	std::error_code error;
+	fs::create_directories(directory, error);
+	for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+	{
+		if (entry.path().extension() == REGION_EXTENSION)
+			fs::remove(entry.path(), error);
+	}
+	fs::remove(fs::path(directory) / INDEX_NAME, error);
+	if (error)
+	{
+		std::cerr << "Failed to clear " << directory << " for the regions: " << error.message() << std::endl;
+		return false;
+	}
+
+	struct Contents {
+		std::vector<Multipolygon> multipolygons;
+		std::vector<Area> buildings;
+		std::vector<Highway> highways;
+		Box bounds = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+	};
+	std::map<std::pair<int32_t, int32_t>, Contents> contents;	// Ordered, so the same map always makes the same files
+	Contents overview;
+
+	// Every feature goes to the region its center is in, the region's bounds grow to hold all of it
+	World world(bounds);
+	const Box& extent = world.Bounds();
+	auto place = [&contents, &overview, &extent](const Box& box) {
+		int32_t x = (int32_t)std::floor(((box.minX + box.maxX) / 2.0 - extent.minX) / REGION_SIZE);
+		int32_t y = (int32_t)std::floor(((box.minY + box.maxY) / 2.0 - extent.minY) / REGION_SIZE);
+		Contents& region = contents[{ x, y }];
+		Extend(region.bounds, box);
+
+		bool large = std::max(box.maxX - box.minX, box.maxY - box.minY) >= OVERVIEW_EXTENT;
+		if (large)
+			Extend(overview.bounds, box);
+
+		return std::make_pair(&region, large);
+	};
+
+	// Multipolygons keep their render order within every region
+	for (const Multipolygon& multipolygon : multipolygons)
+	{
+		Box box = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+		for (const Multipolygon::Polygon& polygon : multipolygon.polygons)
+			Extend(box, polygon.vertices);
+
+		if (!multipolygon.visible || box.minX > box.maxX)
+			continue;
+
+		auto placed = place(box);
+		placed.first->multipolygons.push_back(multipolygon);
+		if (placed.second)
+			overview.multipolygons.push_back(multipolygon);
+	}
+
+	for (const Area& area : buildings)
+	{
+		Box box = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+		Extend(box, area.points);
+		if (box.minX > box.maxX)
+			continue;
+
+		auto placed = place(box);
+		placed.first->buildings.push_back(area);
+		if (placed.second)
+			overview.buildings.push_back(area);
+	}
+
+	for (const Highway& highway : highways)
+	{
+		Box box = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+		Extend(box, highway.points);
+		if (highway.points.count < 2)
+			continue;
+
+		auto placed = place(box);
+		placed.first->highways.push_back(highway);
+		if (placed.second)
+			overview.highways.push_back(highway);
+	}
+
+	std::vector<RegionRecord> records;
+	for (const auto& region : contents)
+	{
+		std::string path = (fs::path(directory) / (std::to_string(region.first.first) + "_" + std::to_string(region.first.second) + REGION_EXTENSION)).string();
+		if (!MapCache::Write(path, fingerprint, style, bounds, region.second.multipolygons, region.second.buildings, region.second.highways))
+			return false;
+
+		const Box& box = region.second.bounds;
+		records.push_back({ region.first.first, region.first.second, box.minX, box.minY, box.maxX, box.maxY });
+	}
+
+	if (!MapCache::Write((fs::path(directory) / OVERVIEW_NAME).string(), fingerprint, style, bounds, overview.multipolygons, overview.buildings, overview.highways))
+		return false;
+
+	IndexHeader header;
+	memset(&header, 0, sizeof(IndexHeader));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = INDEX_VERSION;
+	header.headerSize = sizeof(IndexHeader);
+	header.source = fingerprint;
+	header.style = style;
+	header.projection = World::Projection::Id;
+	header.regionCount = (uint32_t)records.size();
+	header.minlat = bounds.minlat;
+	header.minlon = bounds.minlon;
+	header.maxlat = bounds.maxlat;
+	header.maxlon = bounds.maxlon;
+	header.regionSize = REGION_SIZE;
+
+	// Through a temporary file like the caches, so there's never half an index
+	std::string path = (fs::path(directory) / INDEX_NAME).string();
+	std::string temporary = path + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file)
+	{
+		std::cerr << "Failed to create region index " << temporary << std::endl;
+		return false;
+	}
+
+	bool success = (fwrite(&header, sizeof(IndexHeader), 1, file) == 1);
+	success &= records.empty() || (fwrite(records.data(), sizeof(RegionRecord), records.size(), file) == records.size());
+	success &= (fclose(file) == 0);
+
+	if (success)
+		fs::rename(temporary, path, error);
+
+	if (!success || error)
+	{
+		std::cerr << "Failed to write region index " << path << std::endl;
+		fs::remove(temporary, error);
+		return false;
+	}
+
+	regions = records.size();
+	return true;
+}
+
+RegionStore::RegionStore(ThreadPool& pool, size_t budget) :
+	pool(pool), budget(budget)
+{
+}
+
+RegionStore::~RegionStore()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_one();
+
+	if (thread.joinable())
+		thread.join();
+}
+
+bool RegionStore::Open(const std::string& directory, uint64_t style)
+{
+	std::string path = (fs::path(directory) / INDEX_NAME).string();
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		std::cerr << "Failed to open region index " << path << std::endl;
+		return false;
+	}
+
+	const IndexHeader* header = (const IndexHeader*)file.Data();
+	if (file.Size() < sizeof(IndexHeader) ||
+		memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+		header->version != INDEX_VERSION ||
+		header->headerSize != sizeof(IndexHeader) ||
+		(file.Size() - sizeof(IndexHeader)) / sizeof(RegionRecord) < header->regionCount)
+	{
+		std::cerr << "Region index " << path << " is corrupted" << std::endl;
+		return false;
+	}
+
+	if (header->style != style || header->projection != World::Projection::Id)
+	{
+		std::cerr << "The regions in " << directory << " were made with other style rules or another projection, write them again" << std::endl;
+		return false;
+	}
+
+	this->directory = directory;
+	this->style = style;
+	source = header->source;
+	bounds.minlat = header->minlat;
+	bounds.minlon = header->minlon;
+	bounds.maxlat = header->maxlat;
+	bounds.maxlon = header->maxlon;
+
+	const RegionRecord* records = (const RegionRecord*)(file.Data() + sizeof(IndexHeader));
+	std::vector<Box> boxes;
+	for (uint32_t i = 0; i < header->regionCount; i++)
+	{
+		Region region;
+		region.x = records[i].x;
+		region.y = records[i].y;
+		region.bounds = { records[i].minX, records[i].minY, records[i].maxX, records[i].maxY };
+		regions.push_back(region);
+		boxes.push_back(region.bounds);
+	}
+	index.Build(boxes);
+
+	overview = LoadRegion((fs::path(directory) / OVERVIEW_NAME).string());
+	if (!overview)
+		return false;
+
+	thread = std::thread(&RegionStore::Work, this);
+	return true;
+}
+
+void RegionStore::Update(const Box& view, double pixelsPerUnit)
+{
+	TraceZone zone("regions");
+	frame++;
+
+	Done finished;
+	while (done.Pop(finished))
+	{
+		pending--;
+
+		// Regions that failed to load stay requested, so they aren't tried again every frame
+		Region& region = regions[finished.region];
+		if (!finished.arena)
+			continue;
+
+		region.requested = false;
+		region.arena = std::move(finished.arena);
+		region.lastUsed = frame;
+		loaded++;
+		loadedBytes += region.arena->Bytes();
+	}
+
+	if (!ShowOverview(pixelsPerUnit))
+	{
+		auto byDistance = [this](const Box& box) {
+			double x = (box.minX + box.maxX) / 2.0, y = (box.minY + box.maxY) / 2.0;
+			std::sort(candidates.begin(), candidates.end(), [this, x, y](uint32_t a, uint32_t b) {
+				const Box& boxA = regions[a].bounds;
+				const Box& boxB = regions[b].bounds;
+				return (std::hypot((boxA.minX + boxA.maxX) / 2.0 - x, (boxA.minY + boxA.maxY) / 2.0 - y) <
+					std::hypot((boxB.minX + boxB.maxX) / 2.0 - x, (boxB.minY + boxB.maxY) / 2.0 - y));
+			});
+		};
+
+		// What's in view comes first, from the center outwards
+		candidates.clear();
+		index.Query(view, candidates);
+		for (uint32_t i : candidates)
+			regions[i].lastUsed = frame;
+
+		byDistance(view);
+		for (uint32_t i : candidates)
+			Request(i);
+
+		// Then whatever is a view further in the direction the view is moving
+		double dx = (view.minX + view.maxX - lastView.minX - lastView.maxX) / 2.0;
+		double dy = (view.minY + view.maxY - lastView.minY - lastView.maxY) / 2.0;
+		double distance = std::hypot(dx, dy);
+		if (distance > 0.0)
+		{
+			double width = view.maxX - view.minX, height = view.maxY - view.minY;
+			Box ahead = { view.minX + dx / distance * width, view.minY + dy / distance * height,
+				view.maxX + dx / distance * width, view.maxY + dy / distance * height };
+
+			candidates.clear();
+			index.Query(ahead, candidates);
+			byDistance(ahead);
+			for (uint32_t i : candidates)
+				Request(i);
+		}
+	}
+
+	lastView = view;
+	Evict();
+
+	zone.Arg("loaded", loaded);
+	Trace::Counter("region bytes", loadedBytes);
+}
+
+void RegionStore::Query(const Box& view, double pixelsPerUnit, std::vector<Visible>& result) const
+{
+	if (ShowOverview(pixelsPerUnit))
+	{
+		result.push_back({ (uint32_t)regions.size(), overview });
+		return;
+	}
+
+	std::vector<uint32_t> hits;
+	index.Query(view, hits);
+	std::sort(hits.begin(), hits.end());
+
+	// Until every region in view is there, the overview fills the gaps
+	size_t first = result.size();
+	for (uint32_t i : hits)
+	{
+		if (regions[i].arena)
+			result.push_back({ i, regions[i].arena });
+	}
+
+	if (result.size() - first < hits.size())
+		result.insert(result.begin() + first, { (uint32_t)regions.size(), overview });
+}
+
+bool RegionStore::ShowOverview(double pixelsPerUnit) const
+{
+	return (REGION_SIZE * pixelsPerUnit < REGION_MIN_PIXELS);
+}
+
+void RegionStore::Request(uint32_t region)
+{
+	Region& wanted = regions[region];
+	if (wanted.arena || wanted.requested || pending >= REGION_REQUESTS)
+		return;
+
+	wanted.requested = true;
+	pending++;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requests.push_back(region);
+	}
+	wake.notify_one();
+}
+
+void RegionStore::Evict()
+{
+	// Regions in view stay, even if they alone are over the budget
+	while (loadedBytes > budget)
+	{
+		Region* oldest = nullptr;
+		for (Region& region : regions)
+		{
+			if (region.arena && region.lastUsed < frame && (!oldest || region.lastUsed < oldest->lastUsed))
+				oldest = &region;
+		}
+
+		if (!oldest)
+			break;
+
+		loadedBytes -= oldest->arena->Bytes();
+		loaded--;
+		oldest->arena.reset();
+	}
+}
+
+std::string RegionStore::PathFor(int32_t x, int32_t y) const
+{
+	return (fs::path(directory) / (std::to_string(x) + "_" + std::to_string(y) + REGION_EXTENSION)).string();
+}
+
+void RegionStore::Work()
+{
+	Trace::SetThreadName("Regions");
+
+	while (true)
+	{
+		uint32_t region;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return (stop || !requests.empty()); });
+			if (stop)
+				return;
+
+			region = requests.front();
+			requests.pop_front();
+		}
+
+		// Only the position is read here, it never changes after Open
+		done.Push({ region, LoadRegion(PathFor(regions[region].x, regions[region].y)) });
+	}
+}
+
+std::shared_ptr<MapArena> RegionStore::LoadRegion(const std::string& path)
+{
+	TraceZone zone("load region");
+
+	// The arena has its own copy of the geometry, the mapping and the features can go right after
+	MapCache cache;
+	std::vector<Multipolygon> multipolygons;
+	std::vector<Area> buildings;
+	std::vector<Highway> highways;
+	if (!cache.Load(path, source, style, multipolygons, buildings, highways))
+	{
+		std::cerr << "Failed to load region " << path << ", the map it was made from has changed or it is corrupted" << std::endl;
+		return nullptr;
+	}
+
+	std::shared_ptr<MapArena> arena = std::make_shared<MapArena>();
+	arena->Build(multipolygons, buildings, highways, pool);
+	return arena;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <osmp.hpp>
+#include "HandoffQueue.hpp"
+#include "MapArena.hpp"
+#include "MapCache.hpp"
+#include "SpatialIndex.hpp"
+#include "ThreadPool.hpp"
+
+// Side of the square regions a map is split into, in world units (meters)
+#define REGION_SIZE 2000.0
+
+// Features at least this big also go into the overview, which is drawn instead of the regions when zoomed out
+#define OVERVIEW_EXTENT (REGION_SIZE / 4.0)
+
+// Regions smaller than this on screen aren't loaded anymore, the overview stands in for them
+#define REGION_MIN_PIXELS 256.0
+
+// Regions being loaded at a time, so a fast pan doesn't queue up regions that are out of view by the time they're done
+#define REGION_REQUESTS 4
+
+// A preprocessed map split into square regions on disk, for extracts that don't fit into memory as a whole.
+// Every region is a map cache of the features whose bounding box is centered in it, with their triangulations,
+// the index next to them knows how far every region's features reach. At runtime only the regions around the view
+// are loaded, on a thread of their own, and the least recently used ones are dropped once they take up more than the budget.
+// Regions the view is panning towards are loaded ahead of time
+class RegionStore
+{
+public:
+	// Splits the map into regions and writes them with the index into the directory
+	static bool Write(const std::string& directory, const std::string& source, uint64_t style, const osmp::Bounds& bounds,
+		const std::vector<Multipolygon>& multipolygons, const std::vector<Area>& buildings, const std::vector<Highway>& highways, size_t& regions);
+
+public:
+	RegionStore(ThreadPool& pool, size_t budget);
+	~RegionStore();
+
+	RegionStore(const RegionStore&) = delete;
+	RegionStore& operator=(const RegionStore&) = delete;
+
+	// Reads the index and loads the overview. Fails if the regions were styled with other rules or are in another projection
+	bool Open(const std::string& directory, uint64_t style);
+
+	const osmp::Bounds& Bounds() const { return bounds; }
+
+	// Once per frame from the render thread, never waits for a region. Takes the regions that finished loading,
+	// asks for the ones the view needs and drops the least recently used ones over the budget
+	void Update(const Box& view, double pixelsPerUnit);
+
+	// What to draw for the view: the overview, or the loaded regions reaching into it. Holding on to an arena
+	// keeps it alive after the region was dropped
+	struct Visible {
+		uint32_t region;	// Regions() for the overview
+		std::shared_ptr<const MapArena> arena;
+	};
+	void Query(const Box& view, double pixelsPerUnit, std::vector<Visible>& result) const;
+
+	size_t Regions() const { return regions.size(); }
+	size_t Loaded() const { return loaded; }
+	size_t LoadedBytes() const { return loadedBytes; }
+
+private:
+	struct Region {
+		int32_t x, y;
+		Box bounds;		// Of its features, which reach past the region itself
+		std::shared_ptr<MapArena> arena;
+		bool requested = false;
+		uint64_t lastUsed = 0;	// Frame
+	};
+
+	struct Done {
+		uint32_t region;
+		std::shared_ptr<MapArena> arena;	// Empty if loading failed
+	};
+
+	bool ShowOverview(double pixelsPerUnit) const;
+	void Request(uint32_t region);
+	void Evict();
+	std::string PathFor(int32_t x, int32_t y) const;
+
+	// The loading thread
+	void Work();
+	std::shared_ptr<MapArena> LoadRegion(const std::string& path);
+
+	ThreadPool& pool;
+	size_t budget;
+	std::string directory;
+	MapCache::Fingerprint source;
+	uint64_t style = 0;
+	osmp::Bounds bounds;
+
+	std::vector<Region> regions;
+	SpatialIndex index;		// Bounds of the regions
+	std::shared_ptr<MapArena> overview;
+
+	uint64_t frame = 0;
+	size_t loaded = 0, loadedBytes = 0, pending = 0;
+	Box lastView = { 0.0, 0.0, 0.0, 0.0 };
+	std::vector<uint32_t> candidates;
+
+	// Regions to load go to the thread under the lock, loaded ones come back without one
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<uint32_t> requests;
+	bool stop = false;
+	HandoffQueue<Done> done;
+};
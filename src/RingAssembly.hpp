@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include <triangle.h>
+#include "OsmData.hpp"
+#include "SpatialIndex.hpp"
+#include "Projection.hpp"
+#include "Arena.hpp"
+
+// The stages a multipolygon goes through while it's built, out here so the benchmarks can time them one by one.
+// Everything lives in the thread's scratch arena, only the packed polygons go to the geometry store
+
+struct TriangulationData {
+	ScratchVector<REAL> vertices, holes;
+	ScratchVector<int> segments;
+	ScratchVector<int> rings;	// Where every ring starts in segments
+};
+
+struct Ring {
+	ScratchVector<NodeCoord> nodes;
+	bool inner;
+	int index;
+	bool hole = false;
+	Box bounds = {};	// Filled in by GroupRings
+};
+
+struct RingGroup {
+	ScratchVector<Ring> rings;
+};
+
+// Joins the member ways into closed rings
+bool AssignRings(ScratchVector<Ring>& rings, const std::vector<RelationMember>& members);
+
+// Groups every outer ring with the holes directly inside it
+bool GroupRings(ScratchVector<RingGroup>& ringGroups, ScratchVector<Ring>& rings);
+
+// Rings of the group in world space as Triangle's segments, with a point inside every hole
+void PrepareTriangulation(const RingGroup& ringGroup, const World& world, TriangulationData& td);
+
+// Merges vertices in the same spot and drops the segments that collapse because of it
+void MergeDuplicateVertices(TriangulationData& td);
+
+// Ear clipping for the plain groups most maps are made of, takes td straight from PrepareTriangulation.
+// The points are td's vertices as they are. False if the group has to go to Triangle, see Earcut
+bool TriangulateWithEarcut(const TriangulationData& td, ScratchVector<Vector2d>& points, ScratchVector<int>& triangles);
+
+// Everything else, after MergeDuplicateVertices. Points Triangle adds where rings cross come after td's vertices
+void TriangulateWithTriangle(TriangulationData& td, ScratchVector<Vector2d>& points, ScratchVector<int>& triangles);
@@ -0,0 +1,146 @@
+#include "Simplify.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "Arena.hpp"
+#include "Intersection.hpp"
+
+#define SIMPLIFY_ATTEMPTS 4
+
+static double SegmentDistance2(const Vector2d& p, const Vector2d& a, const Vector2d& b)
+{
+	double dx = b.x - a.x, dy = b.y - a.y;
+	double length2 = dx * dx + dy * dy;
+	double t = (length2 > 0.0) ? std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) / length2, 0.0, 1.0) : 0.0;
+
+	double x = a.x + t * dx - p.x, y = a.y + t * dy - p.y;
+	return x * x + y * y;
+}
+
+// Marks the points between first and last that have to stay, with an explicit stack since ways can be very long
+static void Mark(const Vector2d* points, size_t first, size_t last, double tolerance2, ScratchVector<bool>& keep)
+{
+	ScratchVector<std::pair<size_t, size_t>> stack = { { first, last } };
+	while (!stack.empty())
+	{
+		auto [from, to] = stack.back();
+		stack.pop_back();
+
+		double farthest = -1.0;
+		size_t split = from;
+		for (size_t i = from + 1; i < to; i++)
+		{
+			double distance = SegmentDistance2(points[i], points[from], points[to]);
+			if (distance > farthest)
+			{
+				farthest = distance;
+				split = i;
+			}
+		}
+
+		if (farthest <= tolerance2)
+			continue;
+
+		keep[split] = true;
+		stack.push_back({ from, split });
+		stack.push_back({ split, to });
+	}
+}
+
+void SimplifyPolyline(Span<const Vector2d> points, double tolerance, std::vector<uint32_t>& kept)
+{
+	kept.clear();
+	if (points.empty())
+		return;
+
+	ScratchScope scope;
+	ScratchVector<bool> keep(points.size(), false);
+	keep[0] = keep[points.size() - 1] = true;
+	Mark(points.data, 0, points.size() - 1, tolerance * tolerance, keep);
+
+	for (uint32_t i = 0; i < points.size(); i++)
+	{
+		if (keep[i])
+			kept.push_back(i);
+	}
+}
+
+static void SimplifyRing(Span<const Vector2d> ring, double tolerance, std::vector<uint32_t>& kept)
+{
+	kept.clear();
+	if (ring.size() < 3)
+		return;
+
+	// A ring has no ends, so it's split at its first point and the point furthest away from that
+	ScratchScope scope;
+	ScratchVector<Vector2d> closed(ring.begin(), ring.end());
+	closed.push_back(ring[0]);
+
+	size_t opposite = 0;
+	double farthest = -1.0;
+	for (size_t i = 1; i < ring.size(); i++)
+	{
+		double dx = ring[i].x - ring[0].x, dy = ring[i].y - ring[0].y;
+		if (dx * dx + dy * dy > farthest)
+		{
+			farthest = dx * dx + dy * dy;
+			opposite = i;
+		}
+	}
+
+	ScratchVector<bool> keep(closed.size(), false);
+	keep[0] = keep[opposite] = true;
+	Mark(closed.data(), 0, opposite, tolerance * tolerance, keep);
+	Mark(closed.data(), opposite, ring.size(), tolerance * tolerance, keep);
+
+	for (uint32_t i = 0; i < ring.size(); i++)
+	{
+		if (keep[i])
+			kept.push_back(i);
+	}
+
+	if (kept.size() < 3)
+		kept.clear();
+}
+
+void SimplifyRings(Span<const Span<const Vector2d>> rings, double tolerance, std::vector<std::vector<uint32_t>>& kept)
+{
+	kept.resize(rings.size());
+
+	ScratchScope scope;
+	ScratchVector<Vector2d> points;
+	ScratchVector<size_t> starts;
+	ScratchVector<Span<const Vector2d>> simplified;
+	for (int attempt = 0; attempt < SIMPLIFY_ATTEMPTS; attempt++, tolerance /= 2.0)
+	{
+		points.clear();
+		starts.clear();
+		for (size_t i = 0; i < rings.size(); i++)
+		{
+			SimplifyRing(rings[i], tolerance, kept[i]);
+			if (kept[i].empty())
+				continue;
+
+			starts.push_back(points.size());
+			for (uint32_t point : kept[i])
+				points.push_back(rings[i][point]);
+		}
+		starts.push_back(points.size());
+
+		// The points are all there now, so they won't move anymore
+		simplified.clear();
+		for (size_t i = 0; i + 1 < starts.size(); i++)
+			simplified.push_back({ points.data() + starts[i], starts[i + 1] - starts[i] });
+
+		if (!RingsIntersecting({ simplified.data(), simplified.size() }))
+			return;
+	}
+
+	for (size_t i = 0; i < rings.size(); i++)
+	{
+		kept[i].resize(rings[i].size());
+		for (uint32_t j = 0; j < rings[i].size(); j++)
+			kept[i][j] = j;
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "span.hpp"
+#include "vector2.hpp"
+
+// Douglas-Peucker on an open polyline. Keeps just enough points that none of the dropped ones is further than
+// the tolerance from the simplified line, both ends always stay. Positions of the kept points go to kept, in order
+void SimplifyPolyline(Span<const Vector2d> points, double tolerance, std::vector<uint32_t>& kept);
+
+// Simplifies the closed rings of one polygon together, so they neither cross themselves nor each other afterwards.
+// If they would, the tolerance is halved and it's tried again, giving up keeps every ring as it is.
+// Rings that collapse to less than three points come back empty
+void SimplifyRings(Span<const Span<const Vector2d>> rings, double tolerance, std::vector<std::vector<uint32_t>>& kept);
@@ -0,0 +1,342 @@
+#include "SoftwareRenderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Image.hpp"
+#include "Trace.hpp"
+
+#define CHUNK_PRIMITIVES 4096
+#define TRANSFORM_FEATURES 256
+
+typedef MapArena::Vertex Vertex;
+
+namespace
+{
+	// Pixels of a tile, the far edges are exclusive
+	struct Rect {
+		int x0, y0, x1, y1;
+	};
+}
+
+bool Framebuffer::Save(const std::string& path) const
+{
+	return WriteImage(path, width, height, pixels.data());
+}
+
+static inline void Plot(Framebuffer& framebuffer, int x, int y, const uint8_t* color)
+{
+	memcpy(&framebuffer.pixels[((size_t)y * framebuffer.width + x) * 4], color, 4);
+}
+
+static inline float Edge(const Vertex& a, const Vertex& b, float x, float y)
+{
+	return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+// Pixel range of a bounding box, clipped to the given area. False if nothing is left.
+// Written so that NaNs and huge coordinates from extreme zoom levels end up outside as well
+static inline bool Clip(float minX, float minY, float maxX, float maxY, const Rect& rect, Rect& pixels)
+{
+	if (!(maxX >= rect.x0 && minX < rect.x1 && maxY >= rect.y0 && minY < rect.y1))
+		return false;
+
+	pixels.x0 = (int)std::max((float)rect.x0, std::floor(minX));
+	pixels.y0 = (int)std::max((float)rect.y0, std::floor(minY));
+	pixels.x1 = (int)std::min((float)rect.x1 - 1, std::floor(maxX)) + 1;
+	pixels.y1 = (int)std::min((float)rect.y1 - 1, std::floor(maxY)) + 1;
+	return true;
+}
+
+// Fills every pixel whose center is inside the triangle or on its edges
+static void FillTriangle(Framebuffer& framebuffer, const Rect& rect, Vertex a, Vertex b, Vertex c, const uint8_t* color)
+{
+	float area = Edge(a, b, c.x, c.y);
+	if (!(area != 0.0f))
+		return;
+
+	if (area < 0.0f)
+		std::swap(b, c);
+
+	Rect pixels;
+	if (!Clip(std::min({ a.x, b.x, c.x }), std::min({ a.y, b.y, c.y }), std::max({ a.x, b.x, c.x }), std::max({ a.y, b.y, c.y }), rect, pixels))
+		return;
+
+	// The edge functions change by a constant from one pixel to the next
+	float stepA = -(c.y - b.y), stepB = -(a.y - c.y), stepC = -(b.y - a.y);
+	for (int y = pixels.y0; y < pixels.y1; y++)
+	{
+		float px = pixels.x0 + 0.5f, py = y + 0.5f;
+		float w0 = Edge(b, c, px, py);
+		float w1 = Edge(c, a, px, py);
+		float w2 = Edge(a, b, px, py);
+
+		for (int x = pixels.x0; x < pixels.x1; x++)
+		{
+			if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+				Plot(framebuffer, x, y, color);
+
+			w0 += stepA;
+			w1 += stepB;
+			w2 += stepC;
+		}
+	}
+}
+
+// One pixel wide line, one pixel per column or row along the longer axis
+static void DrawLine(Framebuffer& framebuffer, const Rect& rect, Vertex a, Vertex b, const uint8_t* color)
+{
+	bool steep = std::abs(b.y - a.y) > std::abs(b.x - a.x);
+	Rect major = rect;
+	if (steep)
+	{
+		std::swap(a.x, a.y);
+		std::swap(b.x, b.y);
+		major = { rect.y0, rect.x0, rect.y1, rect.x1 };
+	}
+
+	if (a.x > b.x)
+		std::swap(a, b);
+
+	Rect pixels;
+	if (!Clip(a.x, std::min(a.y, b.y), b.x, std::max(a.y, b.y), major, pixels))
+		return;
+
+	// Pixel centers just past the ends would put the line outside its bounding box, and with that outside the tiles it was binned into
+	float slope = (b.x != a.x) ? (b.y - a.y) / (b.x - a.x) : 0.0f;
+	float minY = std::min(a.y, b.y), maxY = std::max(a.y, b.y);
+	for (int x = pixels.x0; x < pixels.x1; x++)
+	{
+		float y = std::clamp(a.y + (x + 0.5f - a.x) * slope, minY, maxY);
+		if (!(y >= major.y0 && y < major.y1))
+			continue;
+
+		if (steep)
+			Plot(framebuffer, (int)y, x, color);
+		else
+			Plot(framebuffer, x, (int)y, color);
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer(const MapArena& arena, ThreadPool& pool, int tileSize) :
+	arena(arena), pool(pool), tileSize(tileSize)
+{
+}
+
+void SoftwareRenderer::Render(Framebuffer& framebuffer, const Box& view, uint8_t r, uint8_t g, uint8_t b)
+{
+	if (framebuffer.width <= 0 || framebuffer.height <= 0)
+		return;
+
+	float scaleX = framebuffer.width / (view.maxX - view.minX);
+	float scaleY = framebuffer.height / (view.maxY - view.minY);
+	float offsetX = view.minX, offsetY = view.minY;
+	level = MapArena::LevelFor(std::min(scaleX, scaleY));
+
+	// Everything after this only looks at what's on screen
+	{
+		TraceZone zone("cull");
+		visible.clear();
+		arena.Visible(view, visible);
+		zone.Arg("visible", visible.size());
+	}
+
+	// Bring the vertices into pixels once instead of once per tile they show up in
+	const std::vector<Vertex>& vertices = arena.Vertices();
+	Span<const MapArena::Feature> features = arena.Features(level);
+	{
+		TraceZone zone("transform");
+		transformed.resize(vertices.size());
+		pool.ParallelFor((visible.size() + TRANSFORM_FEATURES - 1) / TRANSFORM_FEATURES, [&](size_t block) {
+			size_t end = std::min(visible.size(), (block + 1) * TRANSFORM_FEATURES);
+			for (size_t i = block * TRANSFORM_FEATURES; i < end; i++)
+			{
+				const MapArena::Feature& feature = features[visible[i]];
+				for (uint32_t j = feature.firstVertex; j < feature.firstVertex + feature.vertexCount; j++)
+					transformed[j] = { (vertices[j].x - offsetX) * scaleX, (vertices[j].y - offsetY) * scaleY };
+			}
+		});
+	}
+
+	// Visible features that follow each other in a range are binned together, up to a chunk's worth of primitives
+	Span<const MapArena::DrawRange> ranges = arena.Ranges(level);
+	chunkCount = 0;
+	for (uint32_t id : visible)
+	{
+		const MapArena::Feature& feature = features[id];
+		uint32_t step = (ranges[feature.range].primitive == MapArena::DrawRange::TRIANGLES ? 3 : 2) * CHUNK_PRIMITIVES;
+		for (uint32_t first = feature.first; first < feature.first + feature.count; )
+		{
+			Chunk* chunk = (chunkCount > 0) ? &chunks[chunkCount - 1] : nullptr;
+			if (!chunk || chunk->range != feature.range || chunk->end != first || chunk->end - chunk->first >= step)
+			{
+				if (chunkCount == chunks.size())
+					chunks.emplace_back();
+
+				chunk = &chunks[chunkCount++];
+				chunk->range = feature.range;
+				chunk->first = first;
+			}
+
+			chunk->end = std::min(feature.first + feature.count, chunk->first + step);
+			first = chunk->end;
+		}
+	}
+
+	int tilesX = (framebuffer.width + tileSize - 1) / tileSize;
+	int tilesY = (framebuffer.height + tileSize - 1) / tileSize;
+	{
+		TraceZone zone("bin");
+		zone.Arg("chunks", chunkCount);
+		pool.ParallelFor(chunkCount, [&](size_t i) {
+			Bin(chunks[i], tilesX, tilesY, framebuffer.width, framebuffer.height);
+		});
+	}
+
+	TraceZone rasterZone("raster");
+	uint8_t clear[4] = { r, g, b, 255 };
+	pool.ParallelFor(tilesX * tilesY, [&](size_t tile) {
+		int x0 = (tile % tilesX) * tileSize;
+		int y0 = (tile / tilesX) * tileSize;
+		int x1 = std::min(x0 + tileSize, framebuffer.width);
+		int y1 = std::min(y0 + tileSize, framebuffer.height);
+		for (int y = y0; y < y1; y++)
+		{
+			for (int x = x0; x < x1; x++)
+				Plot(framebuffer, x, y, clear);
+		}
+
+		RenderTile(framebuffer, tile, tilesX);
+	});
+}
+
+void SoftwareRenderer::Bin(Chunk& chunk, int tilesX, int tilesY, int width, int height)
+{
+	const MapArena::DrawRange& range = arena.Ranges(level)[chunk.range];
+	const std::vector<uint32_t>& indices = arena.Indices();
+	uint32_t corners = (range.primitive == MapArena::DrawRange::TRIANGLES) ? 3 : 2;
+	Rect screen = { 0, 0, width, height };
+
+	auto tilesOf = [&](uint32_t first, Rect& tiles) {
+		float minX = transformed[indices[first]].x, maxX = minX;
+		float minY = transformed[indices[first]].y, maxY = minY;
+		for (uint32_t i = 1; i < corners; i++)
+		{
+			const Vertex& vertex = transformed[indices[first + i]];
+			minX = std::min(minX, vertex.x);
+			maxX = std::max(maxX, vertex.x);
+			minY = std::min(minY, vertex.y);
+			maxY = std::max(maxY, vertex.y);
+		}
+
+		if (!Clip(minX, minY, maxX, maxY, screen, tiles))
+			return false;
+
+		tiles.x0 /= tileSize;
+		tiles.y0 /= tileSize;
+		tiles.x1 = (tiles.x1 - 1) / tileSize + 1;
+		tiles.y1 = (tiles.y1 - 1) / tileSize + 1;
+		return true;
+	};
+
+	// Counting sort by tile, primitives keep their order within every tile
+	chunk.tileStart.assign(tilesX * tilesY + 1, 0);
+	Rect tiles;
+	for (uint32_t first = chunk.first; first < chunk.end; first += corners)
+	{
+		if (!tilesOf(first, tiles))
+			continue;
+
+		for (int y = tiles.y0; y < tiles.y1; y++)
+		{
+			for (int x = tiles.x0; x < tiles.x1; x++)
+				chunk.tileStart[y * tilesX + x + 1]++;
+		}
+	}
+
+	for (size_t i = 1; i < chunk.tileStart.size(); i++)
+		chunk.tileStart[i] += chunk.tileStart[i - 1];
+
+	std::vector<uint32_t> cursor(chunk.tileStart.begin(), chunk.tileStart.end() - 1);
+	chunk.entries.resize(chunk.tileStart.back());
+	for (uint32_t first = chunk.first; first < chunk.end; first += corners)
+	{
+		if (!tilesOf(first, tiles))
+			continue;
+
+		for (int y = tiles.y0; y < tiles.y1; y++)
+		{
+			for (int x = tiles.x0; x < tiles.x1; x++)
+				chunk.entries[cursor[y * tilesX + x]++] = first;
+		}
+	}
+}
+
+void SoftwareRenderer::RenderTile(Framebuffer& framebuffer, int tile, int tilesX)
+{
+	int x0 = (tile % tilesX) * tileSize;
+	int y0 = (tile / tilesX) * tileSize;
+	Rect rect = { x0, y0, std::min(x0 + tileSize, framebuffer.width), std::min(y0 + tileSize, framebuffer.height) };
+
+	const std::vector<uint32_t>& indices = arena.Indices();
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const Chunk& chunk = chunks[i];
+		if (chunk.tileStart[tile] == chunk.tileStart[tile + 1])
+			continue;
+
+		const MapArena::DrawRange& range = arena.Ranges(level)[chunk.range];
+		uint8_t color[4] = { range.r, range.g, range.b, 255 };
+		for (uint32_t i = chunk.tileStart[tile]; i < chunk.tileStart[tile + 1]; i++)
+		{
+			const uint32_t* primitive = &indices[chunk.entries[i]];
+			if (range.primitive == MapArena::DrawRange::TRIANGLES)
+				FillTriangle(framebuffer, rect, transformed[primitive[0]], transformed[primitive[1]], transformed[primitive[2]], color);
+			else
+				DrawLine(framebuffer, rect, transformed[primitive[0]], transformed[primitive[1]], color);
+		}
+	}
+}
+
+void SoftwareRenderer::RenderFeatures(const MapArena& arena, Framebuffer& framebuffer, const Box& view, std::vector<uint32_t>& features, uint8_t r, uint8_t g, uint8_t b)
+{
+	uint8_t clear[4] = { r, g, b, 255 };
+	for (int y = 0; y < framebuffer.height; y++)
+	{
+		for (int x = 0; x < framebuffer.width; x++)
+			Plot(framebuffer, x, y, clear);
+	}
+
+	// Index queries come back in tree order, features further back in the arena are drawn later
+	std::sort(features.begin(), features.end());
+
+	float scaleX = framebuffer.width / (view.maxX - view.minX);
+	float scaleY = framebuffer.height / (view.maxY - view.minY);
+	float offsetX = view.minX, offsetY = view.minY;
+	int level = MapArena::LevelFor(std::min(scaleX, scaleY));
+	auto transform = [&](uint32_t index) {
+		const Vertex& vertex = arena.Vertices()[index];
+		return Vertex{ (vertex.x - offsetX) * scaleX, (vertex.y - offsetY) * scaleY };
+	};
+
+	Rect rect = { 0, 0, framebuffer.width, framebuffer.height };
+	const std::vector<uint32_t>& indices = arena.Indices();
+	for (uint32_t id : features)
+	{
+		const MapArena::Feature& feature = arena.Features(level)[id];
+		const MapArena::DrawRange& range = arena.Ranges(level)[feature.range];
+		uint8_t color[4] = { range.r, range.g, range.b, 255 };
+
+		if (range.primitive == MapArena::DrawRange::TRIANGLES)
+		{
+			for (uint32_t i = feature.first; i < feature.first + feature.count; i += 3)
+				FillTriangle(framebuffer, rect, transform(indices[i]), transform(indices[i + 1]), transform(indices[i + 2]), color);
+		}
+		else
+		{
+			for (uint32_t i = feature.first; i < feature.first + feature.count; i += 2)
+				DrawLine(framebuffer, rect, transform(indices[i]), transform(indices[i + 1]), color);
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MapArena.hpp"
+#include "SpatialIndex.hpp"
+#include "ThreadPool.hpp"
+
+struct Framebuffer
+{
+	int width, height;
+	std::vector<uint8_t> pixels;	// RGBA, rows top to bottom
+
+	Framebuffer(int width, int height) :
+		width(width), height(height), pixels((size_t)width * height * 4)
+	{
+	}
+
+	bool Save(const std::string& path) const;
+};
+
+// Rasterizes a MapArena on the CPU, no window or GL context needed.
+// The image is cut into square tiles that are rendered in parallel, every tile draws the primitives
+// overlapping it in the same order the GL renderer would draw them
+class SoftwareRenderer
+{
+public:
+	SoftwareRenderer(const MapArena& arena, ThreadPool& pool, int tileSize = 64);
+
+	// Renders the part of the map inside the view box, stretched over the whole framebuffer.
+	// Draws the detail level that fits the scale of the view, and only the features the view overlaps
+	void Render(Framebuffer& framebuffer, const Box& view, uint8_t r, uint8_t g, uint8_t b);
+
+	// Same as Render(), but only draws the given features and does it all on the calling thread.
+	// Meant for lots of small images rendered side by side, the features come from a query of the arena's index
+	static void RenderFeatures(const MapArena& arena, Framebuffer& framebuffer, const Box& view, std::vector<uint32_t>& features, uint8_t r, uint8_t g, uint8_t b);
+
+private:
+	// A run of primitives from one draw range, binned into tiles independently of all the other chunks.
+	// Chunks are cut from the visible features every frame, their buffers are kept around between frames
+	struct Chunk {
+		uint32_t range;
+		uint32_t first, end;				// Into the index buffer
+		std::vector<uint32_t> tileStart;	// Where the primitives of every tile start in entries
+		std::vector<uint32_t> entries;		// First index of every primitive, sorted by tile
+	};
+
+	void Bin(Chunk& chunk, int tilesX, int tilesY, int width, int height);
+	void RenderTile(Framebuffer& framebuffer, int tile, int tilesX);
+
+private:
+	const MapArena& arena;
+	ThreadPool& pool;
+	int tileSize;
+
+	// State of the current frame
+	int level = 0;
+	std::vector<uint32_t> visible;
+	std::vector<Chunk> chunks;
+	size_t chunkCount = 0;
+	std::vector<MapArena::Vertex> transformed;	// In pixels, only the vertices of visible features are filled in
+};
@@ -0,0 +1,113 @@
+#include "SpatialIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static Box Union(const Box& a, const Box& b)
+{
+	return { std::min(a.minX, b.minX), std::min(a.minY, b.minY), std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY) };
+}
+
+SpatialIndex::SpatialIndex(const std::vector<Box>& boxes, int nodeSize)
+{
+	Build(boxes, nodeSize);
+}
+
+void SpatialIndex::Build(const std::vector<Box>& boxes, int nodeSize)
+{
+	this->boxes = boxes;
+	numItems = boxes.size();
+	nodes.clear();
+	items.resize(numItems);
+	for (uint32_t i = 0; i < numItems; i++)
+		items[i] = i;
+
+	if (numItems == 0)
+	{
+		numLeaves = 0;
+		return;
+	}
+
+	// Sort-Tile-Recursive: cut the items into vertical slices by x, then sort every slice by y
+	auto centerX = [&boxes](uint32_t i) { return boxes[i].minX + boxes[i].maxX; };
+	auto centerY = [&boxes](uint32_t i) { return boxes[i].minY + boxes[i].maxY; };
+
+	size_t leafCount = (numItems + nodeSize - 1) / nodeSize;
+	size_t sliceCount = (size_t)std::ceil(std::sqrt((double)leafCount));
+	size_t sliceSize = nodeSize * ((leafCount + sliceCount - 1) / sliceCount);
+
+	std::sort(items.begin(), items.end(), [&centerX](uint32_t a, uint32_t b) { return centerX(a) < centerX(b); });
+	for (size_t begin = 0; begin < numItems; begin += sliceSize)
+	{
+		size_t end = std::min(numItems, begin + sliceSize);
+		std::sort(items.begin() + begin, items.begin() + end, [&centerY](uint32_t a, uint32_t b) { return centerY(a) < centerY(b); });
+	}
+
+	for (size_t begin = 0; begin < numItems; begin += nodeSize)
+	{
+		size_t end = std::min(numItems, begin + nodeSize);
+		Node leaf = { boxes[items[begin]], (uint32_t)begin, (uint32_t)(end - begin) };
+		for (size_t i = begin + 1; i < end; i++)
+			leaf.box = Union(leaf.box, boxes[items[i]]);
+
+		nodes.push_back(leaf);
+	}
+	numLeaves = nodes.size();
+
+	// Consecutive nodes are already close to each other, so upper levels just group them
+	size_t levelBegin = 0;
+	size_t levelEnd = nodes.size();
+	while (levelEnd - levelBegin > 1)
+	{
+		for (size_t begin = levelBegin; begin < levelEnd; begin += nodeSize)
+		{
+			size_t end = std::min(levelEnd, begin + nodeSize);
+			Node parent = { nodes[begin].box, (uint32_t)begin, (uint32_t)(end - begin) };
+			for (size_t i = begin + 1; i < end; i++)
+				parent.box = Union(parent.box, nodes[i].box);
+
+			nodes.push_back(parent);
+		}
+
+		levelBegin = levelEnd;
+		levelEnd = nodes.size();
+	}
+}
+
+void SpatialIndex::Query(const Box& box, std::vector<uint32_t>& result) const
+{
+	if (nodes.empty())
+		return;
+
+	std::vector<uint32_t> stack;
+	stack.reserve(64);
+	stack.push_back(nodes.size() - 1);
+	while (!stack.empty())
+	{
+		uint32_t index = stack.back();
+		stack.pop_back();
+
+		const Node& node = nodes[index];
+		if (!node.box.Intersects(box))
+			continue;
+
+		if (index < numLeaves)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				if (boxes[items[i]].Intersects(box))
+					result.push_back(items[i]);
+			}
+		}
+		else
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+				stack.push_back(i);
+		}
+	}
+}
+
+void SpatialIndex::Query(double x, double y, std::vector<uint32_t>& result) const
+{
+	Query(Box{ x, y, x, y }, result);
+}
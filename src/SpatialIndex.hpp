@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Box
+{
+	double minX, minY, maxX, maxY;
+
+	bool Contains(double x, double y) const { return (x >= minX && x <= maxX && y >= minY && y <= maxY); }
+	bool Contains(const Box& other) const { return (other.minX >= minX && other.maxX <= maxX && other.minY >= minY && other.maxY <= maxY); }
+	bool Intersects(const Box& other) const { return (other.minX <= maxX && other.maxX >= minX && other.minY <= maxY && other.maxY >= minY); }
+};
+
+// Static R-tree over a set of boxes, bulk loaded with Sort-Tile-Recursive packing.
+// Queries return the indices the boxes had when the index was built
+class SpatialIndex
+{
+public:
+	SpatialIndex() = default;
+	SpatialIndex(const std::vector<Box>& boxes, int nodeSize = 16);
+
+	void Build(const std::vector<Box>& boxes, int nodeSize = 16);
+
+	// Appends every item whose box intersects the query box
+	void Query(const Box& box, std::vector<uint32_t>& result) const;
+
+	// Appends every item whose box contains the point
+	void Query(double x, double y, std::vector<uint32_t>& result) const;
+
+	size_t Size() const { return numItems; }
+	size_t Bytes() const { return nodes.size() * sizeof(Node) + items.size() * sizeof(uint32_t) + boxes.size() * sizeof(Box); }
+
+private:
+	// Nodes are stored level by level, leaves first. Children of a node are consecutive
+	struct Node {
+		Box box;
+		uint32_t first, count;	// Children (inner nodes) or items (leaves)
+	};
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> items;
+	std::vector<Box> boxes;
+	size_t numItems = 0;
+	size_t numLeaves = 0;
+};
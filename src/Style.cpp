@@ -0,0 +1,256 @@
+#include "Style.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Same rules as res/style.txt, used when that file can't be loaded
+static const char* defaultStyle = R"(
+area building * 150 150 150
+
+line railway * 80 80 80
+line highway motorway 226 122 143
+line highway trunk 249 178 156
+line highway primary 252 206 144
+line highway secondary 244 251 173
+line highway tertiary 244 244 250
+line highway footway 233 140 124
+line highway * 15 15 20
+
+multipolygon indoor * 150 150 150 indoor
+multipolygon building * 150 150 150
+multipolygon building:colour * 150 150 150
+multipolygon building:material * 150 150 150
+multipolygon building:part * 150 150 150
+multipolygon natural wood 157 202 138
+multipolygon natural scrub 200 215 171
+multipolygon natural heath 214 217 159
+multipolygon natural water 166 198 198
+multipolygon natural grassland 205 235 176
+multipolygon natural floodplain 174 236 190
+multipolygon natural sand 234 222 189
+multipolygon natural scree 237 228 220
+multipolygon natural bare_rock 213 209 204
+multipolygon natural tree_row 169 206 161
+multipolygon water * 106 151 255
+multipolygon waterway * 106 151 255
+multipolygon landuse grass 207 237 165
+multipolygon landuse commercial 238 205 205
+multipolygon landuse residential 218 218 218
+multipolygon landuse forest 157 202 138
+multipolygon landuse basin 170 211 223
+multipolygon landuse allotments 201 225 191
+multipolygon landuse railway 230 209 227
+multipolygon landuse construction 199 199 180
+multipolygon landuse retail 254 202 197
+multipolygon landuse village_green 205 235 176
+multipolygon landuse meadow 205 236 176
+multipolygon landuse cemetery 170 203 175
+multipolygon landuse brownfield 167 168 126
+multipolygon landuse recreation_ground 223 252 226
+multipolygon leisure park 205 247 201
+multipolygon leisure garden 205 235 176
+multipolygon leisure pitch 170 224 203
+multipolygon leisure sports_centre 223 252 226
+multipolygon leisure track 170 224 203
+multipolygon leisure slipway 0 146 218
+multipolygon leisure playground 223 252 226
+multipolygon tourism zoo 147 84 115 outline
+multipolygon man_made bridge 184 184 184
+multipolygon man_made wastewater_plant 230 209 227
+multipolygon man_made pier 250 250 255
+multipolygon amenity parking 100 100 120
+multipolygon amenity bicycle_parking 100 100 120
+multipolygon amenity school 255 255 229
+multipolygon amenity university 255 255 229
+multipolygon amenity kindergarten 255 255 229
+multipolygon place * 180 180 180
+multipolygon public_transport platform 180 180 190
+multipolygon highway pedestrian 213 212 227
+multipolygon area:highway primary 255 255 229
+multipolygon area:highway secondary 244 251 173
+multipolygon area:highway footway 233 140 124
+multipolygon area:highway cycleway 233 140 124
+multipolygon area:highway footway;cycleway 233 140 124
+multipolygon area:highway emergency 250 250 255
+multipolygon area:highway unclassified 15 15 20
+multipolygon area:highway residential 15 15 20
+multipolygon area:highway service 15 15 20
+multipolygon area:highway traffic_island 15 15 20
+multipolygon area:highway bus 150 150 150
+multipolygon area:highway reserved 0 0 0 hidden
+multipolygon area:railway tram 150 150 150
+multipolygon bridge:support * 184 184 184
+multipolygon tunnel yes 240 240 255
+)";
+
+// 64 bit FNV-1a
+static uint64_t Hash(const std::string& data, uint64_t hash)
+{
+	for (char c : data)
+	{
+		hash ^= (uint8_t)c;
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+StyleTable::StyleTable() :
+	hash(0)
+{
+	Parse(defaultStyle, "default style");
+}
+
+bool StyleTable::Load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::stringstream text;
+	text << file.rdbuf();
+	return Parse(text.str(), path);
+}
+
+bool StyleTable::Parse(const std::string& text, const std::string& name)
+{
+	// Everything is compiled into new tables first, so an error leaves the current rules alone
+	std::unordered_map<std::string, uint32_t> keyIds;
+	std::unordered_map<std::string, uint32_t> valueIds = { { "*", 0 } };
+	std::unordered_map<uint64_t, Rule> rules;
+	std::unordered_map<uint64_t, uint32_t> priorities;	// Per class and key
+	std::vector<std::string> keys;
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	std::istringstream lines(text);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(lines, line))
+	{
+		lineNumber++;
+
+		std::istringstream fields(line);
+		std::string className, key, value;
+		int r, g, b;
+		if (!(fields >> className) || className[0] == '#')
+			continue;
+
+		if (!(fields >> key >> value >> r >> g >> b))
+		{
+			std::cerr << name << ":" << lineNumber << ": Expected class, key, value and a colour" << std::endl;
+			return false;
+		}
+
+		Class featureClass;
+		if (className == "area") featureClass = AREA;
+		else if (className == "line") featureClass = LINE;
+		else if (className == "multipolygon") featureClass = MULTIPOLYGON;
+		else
+		{
+			std::cerr << name << ":" << lineNumber << ": Unknown feature class " << className << std::endl;
+			return false;
+		}
+
+		if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255)
+		{
+			std::cerr << name << ":" << lineNumber << ": Colour out of range" << std::endl;
+			return false;
+		}
+
+		Rule rule = { 0, (uint8_t)r, (uint8_t)g, (uint8_t)b, -1, false };
+		std::string flag;
+		while (fields >> flag && flag[0] != '#')
+		{
+			if (flag == "outline") rule.rendering = Style::OUTLINE;
+			else if (flag == "indoor") rule.rendering = Style::INDOOR;
+			else if (flag == "hidden") rule.hidden = true;
+			else
+			{
+				std::cerr << name << ":" << lineNumber << ": Unknown flag " << flag << std::endl;
+				return false;
+			}
+		}
+
+		auto keyId = keyIds.emplace(key, (uint32_t)keyIds.size());
+		if (keyId.second)
+			keys.push_back(key);
+
+		auto valueId = valueIds.emplace(value, (uint32_t)valueIds.size());
+
+		// Only the first time a key shows up in a class decides its priority
+		auto priority = priorities.emplace(RuleKey(featureClass, keyId.first->second, 0), (uint32_t)priorities.size());
+		rule.priority = priority.first->second;
+
+		// The first rule for a key and value wins, later duplicates are never reached
+		rules.emplace(RuleKey(featureClass, keyId.first->second, valueId.first->second), rule);
+
+		std::ostringstream normalized;
+		normalized << featureClass << ' ' << key << ' ' << value << ' ' << r << ' ' << g << ' ' << b << ' ' << (int)rule.rendering << ' ' << rule.hidden << '\n';
+		hash = ::Hash(normalized.str(), hash);
+	}
+
+	this->keyIds = std::move(keyIds);
+	this->valueIds = std::move(valueIds);
+	this->rules = std::move(rules);
+	this->keys = std::move(keys);
+	this->hash = hash;
+	return true;
+}
+
+bool StyleTable::Resolve(Class featureClass, const Tags& tags, Style& style) const
+{
+	const Rule* colour = nullptr;
+	const Rule* rendering = nullptr;
+	bool hidden = false;
+
+	for (const Tag& tag : tags)
+	{
+		// An empty value is the same as not having the tag at all
+		if (tag.value.empty())
+			continue;
+
+		auto key = keyIds.find(tag.key);
+		if (key == keyIds.end())
+			continue;
+
+		// A rule for the exact value goes before the wildcard
+		auto rule = rules.end();
+		auto value = valueIds.find(tag.value);
+		if (value != valueIds.end())
+			rule = rules.find(RuleKey(featureClass, key->second, value->second));
+
+		if (rule == rules.end())
+			rule = rules.find(RuleKey(featureClass, key->second, 0));
+
+		if (rule == rules.end())
+			continue;
+
+		const Rule& match = rule->second;
+		if (!colour || match.priority > colour->priority)
+			colour = &match;
+
+		if (match.rendering != -1 && (!rendering || match.priority > rendering->priority))
+			rendering = &match;
+
+		hidden |= match.hidden;
+	}
+
+	if (!colour)
+		return false;
+
+	style.r = colour->r;
+	style.g = colour->g;
+	style.b = colour->b;
+	if (rendering)
+		style.rendering = (Style::Rendering)rendering->rendering;
+	if (hidden)
+		style.visible = false;
+
+	return true;
+}
+
+uint64_t StyleTable::RuleKey(Class featureClass, uint32_t key, uint32_t value)
+{
+	return ((uint64_t)featureClass << 62) | ((uint64_t)key << 32) | value;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "OsmData.hpp"
+
+// What a feature looks like after its tags went through a StyleTable
+struct Style
+{
+	enum Rendering {
+		FILL,
+		OUTLINE,
+		INDOOR
+	};
+
+	int r, g, b;
+	Rendering rendering;
+	bool visible;
+};
+
+// Style rules compiled into integer lookups. Keys and values are interned once when the rules are loaded,
+// resolving a feature costs a couple of hash lookups per tag and no string compares or allocations.
+// The rule format is described in res/style.txt, the same rules are built in as the default
+class StyleTable
+{
+public:
+	enum Class {
+		AREA,			// Closed ways
+		LINE,			// Open ways
+		MULTIPOLYGON,
+		CLASS_COUNT
+	};
+
+	StyleTable();
+
+	// Replaces the rules with the ones from the file. Keeps the current rules if the file can't be read or has errors
+	bool Load(const std::string& path);
+	bool Parse(const std::string& text, const std::string& name);
+
+	// Applies the rules matching the tags on top of the style. Returns false if none matched
+	bool Resolve(Class featureClass, const Tags& tags, Style& style) const;
+
+	// Every key any rule looks at
+	const std::vector<std::string>& Keys() const { return keys; }
+
+	// Changes whenever the rules change
+	uint64_t Hash() const { return hash; }
+
+private:
+	struct Rule {
+		uint32_t priority;	// Rules of keys further down in the file win
+		uint8_t r, g, b;
+		int8_t rendering;	// -1 if the rule doesn't change it
+		bool hidden;
+	};
+
+	// Class, key id and value id packed into one integer
+	static uint64_t RuleKey(Class featureClass, uint32_t key, uint32_t value);
+
+	std::unordered_map<std::string, uint32_t> keyIds;
+	std::unordered_map<std::string, uint32_t> valueIds;	// The wildcard * is always 0
+	std::unordered_map<uint64_t, Rule> rules;
+	std::vector<std::string> keys;
+	uint64_t hash;
+};
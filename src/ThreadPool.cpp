@@ -0,0 +1,175 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+
+#include "Trace.hpp"
+
+// Lets tasks that submit more tasks push them onto their own worker's queue
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local unsigned int currentWorker = 0;
+
+ThreadPool::ThreadPool(unsigned int threads) :
+	nextQueue(0), queued(0), stop(false)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < threads; i++)
+		queues.push_back(std::make_unique<Queue>());
+
+	for (unsigned int i = 0; i < threads; i++)
+		workers.emplace_back(&ThreadPool::Work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	Wait(tasks);
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::Submit(Task task)
+{
+	Submit(std::move(task), tasks);
+}
+
+void ThreadPool::Submit(Task task, Group& group)
+{
+	unsigned int index = (currentPool == this) ? currentWorker : (nextQueue++ % queues.size());
+
+	group.pending++;
+	queued++;
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->jobs.push_back({ std::move(task), &group });
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+	done.notify_all();
+}
+
+void ThreadPool::Wait(Group& group)
+{
+	// Blocking a worker could deadlock the pool once all of them wait, so the waiting thread runs tasks instead.
+	// Whatever it picks up may belong to somebody else, but it only waits for as long as its own group isn't done
+	unsigned int index = (currentPool == this) ? currentWorker : queues.size();
+	while (group.pending > 0)
+	{
+		if (TryRun(index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		done.wait(lock, [this, &group]() { return (group.pending == 0 || queued > 0); });
+	}
+
+	std::exception_ptr rethrow;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		std::swap(rethrow, group.error);
+	}
+	if (rethrow)
+		std::rethrow_exception(rethrow);
+}
+
+void ThreadPool::Wait()
+{
+	assert(currentPool != this && "A task can't wait for the tasks without a group, it is one of them");
+	Wait(tasks);
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+	// A few tasks per worker keep the overhead low, stealing takes care of the imbalance
+	Group group;
+	size_t chunk = std::max((size_t)1, count / (queues.size() * 16));
+	for (size_t begin = 0; begin < count; begin += chunk)
+	{
+		size_t end = std::min(count, begin + chunk);
+		Submit([&func, begin, end]() {
+			for (size_t i = begin; i < end; i++)
+				func(i);
+		}, group);
+	}
+
+	Wait(group);
+}
+
+void ThreadPool::Work(unsigned int index)
+{
+	currentPool = this;
+	currentWorker = index;
+	Trace::SetThreadName("Worker " + std::to_string(index));
+
+	while (true)
+	{
+		if (TryRun(index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this]() { return (stop || queued > 0); });
+		if (stop && queued == 0)
+			return;
+	}
+}
+
+// Runs the next task of its own queue, or steals one from another queue. An index past the last queue only steals
+bool ThreadPool::TryRun(unsigned int index)
+{
+	Job job = { nullptr, nullptr };
+	for (unsigned int i = 0; i < queues.size() && !job.task; i++)
+	{
+		unsigned int victim = (index + i) % queues.size();
+		std::lock_guard<std::mutex> lock(queues[victim]->mutex);
+		if (queues[victim]->jobs.empty())
+			continue;
+
+		if (victim == index)
+		{
+			job = std::move(queues[victim]->jobs.front());
+			queues[victim]->jobs.pop_front();
+		}
+		else
+		{
+			job = std::move(queues[victim]->jobs.back());
+			queues[victim]->jobs.pop_back();
+		}
+	}
+
+	if (!job.task)
+		return false;
+
+	queued--;
+	try
+	{
+		job.task();
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		if (!job.group->error)
+			job.group->error = std::current_exception();
+	}
+
+	// The group may be gone as soon as its waiter sees it done, so nothing touches it afterwards
+	Group* group = job.group;
+	job.task = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		if (--group->pending == 0)
+			done.notify_all();
+	}
+
+	return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing thread pool. Every worker has its own task queue and works through it front to back,
+// idle workers steal from the back of the others. That way a couple of huge tasks don't hold up
+// all the small ones queued behind them
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	// Tasks that are waited for together. Waiting for a group doesn't wait for anybody else's tasks, so several threads
+	// can each wait for their own group at once, and tasks can wait for groups of their own. Has to outlive its tasks
+	class Group
+	{
+	public:
+		Group() = default;
+		Group(const Group&) = delete;
+		Group& operator=(const Group&) = delete;
+
+	private:
+		friend class ThreadPool;
+		std::atomic<size_t> pending{ 0 };	// Submitted but not finished yet
+		std::exception_ptr error;
+	};
+
+	// Defaults to one worker per hardware thread
+	ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Without a group the task goes to the pool's own group, which only Wait() without a group waits for
+	void Submit(Task task);
+	void Submit(Task task, Group& group);
+
+	// Blocks until every task of the group has finished. The calling thread helps out in the meantime.
+	// Rethrows the first exception thrown by any of them
+	void Wait(Group& group);
+
+	// The same for the tasks submitted without a group. Not from inside a task, that task would wait for itself
+	void Wait();
+
+	// Runs func(i) for every i in [0, count) and waits for all of them, from any thread and from inside tasks
+	void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+	unsigned int Size() const { return workers.size(); }
+
+private:
+	struct Job {
+		Task task;
+		Group* group;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	void Work(unsigned int index);
+	bool TryRun(unsigned int index);
+
+private:
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::atomic<unsigned int> nextQueue;
+
+	Group tasks;	// Submitted without a group
+	std::atomic<size_t> queued;		// Submitted but not started yet
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stop;
+};
@@ -0,0 +1,106 @@
+#include "TileGenerator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "SoftwareRenderer.hpp"
+#include "Trace.hpp"
+
+namespace fs = std::filesystem;
+
+#define PI 3.14159265358979323846
+
+struct Tile {
+	int z, x, y;
+};
+
+static int TileX(double lon, int zoom)
+{
+	int tiles = 1 << zoom;
+	return std::min(tiles - 1, std::max(0, (int)std::floor((lon + 180.0) / 360.0 * tiles)));
+}
+
+static int TileY(double lat, int zoom)
+{
+	int tiles = 1 << zoom;
+	double radians = lat * PI / 180.0;
+	double y = (1.0 - std::log(std::tan(radians) + 1.0 / std::cos(radians)) / PI) / 2.0 * tiles;
+	return std::min(tiles - 1, std::max(0, (int)std::floor(y)));
+}
+
+static double TileLon(int x, int zoom)
+{
+	return x / (double)(1 << zoom) * 360.0 - 180.0;
+}
+
+static double TileLat(int y, int zoom)
+{
+	return std::atan(std::sinh(PI * (1.0 - 2.0 * y / (double)(1 << zoom)))) * 180.0 / PI;
+}
+
+bool GenerateTiles(const MapArena& arena, const World& world, const osmp::Bounds& bounds,
+	const std::string& directory, int minZoom, int maxZoom, ThreadPool& pool, TileStats& stats)
+{
+	if (minZoom < 0 || maxZoom > 24 || minZoom > maxZoom)
+	{
+		std::cerr << "Zoom levels have to be between 0 and 24" << std::endl;
+		return false;
+	}
+
+	// Every tile overlapping the map, the directories are created up front so the workers don't race for them
+	std::vector<Tile> tiles;
+	for (int z = minZoom; z <= maxZoom; z++)
+	{
+		int x0 = TileX(bounds.minlon, z), x1 = TileX(bounds.maxlon, z);
+		int y0 = TileY(bounds.maxlat, z), y1 = TileY(bounds.minlat, z);
+		for (int x = x0; x <= x1; x++)
+		{
+			std::error_code error;
+			fs::path path = fs::path(directory) / std::to_string(z) / std::to_string(x);
+			fs::create_directories(path, error);
+			if (error)
+			{
+				std::cerr << "Failed to create " << path.string() << ": " << error.message() << std::endl;
+				return false;
+			}
+
+			for (int y = y0; y <= y1; y++)
+				tiles.push_back({ z, x, y });
+		}
+	}
+
+	std::atomic<size_t> features(0);
+	std::atomic<bool> failed(false);
+	auto start = std::chrono::steady_clock::now();
+	pool.ParallelFor(tiles.size(), [&](size_t i) {
+		const Tile& tile = tiles[i];
+		TraceZone zone("tile");
+		zone.Arg("zoom", tile.z);
+
+		Vector2d topLeft = world.ToWorld(TileLon(tile.x, tile.z), TileLat(tile.y, tile.z));
+		Vector2d bottomRight = world.ToWorld(TileLon(tile.x + 1, tile.z), TileLat(tile.y + 1, tile.z));
+		Box view = { topLeft.x, topLeft.y, bottomRight.x, bottomRight.y };
+
+		std::vector<uint32_t> visible;
+		arena.Index().Query(view, visible);
+		features += visible.size();
+		zone.Arg("features", visible.size());
+
+		Framebuffer framebuffer(TILE_SIZE, TILE_SIZE);
+		SoftwareRenderer::RenderFeatures(arena, framebuffer, view, visible, 51, 0, 51);
+
+		fs::path path = fs::path(directory) / std::to_string(tile.z) / std::to_string(tile.x) / (std::to_string(tile.y) + ".png");
+		if (!framebuffer.Save(path.string()))
+			failed = true;
+	});
+
+	stats.tiles = tiles.size();
+	stats.features = features;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return !failed;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <osmp.hpp>
+#include "MapArena.hpp"
+#include "ThreadPool.hpp"
+#include "Projection.hpp"
+
+#define TILE_SIZE 256
+
+struct TileStats
+{
+	size_t tiles;
+	size_t features;	// Summed up over all tiles
+	double seconds;
+};
+
+// Renders every slippy map tile between the zoom levels that overlaps the map bounds and writes them to
+// directory/z/x/y.png. Tiles are rendered side by side on the pool, each one only looks at the features its
+// query of the arena's index returns. Tiles line up exactly when the viewer is built with WebMercator, with any
+// other projection the tile corners are projected and the latitude in between is stretched linearly
+bool GenerateTiles(const MapArena& arena, const World& world, const osmp::Bounds& bounds,
+	const std::string& directory, int minZoom, int maxZoom, ThreadPool& pool, TileStats& stats);
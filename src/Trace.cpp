@@ -0,0 +1,131 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::enabled(false);
+
+namespace
+{
+	struct ThreadBuffer {
+		uint32_t thread;
+		std::string name;
+		std::vector<Trace::Event> events;
+	};
+
+	// Buffers outlive their threads, so pool workers that are gone by the time the trace is written still show up
+	std::mutex buffersMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	uint64_t startTime = 0;
+
+	ThreadBuffer& ThisThread()
+	{
+		static thread_local ThreadBuffer* buffer = nullptr;
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock(buffersMutex);
+			buffers.push_back(std::make_unique<ThreadBuffer>());
+			buffer = buffers.back().get();
+			buffer->thread = (uint32_t)buffers.size();
+		}
+
+		return *buffer;
+	}
+
+	// Names are string literals or thread names, only quotes and backslashes need care
+	void WriteString(std::ofstream& file, const char* text)
+	{
+		file << '"';
+		for (const char* c = text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				file << '\\';
+			file << *c;
+		}
+		file << '"';
+	}
+}
+
+void Trace::Start()
+{
+	startTime = Now();
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+void Trace::Counter(const char* name, int64_t value)
+{
+	if (!Enabled())
+		return;
+
+	uint64_t now = Now();
+	Event event = { name, now, now, { nullptr, nullptr }, { value, 0 }, true };
+	Record(event);
+}
+
+void Trace::SetThreadName(const std::string& name)
+{
+	ThisThread().name = name;
+}
+
+void Trace::Record(const Event& event)
+{
+	ThisThread().events.push_back(event);
+}
+
+bool Trace::Write(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	// Timestamps are in microseconds, the fraction keeps the nanoseconds
+	auto time = [](uint64_t ns) { return (ns - std::min(ns, startTime)) / 1000.0; };
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (const std::unique_ptr<ThreadBuffer>& buffer : buffers)
+	{
+		if (!buffer->name.empty())
+		{
+			file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->thread << ",\"args\":{\"name\":";
+			WriteString(file, buffer->name.c_str());
+			file << "}}";
+			first = false;
+		}
+
+		for (const Event& event : buffer->events)
+		{
+			file << (first ? "" : ",\n") << "{\"ph\":\"" << (event.counter ? "C" : "X") << "\",\"name\":";
+			WriteString(file, event.name);
+			file << ",\"pid\":1,\"tid\":" << buffer->thread << ",\"ts\":" << time(event.start);
+			if (event.counter)
+				file << ",\"args\":{\"value\":" << event.args[0] << "}}";
+			else
+			{
+				file << ",\"dur\":" << (event.end - event.start) / 1000.0;
+				if (event.argNames[0])
+				{
+					file << ",\"args\":{";
+					for (int i = 0; i < 2 && event.argNames[i]; i++)
+					{
+						file << (i > 0 ? "," : "");
+						WriteString(file, event.argNames[i]);
+						file << ":" << event.args[i];
+					}
+					file << "}";
+				}
+				file << "}";
+			}
+			first = false;
+		}
+	}
+	file << "\n]}\n";
+
+	return (bool)file;
+}
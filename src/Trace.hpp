@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Timeline of what every thread was doing, written out in the Chrome trace format so it can be opened in
+// chrome://tracing or ui.perfetto.dev. Nothing is recorded until Start() is called, until then a zone costs
+// one relaxed load. Every thread records into a buffer of its own, no locks are taken while recording
+class Trace
+{
+public:
+	// What a zone or counter leaves behind in the thread's buffer
+	struct Event {
+		const char* name;
+		uint64_t start, end;
+		const char* argNames[2];
+		int64_t args[2];
+		bool counter;
+	};
+
+	static void Start();
+	static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+	static uint64_t Now() { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+	// Shows up as a graph of the value over time
+	static void Counter(const char* name, int64_t value);
+
+	// Name of the calling thread's row in the trace
+	static void SetThreadName(const std::string& name);
+
+	// Everything recorded so far. Threads must not be recording while this runs
+	static bool Write(const std::string& path);
+
+private:
+	friend class TraceZone;
+
+	static void Record(const Event& event);
+
+	static std::atomic<bool> enabled;
+};
+
+// Scoped zone, from construction to destruction. Names and argument names have to be string literals,
+// only the pointers are stored
+class TraceZone
+{
+public:
+	TraceZone(const char* name) :
+		event{ name, Trace::Enabled() ? Trace::Now() : 0, 0, { nullptr, nullptr }, { 0, 0 }, false }
+	{
+	}
+
+	~TraceZone()
+	{
+		if (event.start != 0)
+		{
+			event.end = Trace::Now();
+			Trace::Record(event);
+		}
+	}
+
+	TraceZone(const TraceZone&) = delete;
+	TraceZone& operator=(const TraceZone&) = delete;
+
+	// Attaches a number to the zone, like the id of the relation it worked on. Up to two per zone
+	void Arg(const char* name, int64_t value)
+	{
+		int slot = (event.argNames[0] == nullptr) ? 0 : 1;
+		event.argNames[slot] = name;
+		event.args[slot] = value;
+	}
+
+private:
+	Trace::Event event;
+};
@@ -0,0 +1,351 @@
+#include "TriangulationCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "Projection.hpp"
+#include "Trace.hpp"
+
+#define TRIANGULATION_CACHE_MAGIC "MVTRIS"
+#define TRIANGULATION_CACHE_VERSION 1
+
+namespace fs = std::filesystem;
+
+struct Section {
+	uint64_t offset;
+	uint64_t count;
+};
+
+struct Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t projection;	// World::Projection::Id the points are in
+	uint32_t padding;
+	uint64_t generation;	// Counts the runs that saved the cache
+
+	Section entries;		// EntryRecord, sorted by key
+	Section data;			// Bytes of the serialized groups, every entry 8 byte aligned
+};
+
+struct EntryRecord {
+	uint64_t key;
+	uint64_t lastUsed;
+	uint64_t offset;		// Into the data section
+	uint64_t size;
+};
+
+// Every group is its counts followed by the lists, points first so they stay 8 byte aligned
+struct GroupRecord {
+	uint32_t points;
+	uint32_t triangles;
+	uint32_t segments;
+	uint32_t rings;
+
+	size_t Bytes() const { return sizeof(GroupRecord) + (size_t)points * sizeof(Vector2d) + ((size_t)triangles + segments + rings) * sizeof(int32_t); }
+};
+
+static size_t Align(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+// The blob has been checked when the file was loaded, or was written by Insert
+static const uint8_t* Read(const uint8_t* data, std::vector<int>& out, uint32_t count)
+{
+	out.resize(count);
+	memcpy(out.data(), data, count * sizeof(int32_t));
+	return data + count * sizeof(int32_t);
+}
+
+// Entries whose groups don't add up to exactly their size can't be trusted
+static bool CheckEntry(const uint8_t* data, size_t size)
+{
+	size_t position = 0;
+	while (position < size)
+	{
+		GroupRecord group;
+		if (size - position < sizeof(GroupRecord))
+			return false;
+
+		memcpy(&group, data + position, sizeof(GroupRecord));
+		if (group.Bytes() > size - position)
+			return false;
+
+		position += Align(group.Bytes());
+	}
+
+	return (position == size);
+}
+
+TriangulationCache::TriangulationCache(size_t maxBytes) :
+	maxBytes(maxBytes), generation(1), bytes(0), hits(0), misses(0)
+{
+}
+
+uint64_t TriangulationCache::Key(const std::vector<RelationMember>& members)
+{
+	// A word at a time instead of FNV's byte at a time, relations can have hundreds of thousands of nodes.
+	// Mixed well enough that a collision between 64 bit keys practically never happens
+	uint64_t hash = 0xcbf29ce484222325ull;
+	auto mix = [&hash](uint64_t value) {
+		hash = (hash ^ value) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 29;
+	};
+
+	auto bits = [](double value) {
+		uint64_t result;
+		memcpy(&result, &value, sizeof(result));
+		return result;
+	};
+
+	mix(World::Projection::Id);
+	mix(members.size());
+	for (const RelationMember& member : members)
+	{
+		mix(member.inner);
+		mix(member.nodes->size());
+		for (const NodeCoord& node : *member.nodes)
+		{
+			mix(node.id);
+			mix(bits(node.lon));
+			mix(bits(node.lat));
+		}
+	}
+
+	return hash;
+}
+
+bool TriangulationCache::Load(const std::string& path)
+{
+	TraceZone zone("load triangulation cache");
+
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+	added.clear();
+	bytes = 0;
+	generation = 1;
+
+	if (!file.Open(path))
+		return false;
+
+	const Header* header = (const Header*)file.Data();
+	if (file.Size() < sizeof(Header) ||
+		memcmp(header->magic, TRIANGULATION_CACHE_MAGIC, sizeof(TRIANGULATION_CACHE_MAGIC)) != 0 ||
+		header->version != TRIANGULATION_CACHE_VERSION ||
+		header->headerSize != sizeof(Header) ||
+		header->projection != World::Projection::Id)
+	{
+		file.Close();
+		return false;
+	}
+
+	size_t size = file.Size();
+	if (header->entries.offset % 8 != 0 || header->entries.offset > size || header->entries.count > (size - header->entries.offset) / sizeof(EntryRecord) ||
+		header->data.offset % 8 != 0 || header->data.offset > size || header->data.count > size - header->data.offset)
+	{
+		std::cerr << "Triangulation cache " << path << " is corrupted" << std::endl;
+		file.Close();
+		return false;
+	}
+
+	generation = header->generation + 1;
+
+	const EntryRecord* records = (const EntryRecord*)(file.Data() + header->entries.offset);
+	const uint8_t* data = file.Data() + header->data.offset;
+	entries.reserve(header->entries.count);
+	for (uint64_t i = 0; i < header->entries.count; i++)
+	{
+		// Broken entries are skipped, the relations are just triangulated again
+		const EntryRecord& record = records[i];
+		if (record.offset % 8 != 0 || record.offset > header->data.count || record.size > header->data.count - record.offset ||
+			!CheckEntry(data + record.offset, record.size))
+		{
+			continue;
+		}
+
+		entries[record.key] = { data + record.offset, (size_t)record.size, record.lastUsed };
+		bytes += record.size;
+	}
+
+	return true;
+}
+
+bool TriangulationCache::Save(const std::string& path)
+{
+	TraceZone zone("save triangulation cache");
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Most recently used first, whatever doesn't fit anymore is dropped. Ties are broken by key so the same entries
+	// are kept no matter how the hash map is ordered
+	std::vector<std::pair<uint64_t, const Entry*>> order;
+	order.reserve(entries.size());
+	for (const auto& entry : entries)
+		order.push_back({ entry.first, &entry.second });
+
+	std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) {
+		return (a.second->lastUsed != b.second->lastUsed) ? (a.second->lastUsed > b.second->lastUsed) : (a.first < b.first);
+	});
+
+	size_t kept = 0, keptBytes = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		size_t size = Align(order[i].second->size);
+		if (keptBytes + size > maxBytes)
+			continue;
+
+		keptBytes += size;
+		order[kept++] = order[i];
+	}
+	order.resize(kept);
+
+	std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return (a.first < b.first); });
+
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	memcpy(header.magic, TRIANGULATION_CACHE_MAGIC, sizeof(TRIANGULATION_CACHE_MAGIC));
+	header.version = TRIANGULATION_CACHE_VERSION;
+	header.headerSize = sizeof(Header);
+	header.projection = World::Projection::Id;
+	header.generation = generation;
+	header.entries = { Align(sizeof(Header)), order.size() };
+	header.data = { Align(header.entries.offset + order.size() * sizeof(EntryRecord)), keptBytes };
+
+	// The entries still point into the mapped file, so everything is copied out before the file is replaced
+	std::vector<uint8_t> buffer(header.data.offset + header.data.count, 0);
+	memcpy(buffer.data(), &header, sizeof(Header));
+	EntryRecord* records = (EntryRecord*)(buffer.data() + header.entries.offset);
+	uint64_t offset = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Entry& entry = *order[i].second;
+		records[i] = { order[i].first, entry.lastUsed, offset, entry.size };
+		if (entry.size > 0)
+			memcpy(buffer.data() + header.data.offset + offset, entry.data, entry.size);
+		offset += Align(entry.size);
+	}
+
+	entries.clear();
+	added.clear();
+	bytes = 0;
+	file.Close();
+
+	// Write to a temporary file first so a crash never leaves a half written cache behind
+	std::string temporary = path + ".tmp";
+	FILE* out = fopen(temporary.c_str(), "wb");
+	if (!out)
+	{
+		std::cerr << "Failed to create triangulation cache " << temporary << std::endl;
+		return false;
+	}
+
+	bool success = (fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size());
+	success &= (fclose(out) == 0);
+
+	std::error_code error;
+	if (success)
+		fs::rename(temporary, path, error);
+
+	if (!success || error)
+	{
+		std::cerr << "Failed to write triangulation cache " << path << std::endl;
+		fs::remove(temporary, error);
+		return false;
+	}
+
+	return true;
+}
+
+bool TriangulationCache::Find(uint64_t key, std::vector<Group>& groups)
+{
+	Entry entry;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = entries.find(key);
+		if (it == entries.end())
+		{
+			misses++;
+			return false;
+		}
+
+		it->second.lastUsed = generation;
+		entry = it->second;
+	}
+
+	// Entry data never moves or changes, it can be read without the lock
+	if (!Decode(entry.data, entry.size, groups))
+	{
+		misses++;
+		return false;
+	}
+
+	hits++;
+	Trace::Counter("triangulation cache hits", hits);
+	return true;
+}
+
+void TriangulationCache::Insert(uint64_t key, const std::vector<Group>& groups)
+{
+	std::vector<uint8_t> data;
+	for (const Group& group : groups)
+	{
+		GroupRecord record = { (uint32_t)group.points.size(), (uint32_t)group.triangles.size(), (uint32_t)group.segments.size(), (uint32_t)group.rings.size() };
+		size_t position = data.size();
+		data.resize(Align(position + record.Bytes()));
+
+		uint8_t* out = data.data() + position;
+		memcpy(out, &record, sizeof(GroupRecord));
+		out += sizeof(GroupRecord);
+		memcpy(out, group.points.data(), group.points.size() * sizeof(Vector2d));
+		out += group.points.size() * sizeof(Vector2d);
+		for (const std::vector<int>* list : { &group.triangles, &group.segments, &group.rings })
+		{
+			memcpy(out, list->data(), list->size() * sizeof(int32_t));
+			out += list->size() * sizeof(int32_t);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (entries.count(key))
+		return;
+
+	added.push_back(std::move(data));
+	entries[key] = { added.back().data(), added.back().size(), generation };
+	bytes += added.back().size();
+}
+
+// Also makes sure every index points at something, a damaged file must not crash the renderer later on
+bool TriangulationCache::Decode(const uint8_t* data, size_t size, std::vector<Group>& groups)
+{
+	groups.clear();
+	size_t position = 0;
+	while (position < size)
+	{
+		GroupRecord record;
+		memcpy(&record, data + position, sizeof(GroupRecord));
+
+		const uint8_t* in = data + position + sizeof(GroupRecord);
+		groups.emplace_back();
+		Group& group = groups.back();
+		group.points.resize(record.points);
+		memcpy(group.points.data(), in, record.points * sizeof(Vector2d));
+		in += record.points * sizeof(Vector2d);
+		in = Read(in, group.triangles, record.triangles);
+		in = Read(in, group.segments, record.segments);
+		Read(in, group.rings, record.rings);
+
+		auto inside = [](const std::vector<int>& indices, size_t count) {
+			return std::all_of(indices.begin(), indices.end(), [count](int index) { return (index >= 0 && (size_t)index < count); });
+		};
+
+		if (!inside(group.triangles, group.points.size()) || !inside(group.segments, group.points.size()) || !inside(group.rings, group.segments.size()))
+			return false;
+
+		position += Align(record.Bytes());
+	}
+
+	return true;
+}
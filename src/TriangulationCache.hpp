@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "OsmData.hpp"
+#include "vector2.hpp"
+
+#define TRIANGULATION_CACHE_SIZE (256ull * 1024 * 1024)
+
+// Triangulated multipolygons of earlier runs, shared by every map that is loaded. Entries are looked up by a hash of
+// the relation's member ways, so relations that didn't change skip ring assembly and triangulation no matter which
+// extract they come from. Points are stored in projected coordinates for the same reason, they don't depend on the
+// map bounds. The file is memory mapped, entries are only copied out when they're used
+class TriangulationCache
+{
+public:
+	// One triangulated ring group, the same lists the multipolygon stores
+	struct Group {
+		std::vector<Vector2d> points;	// Projected, see World::FromProjected
+		std::vector<int> triangles, segments, rings;
+	};
+
+	TriangulationCache(size_t maxBytes = TRIANGULATION_CACHE_SIZE);
+
+	TriangulationCache(const TriangulationCache&) = delete;
+	TriangulationCache& operator=(const TriangulationCache&) = delete;
+
+	// Changes whenever the ways, their nodes or their roles change
+	static uint64_t Key(const std::vector<RelationMember>& members);
+
+	// A missing or outdated file just leaves the cache empty
+	bool Load(const std::string& path);
+
+	// Keeps as many of the most recently used entries as fit into the size limit. Leaves the cache empty,
+	// the file it was loaded from is gone
+	bool Save(const std::string& path);
+
+	// Both can be called from several threads at once
+	bool Find(uint64_t key, std::vector<Group>& groups);
+	void Insert(uint64_t key, const std::vector<Group>& groups);
+
+	size_t Hits() const { return hits; }
+	size_t Misses() const { return misses; }
+	size_t Entries() const { return entries.size(); }
+	size_t Bytes() const { return bytes; }
+
+private:
+	// Serialized groups, either in the mapped file or in added
+	struct Entry {
+		const uint8_t* data;
+		size_t size;
+		uint64_t lastUsed;	// Generation of the last run that used it
+	};
+
+	static bool Decode(const uint8_t* data, size_t size, std::vector<Group>& groups);
+
+	size_t maxBytes;
+	MappedFile file;
+	uint64_t generation;
+
+	std::mutex mutex;
+	std::unordered_map<uint64_t, Entry> entries;
+	std::deque<std::vector<uint8_t>> added;
+	size_t bytes;
+
+	std::atomic<size_t> hits, misses;
+};
@@ -26,6 +26,14 @@ Window::Window(const Vector2i& size, const std::string& title)
 		throw std::runtime_error("Failed to load GL loader");
 
 	glViewport(0, 0, size.x, size.y);
+
+	glfwSetWindowUserPointer(handle, this);
+	glfwSetScrollCallback(handle, [](GLFWwindow* handle, double x, double y) {
+		((Window*)glfwGetWindowUserPointer(handle))->scroll += y;
+	});
+	glfwSetFramebufferSizeCallback(handle, [](GLFWwindow* handle, int width, int height) {
+		glViewport(0, 0, width, height);
+	});
 }
 
 Window::~Window()
@@ -54,3 +62,29 @@ void Window::SwapBuffers()
 {
 	glfwSwapBuffers(handle);
 }
+
+Vector2i Window::Size() const
+{
+	Vector2i size;
+	glfwGetWindowSize(handle, &size.x, &size.y);
+	return size;
+}
+
+Vector2d Window::CursorPosition() const
+{
+	Vector2d position;
+	glfwGetCursorPos(handle, &position.x, &position.y);
+	return position;
+}
+
+bool Window::MouseDown() const
+{
+	return (glfwGetMouseButton(handle, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS);
+}
+
+double Window::TakeScroll()
+{
+	double scrolled = scroll;
+	scroll = 0.0;
+	return scrolled;
+}
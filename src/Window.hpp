@@ -21,6 +21,13 @@ public:
 	void Clear(float r, float g, float b, float a);
 	void SwapBuffers();
 
+	// Input, positions are in screen coordinates with the origin in the top left corner
+	Vector2i Size() const;
+	Vector2d CursorPosition() const;
+	bool MouseDown() const;		// Left button
+	double TakeScroll();		// Scrolled since the last call, positive is away from the user
+
 private:
 	GLFWwindow* handle;
+	double scroll = 0.0;
 };
\ No newline at end of file
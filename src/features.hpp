@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "Geometry.hpp"
+
+// The points of areas and highways live in a GeometryStore or a mapped cache file
+typedef struct sArea
+{
+	uint8_t  r = 0;
+	uint8_t  g = 0;
+	uint8_t  b = 10;
+	PackedPoints points;
+} Area;
+
+typedef struct sHighway
+{
+	uint8_t r, g, b;
+	PackedPoints points;
+} Highway;
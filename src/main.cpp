@@ -2,165 +2,565 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
 
 #include <osmp.hpp>
 #include "multipolygon.hpp"
+#include "features.hpp"
+#include "MapCache.hpp"
+#include "MapLoader.hpp"
+#include "BackgroundLoader.hpp"
+#include "MapUpdater.hpp"
+#include "OsmPbf.hpp"
+#include "Style.hpp"
+#include "MapArena.hpp"
+#include "MapRenderer.hpp"
+#include "RegionStore.hpp"
+#include "SoftwareRenderer.hpp"
+#include "TileGenerator.hpp"
+#include "Projection.hpp"
+#include "Camera.hpp"
 #include "Window.hpp"
+#include "Trace.hpp"
+#include "TriangulationCache.hpp"
 
-// Map values from one interval [A, B] to another [a, b]
-inline float Map(float A, float B, float a, float b, float x);
+#define TRIANGULATION_CACHE_PATH "triangulations.cache"
 
-typedef struct sArea
-{
-	size_t   length;
-	uint8_t  r = 0;
-	uint8_t  g = 0;
-	uint8_t  b = 10;
-	int16_t* x;
-	int16_t* y;
-} Area;
-
-typedef struct sHighway
+#define ZOOM_STEP 1.2
+#define UPDATE_POLL_SECONDS 1.0
+#define REGION_BUDGET_MB 1024
+
+namespace fs = std::filesystem;
+
+// Renders the map on the CPU and reports how long the frames took, the last frame is saved to the output file
+static bool RenderHeadless(const MapArena& arena, ThreadPool& pool, const World& world, const std::string& output, int width, int height, int frames)
 {
-	size_t length;
-	uint8_t r, g, b;
-	Vector2f* points;
-} Highway;
+	SoftwareRenderer renderer(arena, pool);
+	Framebuffer framebuffer(width, height);
+	Camera camera(width, height);
+	camera.Fit(world.Bounds());
+	Box view = camera.View();
+
+	std::vector<double> times;
+	for (int i = 0; i < frames; i++)
+	{
+		TraceZone zone("frame");
+		auto start = std::chrono::steady_clock::now();
+		renderer.Render(framebuffer, view, 51, 0, 51);
+		times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
 
-int main(int argc, char** argv)
+	std::sort(times.begin(), times.end());
+	double total = 0.0;
+	for (double time : times)
+		total += time;
+
+	std::cout << "Rendered " << frames << " frames at " << width << "x" << height << " on " << pool.Size() << " threads, "
+		<< arena.Indices().size() << " indices: min " << times.front() << " ms, median " << times[times.size() / 2]
+		<< " ms, mean " << total / frames << " ms, max " << times.back() << " ms" << std::endl;
+
+	if (!framebuffer.Save(output))
+	{
+		std::cerr << "Failed to save the frame to " << output << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+// Applies the change files in the directory that weren't applied yet, in the order of their names like minutely diffs are numbered.
+// A file that isn't complete yet, most likely because it's still being written, stops there and is tried again on the next
+// poll, so the ones after it don't get ahead of it. Returns the number of files applied
+static size_t ApplyUpdates(MapUpdater& updater, const std::string& directory, std::set<std::string>& applied, MapArena::Changes& changes)
 {
-	Window::Init();
+	std::error_code error;
+	std::vector<std::string> files;
+	for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+	{
+		if (entry.path().extension() == ".osc" && !applied.count(entry.path().string()))
+			files.push_back(entry.path().string());
+	}
 
-	std::cout << "Loading and parsing OSM XML file. This might take a bit..." << std::flush;
-	osmp::Object* obj = new osmp::Object("leipzig.osm");
-	std::cout << "Done!" << std::endl;
-	osmp::Bounds bounds = obj->bounds;
-	float aspectRatio = (float)(bounds.maxlon - bounds.minlon) / (float)(bounds.maxlat - bounds.minlat);
-	int windowHeight = 900 - 100;
-	int windowWidth = windowHeight * aspectRatio;
+	if (error)
+	{
+		std::cerr << "Failed to read the updates in " << directory << ": " << error.message() << std::endl;
+		return 0;
+	}
+
+	std::sort(files.begin(), files.end());
+	size_t count = 0;
+	for (const std::string& file : files)
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (!updater.Apply(file, changes))
+		{
+			std::cerr << "Couldn't apply " << file << ", trying again on the next poll" << std::endl;
+			break;
+		}
+
+		applied.insert(file);
+		count++;
+		std::cout << "Applied " << file << " in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+			<< " ms" << std::endl;
+	}
 
-	// Fetch all the ways
-	osmp::Ways ways = obj->GetWays();
+	return count;
+}
 
-	// Turn them into renderable ways by mapping the global coordinates to screen coordinates (do this smarter in the future pls)
+// Everything a loaded map is made of. Geometry loaded from the cache points straight into the mapped file, geometry built
+// from the source into the store, so both have to outlive the features
+struct LoadedMap
+{
+	osmp::Bounds bounds;
+	std::vector<Multipolygon> multipolygons;
 	std::vector<Area> buildings;
 	std::vector<Highway> highways;
-	for (osmp::Way way : ways)
+	MapCache cache;
+	GeometryStore geometry;
+
+	// Updates need the map data the features were built from, which only loading the source keeps around
+	std::unique_ptr<MapBuilder> builder;
+	std::unique_ptr<MapUpdater> updater;
+	std::set<std::string> applied;
+};
+
+// Hands out the arenas a load builds as it goes, the last one is complete
+typedef std::function<void(std::shared_ptr<MapArena> arena, bool complete)> Publish;
+
+// Loads the features from the cache or the source. With updates, the change files that are already there are applied
+// before the complete arena is built. With publish, the features are built into arenas as well: from the source while
+// it's parsed, every batch of features the builder reports is added to the last arena, and the cache a batch at a time
+static bool LoadMap(const std::string& source, bool useDom, const std::string& updateDirectory, const StyleTable& style, ThreadPool& pool, LoadedMap& map,
+	const Publish& publish = nullptr)
+{
+	bool cached = false;
+	if (updateDirectory.empty())
 	{
-		const osmp::Nodes& nodes = way->GetNodes();
-		std::string highwayVal = way->GetTag("highway");
-		std::string railwayVal = way->GetTag("railway");
-		if (way->area)
-		{
-			if (way->GetTag("building") == "")
-			{
-				continue;
-			}
+		TraceZone zone("load cache");
+		cached = map.cache.Load(source, style.Hash(), map.multipolygons, map.buildings, map.highways);
+	}
+
+	if (cached)
+	{
+		std::cout << "Loaded preprocessed map from " << MapCache::PathFor(source) << std::endl;
+		map.bounds = map.cache.Bounds();
+		if (publish)
+			MapArena::BuildProgressively(map.multipolygons, map.buildings, map.highways, pool, publish);
+		return true;
+	}
 
-			Area area;
-			area.length = nodes.size();
-			area.x = new int16_t[area.length];
-			area.y = new int16_t[area.length];
+	// Shared by every map, most multipolygons don't change between two extracts of the same area
+	TriangulationCache triangulations;
+	triangulations.Load(TRIANGULATION_CACHE_PATH);
+
+	map.builder = std::make_unique<MapBuilder>(map.multipolygons, map.buildings, map.highways, map.geometry, style, pool);
+	map.builder->SetTriangulationCache(&triangulations);
+
+	// Only the features added since the last arena are built, the rest is taken from it. The bounds are known before
+	// the first feature, they come from the header of the file or the nodes, which come before the ways
+	std::shared_ptr<MapArena> arena;
+	size_t builtMultipolygons = 0, builtBuildings = 0, builtHighways = 0;
+	auto grow = [&](MapArena::Changes& batch) {
+		for (size_t i = builtMultipolygons; i < map.multipolygons.size(); i++)
+			batch.multipolygons.insert((uint32_t)i);
+		for (size_t i = builtBuildings; i < map.buildings.size(); i++)
+			batch.buildings.insert((uint32_t)i);
+		for (size_t i = builtHighways; i < map.highways.size(); i++)
+			batch.highways.insert((uint32_t)i);
+
+		// The last arena may still be drawn, so the next one is a new arena
+		std::shared_ptr<MapArena> next = std::make_shared<MapArena>();
+		if (arena)
+			next->Update(map.multipolygons, map.buildings, map.highways, batch, *arena, pool);
+		else
+			next->Build(map.multipolygons, map.buildings, map.highways, pool);
+		arena = std::move(next);
+
+		builtMultipolygons = map.multipolygons.size();
+		builtBuildings = map.buildings.size();
+		builtHighways = map.highways.size();
+	};
+
+	if (publish)
+	{
+		map.builder->SetProgress([&]() {
+			if (!arena)
+				map.bounds = map.builder->Bounds();
+
+			MapArena::Changes batch;
+			grow(batch);
+			publish(arena, false);
+		});
+	}
 
-			area.r = 150;
-			area.g = 150;
-			area.b = 150;
+	std::cout << "Loading and parsing " << (IsOsmPbf(source) ? "OSM PBF" : "OSM XML") << " file. This might take a bit..." << std::flush;
+	bool loaded;
+	if (!updateDirectory.empty())
+	{
+		map.updater = std::make_unique<MapUpdater>(*map.builder);
+		loaded = map.updater->Load(source);
+	}
+	else
+		loaded = useDom ? LoadOsmObject(source, *map.builder) : LoadOsmStreaming(source, *map.builder);
+	map.builder->SetProgress(nullptr);
+	map.builder->SetTriangulationCache(nullptr);
+	if (!loaded)
+	{
+		std::cerr << "Failed to load " << source << std::endl;
+		return false;
+	}
+	std::cout << "Done!" << std::endl;
 
-			for (int i = 0; i < area.length; i++)
-			{
-				area.x[i] = Map(bounds.minlon, bounds.maxlon, 0, windowWidth, nodes[i]->lon);
-				area.y[i] = windowHeight - Map(bounds.minlat, bounds.maxlat, 0, windowHeight, nodes[i]->lat);
-			}
+	size_t lookups = triangulations.Hits() + triangulations.Misses();
+	if (lookups > 0)
+	{
+		std::cout << "Triangulation cache: " << triangulations.Hits() << " of " << lookups << " multipolygons reused ("
+			<< 100 * triangulations.Hits() / lookups << "%), " << triangulations.Entries() << " entries" << std::endl;
+	}
 
-			buildings.push_back(area);
+	if (triangulations.Misses() > 0 && !triangulations.Save(TRIANGULATION_CACHE_PATH))
+		std::cerr << "Failed to save the triangulation cache" << std::endl;
+
+	// Once anything was published the bounds must not change anymore, the render thread may be reading them
+	if (!arena)
+		map.bounds = map.builder->Bounds();
+
+	{
+		TraceZone zone("write cache");
+		if (!MapCache::Write(source, style.Hash(), map.bounds, map.multipolygons, map.buildings, map.highways))
+			std::cerr << "Failed to cache the map, it will be parsed again next time" << std::endl;
+	}
+
+	MapArena::Changes changes;
+	if (map.updater)
+		ApplyUpdates(*map.updater, updateDirectory, map.applied, changes);
+
+	if (publish)
+	{
+		if (arena)
+		{
+			// Finish() brought the multipolygons into render order, so they all moved. The ways stayed where they were
+			for (size_t i = 0; i < builtMultipolygons; i++)
+				changes.multipolygons.insert((uint32_t)i);
+
+			grow(changes);
+			publish(arena, true);
 		}
-		else if (highwayVal != "")
+		else
+			MapArena::BuildProgressively(map.multipolygons, map.buildings, map.highways, pool, publish);
+	}
+
+	return true;
+}
+
+// A renderer holds on to the arena it draws, so a region that was dropped stays around until its renderer is gone
+struct RegionRenderer
+{
+	std::shared_ptr<const MapArena> arena;
+	std::unique_ptr<MapRenderer> renderer;
+};
+
+// Draws the regions in view a layer at a time across all of them, features reach into the neighbouring regions.
+// Renderers of regions that went out of view or were loaded again are dropped
+static void DrawRegions(const RegionStore& store, const Box& view, double pixelsPerUnit, std::map<uint32_t, RegionRenderer>& renderers)
+{
+	std::vector<RegionStore::Visible> visible;
+	store.Query(view, pixelsPerUnit, visible);
+
+	for (auto it = renderers.begin(); it != renderers.end();)
+	{
+		bool drawn = std::any_of(visible.begin(), visible.end(), [&it](const RegionStore::Visible& region) {
+			return (region.region == it->first && region.arena == it->second.arena);
+		});
+		it = drawn ? std::next(it) : renderers.erase(it);
+	}
+
+	for (const RegionStore::Visible& region : visible)
+	{
+		RegionRenderer& renderer = renderers[region.region];
+		if (!renderer.renderer)
 		{
-			Highway highway;
-			highway.length = nodes.size();
-			highway.points = new Vector2f[highway.length];
+			renderer.arena = region.arena;
+			renderer.renderer = std::make_unique<MapRenderer>(*region.arena);
+		}
+	}
 
-			for (int i = 0; i < highway.length; i++)
+	for (int layer = MapArena::FILLED_AREAS; layer <= MapArena::HIGHWAYS; layer++)
+	{
+		for (const RegionStore::Visible& region : visible)
+			renderers[region.region].renderer->Draw(view, (MapArena::Layer)layer, (MapArena::Layer)layer);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	// mapviewer [--dom] [--headless image.png|image.ppm [--frames n] [--size WxH]] [--tiles directory --zoom min-max] [--trace trace.json]
+	//           [--updates directory] [--write-regions directory] [--regions directory [--budget MB]] [file.osm|file.osm.pbf]
+	std::string source = "leipzig.osm";
+	std::string tracePath;
+	bool useDom = false;
+	std::string headless;
+	int frames = 1;
+	int imageWidth = 0, imageHeight = 0;
+	std::string tileDirectory;
+	int minZoom = 12, maxZoom = 16;
+	std::string updateDirectory;
+	std::string writeRegions, regionDirectory;
+	size_t budget = REGION_BUDGET_MB;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--dom")
+			useDom = true;
+		else if (arg == "--headless" && i + 1 < argc)
+			headless = argv[++i];
+		else if (arg == "--frames" && i + 1 < argc)
+			frames = std::max(1, atoi(argv[++i]));
+		else if (arg == "--size" && i + 1 < argc)
+		{
+			if (sscanf(argv[++i], "%dx%d", &imageWidth, &imageHeight) != 2 || imageWidth <= 0 || imageHeight <= 0)
 			{
-				highway.points[i].x = Map(bounds.minlon, bounds.maxlon, 0, windowWidth, nodes[i]->lon);
-				highway.points[i].y = windowHeight - Map(bounds.minlat, bounds.maxlat, 0, windowHeight, nodes[i]->lat);
+				std::cerr << "Expected the image size as WxH, e.g. 1920x1080" << std::endl;
+				return 1;
 			}
-
-			if (highwayVal == "motorway") { highway.r = 226; highway.g = 122; highway.b = 143; }
-			else if (highwayVal == "trunk") { highway.r = 249; highway.g = 178; highway.b = 156; }
-			else if (highwayVal == "primary") { highway.r = 252; highway.g = 206; highway.b = 144; }
-			else if (highwayVal == "secondary") { highway.r = 244; highway.g = 251; highway.b = 173; }
-			else if (highwayVal == "tertiary") { highway.r = 244; highway.g = 244; highway.b = 250; }
-			else if (highwayVal == "footway") { highway.r = 233; highway.g = 140; highway.b = 124; }
-			else { highway.r = 15; highway.g = 15; highway.b = 20; }
-
-			highways.push_back(highway);
 		}
-		else if (railwayVal != "")
+		else if (arg == "--trace" && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (arg == "--tiles" && i + 1 < argc)
+			tileDirectory = argv[++i];
+		else if (arg == "--updates" && i + 1 < argc)
+			updateDirectory = argv[++i];
+		else if (arg == "--write-regions" && i + 1 < argc)
+			writeRegions = argv[++i];
+		else if (arg == "--regions" && i + 1 < argc)
+			regionDirectory = argv[++i];
+		else if (arg == "--budget" && i + 1 < argc)
+			budget = std::max(1, atoi(argv[++i]));
+		else if (arg == "--zoom" && i + 1 < argc)
 		{
-			Highway railway;
-			railway.length = nodes.size();
-			railway.points = new Vector2f[railway.length];
-
-			for (int i = 0; i < railway.length; i++)
+			if (sscanf(argv[++i], "%d-%d", &minZoom, &maxZoom) != 2)
 			{
-				railway.points[i].x = Map(bounds.minlon, bounds.maxlon, 0, windowWidth, nodes[i]->lon);
-				railway.points[i].y = windowHeight - Map(bounds.minlat, bounds.maxlat, 0, windowHeight, nodes[i]->lat);
+				std::cerr << "Expected the zoom range as min-max, e.g. 12-16" << std::endl;
+				return 1;
 			}
-
-			railway.r = 80; railway.g = 80; railway.b = 80;
-
-			highways.push_back(railway);
 		}
+		else
+			source = arg;
 	}
 
-	// Fetch all relations
-	osmp::Relations relations = obj->GetRelations();
-	std::vector<Multipolygon> multipolygons;
-	for (const osmp::Relation& relation : relations)
+	if (!tracePath.empty())
 	{
-		if (relation->GetRelationType() == "multipolygon" && !relation->HasNullMembers())
+		Trace::SetThreadName("Main");
+		Trace::Start();
+	}
+
+	StyleTable style;
+	if (!style.Load("style.txt"))
+		std::cerr << "Couldn't load style.txt, using the built in style" << std::endl;
+
+	ThreadPool pool;
+	LoadedMap map;
+
+	int status = 0;
+	if (!writeRegions.empty())
+	{
+		if (!LoadMap(source, useDom, updateDirectory, style, pool, map))
+			return 1;
+
+		auto start = std::chrono::steady_clock::now();
+		size_t regions;
+		if (RegionStore::Write(writeRegions, source, style.Hash(), map.bounds, map.multipolygons, map.buildings, map.highways, regions))
 		{
-			Multipolygon mp = Multipolygon(relation, windowWidth, windowHeight, obj->bounds);
-			multipolygons.push_back(mp);
+			std::cout << "Wrote " << regions << " regions of " << REGION_SIZE << " m to " << writeRegions << " in "
+				<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
 		}
+		else
+			status = 1;
 	}
+	else if (!headless.empty() || !tileDirectory.empty())
+	{
+		if (!LoadMap(source, useDom, updateDirectory, style, pool, map))
+			return 1;
 
-	std::sort(multipolygons.begin(), multipolygons.end());
-
+		// All geometry is in world space around the center of the bounds, the camera decides what's on screen
+		World world(map.bounds);
 
-	// Release map data
-	relations.clear();
-	ways.clear();
-	delete obj;
+		// Pack everything into one vertex and index buffer
+		MapArena arena;
+		arena.Build(map.multipolygons, map.buildings, map.highways, pool);
+#ifndef NDEBUG
+		if (!arena.Check())
+			std::cerr << "Map geometry is broken, expect rendering glitches" << std::endl;
+#endif
 
-	// Create Window + Renderer
-	Window window(Vector2i{ 1280, 800 }, "Map Viewer");
+		if (!headless.empty())
+		{
+			// Same size the window used to have, 800 pixels high and as wide as the map needs
+			if (imageWidth == 0)
+			{
+				const Box& extent = world.Bounds();
+				imageHeight = 800;
+				imageWidth = std::max(1, (int)(imageHeight * (extent.maxX - extent.minX) / (extent.maxY - extent.minY)));
+			}
 
-	// Window loop
-	while ((bool)window)
+			if (!RenderHeadless(arena, pool, world, headless, imageWidth, imageHeight, frames))
+				status = 1;
+		}
+		else
+		{
+			TileStats stats;
+			if (GenerateTiles(arena, world, map.bounds, tileDirectory, minZoom, maxZoom, pool, stats))
+			{
+				std::cout << "Wrote " << stats.tiles << " tiles for zoom " << minZoom << "-" << maxZoom << " to " << tileDirectory
+					<< " in " << stats.seconds << " s on " << pool.Size() << " threads: " << stats.tiles / stats.seconds << " tiles/s, "
+					<< (double)stats.features / std::max<size_t>(1, stats.tiles) << " features per tile" << std::endl;
+			}
+			else
+				status = 1;
+		}
+	}
+	else
 	{
-		Window::PollEvents();
+		Window::Init();
+
+		// The window is up before anything is loaded, the map fills in while the loader publishes it
+		Window window(Vector2i{ 1280, 800 }, "Map Viewer");
+		auto start = std::chrono::steady_clock::now();
+
+		// Preprocessed regions are loaded by the store as the view needs them, there's nothing to load up front
+		RegionStore store(pool, budget * 1024 * 1024);
+		std::map<uint32_t, RegionRenderer> regionRenderers;
+		if (!regionDirectory.empty() && !store.Open(regionDirectory, style.Hash()))
+			return 1;
+
+		BackgroundLoader loader;
+		if (regionDirectory.empty())
+		{
+			loader.Start([&](BackgroundLoader& loader) {
+				return LoadMap(source, useDom, updateDirectory, style, pool, map, [&loader](std::shared_ptr<MapArena> arena, bool complete) {
+					loader.Publish(std::move(arena), complete);
+				});
+			});
+		}
 
-		window.Clear(0.2f, 0.0f, 0.2f, 1.0f);
-		
-		 for (Multipolygon& multipolygon : multipolygons) {
-			// multipolygon.Draw(renderer);
-		 }
+		// The renderer draws the newest arena the loader published
+		std::shared_ptr<MapArena> arena;
+		std::unique_ptr<MapRenderer> renderer;
 
-		for (Area& area : buildings)
+		Camera camera(1280, 800);
+		if (!regionDirectory.empty())
 		{
-			// filledPolygonRGBA(renderer, area.x, area.y, area.length, area.r, area.g, area.b, 255);
+			camera.Fit(World(store.Bounds()).Bounds());
+			std::cout << "Opened " << store.Regions() << " regions in " << regionDirectory << std::endl;
 		}
 
-		for (Highway& highway : highways)
+		// Window loop, dragging pans and scrolling zooms towards the cursor
+		Vector2d lastCursor = window.CursorPosition();
+		auto lastPoll = std::chrono::steady_clock::now();
+		bool loaded = false;
+		while ((bool)window)
 		{
-			// SDL_SetRenderDrawColor(renderer, highway.r, highway.g, highway.b, 255);
-			// SDL_RenderDrawLinesF(renderer, highway.points, highway.length);
+			TraceZone zone("frame");
+			{
+				TraceZone inputZone("input");
+				Window::PollEvents();
+			}
+
+			std::shared_ptr<MapArena> published;
+			bool complete;
+			if (loader.Poll(published, complete))
+			{
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (!arena)
+				{
+					// The bounds are known once anything got published. All geometry is in world space around their center
+					camera.Fit(World(map.bounds).Bounds());
+					std::cout << "Drawing the first part of the map after " << seconds << " s" << std::endl;
+				}
+
+				renderer.reset();
+				arena = std::move(published);
+				renderer = std::make_unique<MapRenderer>(*arena);
+
+				if (complete)
+				{
+					loaded = true;
+					std::cout << "Drawing all of the map after " << seconds << " s" << std::endl;
+#ifndef NDEBUG
+					if (!arena->Check())
+						std::cerr << "Map geometry is broken, expect rendering glitches" << std::endl;
+#endif
+				}
+			}
+			else if (loader.Failed())
+			{
+				status = 1;
+				break;
+			}
+
+			// New change files show up while the map is open, the renderer uploads the arena again after an update.
+			// Only once the complete map got here, before that the loader owns it. Its last publish hands it over
+			if (loaded && map.updater && std::chrono::duration<double>(std::chrono::steady_clock::now() - lastPoll).count() >= UPDATE_POLL_SECONDS)
+			{
+				lastPoll = std::chrono::steady_clock::now();
+
+				MapArena::Changes changes;
+				if (ApplyUpdates(*map.updater, updateDirectory, map.applied, changes) > 0)
+				{
+					renderer.reset();
+					arena->Update(map.multipolygons, map.buildings, map.highways, changes, pool);
+					renderer = std::make_unique<MapRenderer>(*arena);
+				}
+			}
+
+			Vector2i size = window.Size();
+			camera.Resize(size.x, size.y);
+
+			Vector2d cursor = window.CursorPosition();
+			if (window.MouseDown())
+				camera.Pan(cursor.x - lastCursor.x, cursor.y - lastCursor.y);
+			lastCursor = cursor;
+
+			double scroll = window.TakeScroll();
+			if (scroll != 0.0)
+				camera.Zoom(std::pow(ZOOM_STEP, scroll), cursor.x, cursor.y);
+
+			{
+				TraceZone drawZone("draw");
+				window.Clear(0.2f, 0.0f, 0.2f, 1.0f);
+				if (renderer)
+					renderer->Draw(camera.View());
+				else if (!regionDirectory.empty())
+				{
+					store.Update(camera.View(), camera.Scale());
+					DrawRegions(store, camera.View(), camera.Scale(), regionRenderers);
+				}
+			}
+
+			TraceZone swapZone("swap");
+			window.SwapBuffers();
 		}
-		
 
-		window.SwapBuffers();
+		// Closing the window while loading waits for the load, the loader is still using the map
+		renderer.reset();
+		regionRenderers.clear();
+	}
+
+	if (!tracePath.empty())
+	{
+		// The pool is idle by now, so no thread is recording anymore
+		if (Trace::Write(tracePath))
+			std::cout << "Wrote the trace to " << tracePath << ", open it in ui.perfetto.dev or chrome://tracing" << std::endl;
+		else
+			std::cerr << "Failed to write the trace to " << tracePath << std::endl;
 	}
 
 	// Cleanup time
@@ -169,18 +569,5 @@ int main(int argc, char** argv)
 
 	// SDL_Quit();
 
-	for (Area& area : buildings) {
-		delete[] area.x;
-		delete[] area.y;
-	}
-
-	for (Highway& highway : highways)
-		delete[] highway.points;
-
-	return 0;
-}
-
-inline float Map(float A, float B, float a, float b, float x)
-{
-	return (x - A) * (b - a) / (B - A) + a;
+	return status;
 }
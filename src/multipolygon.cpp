@@ -4,547 +4,147 @@
 #include <array>
 #include <algorithm>
 #include <map>
+#include <queue>
+#include <functional>
+#include <unordered_map>
+#include <cstring>
 #include <iostream>
 
-#include <triangle.h>
-#include <osmp.hpp>
-
-#define BREAKIF(x) if(relation->id == x) __debugbreak()
-#define INDEXOF(x, y, n) (y * n + x)
-
-struct TriangulationData {
-	std::vector<REAL> vertices, holes;
-	std::vector<int> segments;
-};
-
-struct Ring {
-	osmp::Nodes nodes;
-	bool inner;
-	int index;
-	bool hole = false;
-};
-
-struct RingGroup {
-	std::vector<Ring> rings;
+#include "RingAssembly.hpp"
+#include "Earcut.hpp"
+#include "Intersection.hpp"
+#include "SpatialIndex.hpp"
+#include "Arena.hpp"
+#include "Trace.hpp"
+#include "TriangulationCache.hpp"
+
+// Looks up member ways by the node ids at their ends, so joining a ring doesn't have to scan every way
+struct MemberIndex {
+	const std::vector<RelationMember>& members;
+	std::unordered_multimap<uint64_t, int, std::hash<uint64_t>, std::equal_to<uint64_t>, ScratchAllocator<std::pair<const uint64_t, int>>> endpoints;
+	ScratchVector<bool> used;
+	size_t remaining;
+
+	MemberIndex(const std::vector<RelationMember>& members);
+
+	// Lowest unused way starting or ending in the node, -1 if there is none
+	int Find(const NodeCoord& node) const;
 };
 
-// Map values from one interval [A, B] to another [a, b]
-inline double Map(double A, double B, double a, double b, double x)
-{
-	return (x - A) * (b - a) / (B - A) + a;
-}
-
-// TODO: Implement better algorithm
-bool Intersect(double p1_x, double p1_y, double p2_x, double p2_y, double q1_x, double q1_y, double q2_x, double q2_y);
-bool Intersect(const osmp::Node& p1, const osmp::Node& p2, const osmp::Node& q1, const osmp::Node& q2);
 bool SelfIntersecting(const Ring& ring);
+bool BuildRing(Ring& ring, MemberIndex& index, int ringCount);
 
-bool BuildRing(Ring& ring, osmp::MemberWays& unassigned, int ringCount);
-bool AssignRings(std::vector<Ring>& rings, const osmp::MemberWays& members);
-
-void FindAllContainedRings(const std::vector<bool>& containmentMatrix, int container, int numRings, std::vector<int>& buffer);
-void FindAllContainedRingsThatArentContainedByUnusedRings(const std::vector<bool>& containmentMatrix, int container, int numRings, const std::vector<Ring>& unusedRings, std::vector<int>& buffer);
-int  FindUncontainedRing(const std::vector<bool>& containmentMatrix, int rings, const std::vector<Ring>& unusedRings);
-bool PointInsideRing(const Ring& ring, const osmp::Node& point);
+bool PointInsideRing(const Ring& ring, const NodeCoord& point);
 bool IsRingContained(const Ring& r1, const Ring& r2);
-bool GroupRings(std::vector<RingGroup>& ringGroup, std::vector<Ring>& rings);
 
-Multipolygon::Multipolygon(const osmp::Relation& relation, int width, int height, const osmp::Bounds& bounds) :
-	r(255), g(0), b(255), visible(true), rendering(RenderType::FILL), id(relation->id)
+Multipolygon::Multipolygon(uint64_t id, const Style& style, const std::vector<RelationMember>& members, const World& world, GeometryStore& geometry, TriangulationCache* cache) :
+	r(style.r), g(style.g), b(style.b), visible(style.visible), rendering(RenderType::FILL), id(id)
 {
-	if (relation->HasNullMembers())
-		return;
-
-	const osmp::MemberWays& members = relation->GetWays();
-
 	/* Implement https://wiki.openstreetmap.org/wiki/Relation:multipolygon/Algorithm */
 
-	std::vector<Ring> rings;
-	if (!AssignRings(rings, members))
+	switch (style.rendering)
 	{
-		std::cerr << "Assigning rings has failed for multipolygon " << id << std::endl;
+	case Style::FILL: rendering = RenderType::FILL; break;
+	case Style::OUTLINE: rendering = RenderType::OUTLINE; break;
+	case Style::INDOOR: rendering = RenderType::INDOOR; break;
 	}
 
-	std::vector<RingGroup> ringGroups;
-	GroupRings(ringGroups, rings);
+	TraceZone zone("multipolygon");
+	zone.Arg("id", id);
+	zone.Arg("members", members.size());
 
-	char* triSwitches = "zpNBQ";
-	for (const RingGroup& ringGroup : ringGroups) 
+	// Relations that didn't change since they were cached skip everything below
+	uint64_t key = 0;
+	std::vector<TriangulationCache::Group> cached;
+	if (cache)
 	{
-		TriangulationData td;
-
-		bool valid = true;
-		for (const Ring& ring : ringGroup.rings)
-		{
-			std::vector<REAL> vertices;
-			for (const osmp::Node& node : ring.nodes) {
-				double x = Map(bounds.minlon, bounds.maxlon, 0, width, node->lon);
-				double y = height - Map(bounds.minlat, bounds.maxlat, 0, height, node->lat);
-
-				vertices.push_back(x);
-				vertices.push_back(y);
-			}
-
-			int segment = td.vertices.size() / 2;
-			for (int i = 0; i < vertices.size() / 2; i += 1) {
-				td.segments.push_back(segment + i);
-				td.segments.push_back(segment + i + 1);
-			}
-			td.segments.back() = td.vertices.size() / 2;
-
-			td.vertices.insert(td.vertices.end(), vertices.begin(), vertices.end());
-
-			if (ring.hole) {
-				double holeX = 0.0f;
-				double holeY = 0.0f;
-				for (int i = 0; i < vertices.size(); i += 2)
-				{
-					holeX += vertices[i];
-					holeY += vertices[i + 1];
-				}
-
-				holeX /= vertices.size() / 2;
-				holeY /= vertices.size() / 2;
-
-				td.holes.push_back(holeX);
-				td.holes.push_back(holeY);
-			}
-		}
-
-		// TODO: Find better way to check for duplicates
-		for (int i = 0; i < td.vertices.size(); i += 2) {
-			for (int j = 0; j < td.vertices.size(); j += 2) {
-				if (i == j) continue;
-
-				if (td.vertices[i] == td.vertices[j] && td.vertices[i + 1] == td.vertices[j + 1])
-				{
-					valid = false;
-					break;
-				}
-			}
-		}
-		
-		if (valid)
+		key = TriangulationCache::Key(members);
+		if (cache->Find(key, cached))
 		{
-			triangulateio in;
-
-			in.numberofpoints = td.vertices.size() / 2;
-			in.pointlist = td.vertices.data();
-			in.pointmarkerlist = NULL;
-
-			in.numberofpointattributes = 0;
-			in.numberofpointattributes = NULL;
-
-			in.numberofholes = td.holes.size() / 2;
-			in.holelist = td.holes.data();
-
-			in.numberofsegments = td.segments.size() / 2;
-			in.segmentlist = td.segments.data();
-			in.segmentmarkerlist = NULL;
-
-			in.numberofregions = 0;
-			in.regionlist = NULL;
-
-			triangulateio out;
-			out.pointlist = NULL;
-			out.pointmarkerlist = NULL;
-			out.trianglelist = NULL;
-			out.segmentlist = NULL;
-			out.segmentmarkerlist = NULL;
-
-			triangulate(triSwitches, &in, &out, NULL);
+			for (TriangulationCache::Group& group : cached)
+			{
+				for (Vector2d& point : group.points)
+					point = world.FromProjected(point);
 
-			polygons.push_back({});
-			for (int i = 0; i < in.numberofpoints * 2; i += 2) {
-				polygons.back().vertices.push_back({ in.pointlist[i], in.pointlist[i + 1] });
-				// polygons.back().vertices.push_back(in.pointlist[i + 1]);
-			}
-			for (int i = 0; i < out.numberoftriangles * 3; i++) {
-				polygons.back().indices.push_back(out.trianglelist[i]);
+				AddPolygon(geometry, { group.points.data(), group.points.size() }, { group.triangles.data(), group.triangles.size() },
+					{ group.segments.data(), group.segments.size() }, { group.rings.data(), group.rings.size() });
 			}
-			for (int i = 0; i < in.numberofsegments * 2; i++) {
-				polygons.back().segments.push_back(in.segmentlist[i]);
-			}
-
-			trifree(out.trianglelist);
-			trifree(out.segmentlist);
-		}
-	}
-
-	// TODO: Make a color map
-
-	std::string tag = "";
-	tag = relation->GetTag("indoor");
-	if (tag != "")
-	{
-		rendering = RenderType::INDOOR;
-		r = 150;
-		g = 150;
-		b = 150;
-	}
-
-	tag = relation->GetTag("building");
-	if (tag != "" || relation->GetTag("building:colour") != "" || relation->GetTag("building:material") != "" || relation->GetTag("building:part") != "")
-	{
-		r = 150;
-		g = 150;
-		b = 150;
-	}
-
-	tag = relation->GetTag("natural");
-	if (tag != "")
-	{
-		if (tag == "wood") {
-			r = 157;
-			g = 202;
-			b = 138;
-		}
-		else if (tag == "scrub") {
-			r = 200;
-			g = 215;
-			b = 171;
-		}
-		else if (tag == "heath") {
-			r = 214;
-			g = 217;
-			b = 159;
-		}
-		else if (tag == "water") {
-			r = 166;
-			g = 198;
-			b = 198;
-		}
-		else if (tag == "grassland") {
-			r = 205;
-			g = 235;
-			b = 176;
-		}
-		else if (tag == "floodplain") {
-			r = 174;
-			g = 236;
-			b = 190;
-		}
-		else if (tag == "sand") {
-			r = 234;
-			g = 222;
-			b = 189;
-		}
-		else if (tag == "scree") {
-			r = 237;
-			g = 228;
-			b = 220;
-		}
-		else if (tag == "bare_rock") {
-			r = 213;
-			g = 209;
-			b = 204;
-		}
-		else if (tag == "tree_row") {
-			r = 169;
-			g = 206;
-			b = 161;
-		}
-	}
 
-	tag = relation->GetTag("water");
-	if (tag != "")
-	{
-		r = 106;
-		g = 151;
-		b = 255;
-	}
-
-	tag = relation->GetTag("waterway");
-	if (tag != "")
-	{
-		r = 106;
-		g = 151;
-		b = 255;
-	}
-
-	tag = relation->GetTag("landuse");
-	if (tag != "")
-	{
-		if (tag == "grass") 
-		{
-			r = 207;
-			g = 237;
-			b = 165;
-		}
-		else if (tag == "commercial")
-		{
-			r = 238;
-			g = 205;
-			b = 205;
-		}
-		else if (tag == "residential")
-		{
-			r = 218;
-			g = 218;
-			b = 218;
-		}
-		else if (tag == "forest")
-		{
-			r = 157;
-			g = 202;
-			b = 138;
-		}
-		else if (tag == "basin")
-		{
-			r = 170;
-			g = 211;
-			b = 223;
-		}
-		else if (tag == "allotments")
-		{
-			r = 201;
-			g = 225;
-			b = 191;
-		}
-		else if (tag == "railway")
-		{
-			r = 230;
-			g = 209;
-			b = 227;
-		}
-		else if (tag == "construction")
-		{
-			r = 199;
-			g = 199;
-			b = 180;
-		}
-		else if (tag == "retail")
-		{
-			r = 254;
-			g = 202;
-			b = 197;
-		}
-		else if (tag == "village_green")
-		{
-			r = 205;
-			g = 235;
-			b = 176;
-		}
-		else if (tag == "meadow")
-		{
-			r = 205;
-			g = 236;
-			b = 176;
-		}
-		else if (tag == "cemetery")
-		{
-			r = 170;
-			g = 203;
-			b = 175;
-		}
-		else if (tag == "brownfield") {
-			r = 167;
-			g = 168;
-			b = 126;
-		}
-		else if (tag == "recreation_ground") {
-			r = 223;
-			g = 252;
-			b = 226;
+			return;
 		}
 	}
 
-	tag = relation->GetTag("leisure");
-	if (tag != "")
+	ScratchScope scope;
+	ScratchVector<Ring> rings;
 	{
-		if (tag == "park")
-		{
-			r = 205;
-			g = 247;
-			b = 201;
-		}
-		else if (tag == "garden")
-		{
-			r = 205;
-			g = 235;
-			b = 176;
-		}
-		else if (tag == "pitch")
-		{
-			r = 170;
-			g = 224;
-			b = 203;
-		}
-		else if (tag == "sports_centre")
-		{
-			r = 223;
-			g = 252;
-			b = 226;
-		}
-		else if (tag == "track")
+		TraceZone assignZone("assign rings");
+		if (!AssignRings(rings, members))
 		{
-			r = 170;
-			g = 224;
-			b = 203;
-		}
-		else if (tag == "slipway")
-		{
-			r = 0;
-			g = 146;
-			b = 218;
-		}
-		else if (tag == "playground")
-		{
-			r = 223;
-			g = 252;
-			b = 226;
+			std::cerr << "Assigning rings has failed for multipolygon " << id << std::endl;
 		}
+		assignZone.Arg("rings", rings.size());
 	}
 
-	tag = relation->GetTag("tourism");
-	if (tag != "")
+	ScratchVector<RingGroup> ringGroups;
 	{
-		if (tag == "zoo") {
-			rendering = RenderType::OUTLINE;
-			r = 147;
-			g = 84;
-			b = 115;
-		}
-	}
-
-	tag = relation->GetTag("man_made");
-	if (tag != "")
-	{
-		if (tag == "bridge") {
-			r = 184;
-			g = 184;
-			b = 184;
-		}
-		else if (tag == "wastewater_plant") {
-			r = 230;
-			g = 209;
-			b = 227;
-		}
-		else if (tag == "pier") {
-			r = 250;
-			g = 250;
-			b = 255;
-		}
+		TraceZone groupZone("group rings");
+		GroupRings(ringGroups, rings);
+		groupZone.Arg("groups", ringGroups.size());
 	}
 
-	tag = relation->GetTag("amenity");
-	if (tag != "")
+	for (const RingGroup& ringGroup : ringGroups) 
 	{
-		if (tag == "parking" || tag == "bicycle_parking") {
-			r = 100;
-			g = 100;
-			b = 120;
-		}
-		else if (tag == "school" || tag == "university" || tag == "kindergarten") {
-			r = 255;
-			g = 255;
-			b = 229;
-		}
-	}
+		TriangulationData td;
+		PrepareTriangulation(ringGroup, world, td);
 
-	tag = relation->GetTag("place");
-	if (tag != "")
-	{
-		r = 180;
-		g = 180;
-		b = 180;
-	}
+		if (td.vertices.size() < 6 || td.segments.size() < 6)
+			continue;
 
-	tag = relation->GetTag("public_transport");
-	if (tag != "")
-	{
-		if (tag == "platform")
+		ScratchVector<Vector2d> points;
+		ScratchVector<int> triangles;
+		bool simple;
 		{
-			r = 180;
-			g = 180;
-			b = 190;
+			TraceZone earcutZone("earcut");
+			earcutZone.Arg("vertices", td.vertices.size() / 2);
+			simple = TriangulateWithEarcut(td, points, triangles);
 		}
-	}
 
-	tag = relation->GetTag("highway");
-	if (tag != "")
-	{
-		if (tag == "pedestrian")
+		if (!simple)
 		{
-			r = 213;
-			g = 212;
-			b = 227;
-		}
-	}
+			// Rings touching themselves or each other, or different nodes in the same spot, would make Triangle fail
+			{
+				TraceZone mergeZone("merge duplicates");
+				mergeZone.Arg("vertices", td.vertices.size() / 2);
+				MergeDuplicateVertices(td);
+			}
 
-	tag = relation->GetTag("area:highway");
-	if (tag != "")
-	{
-		if (tag == "primary")
-		{
-			r = 255;
-			g = 255;
-			b = 229;
-		}
-		else if (tag == "secondary")
-		{
-			r = 244; 
-			g = 251; 
-			b = 173;
-		}
-		else if (tag == "footway" || tag == "cycleway" || tag == "footway;cycleway")	// TODO: Apparently you can list values??? check with the standard.
-		{
-			r = 233; 
-			g = 140; 
-			b = 124;
-		}
-		else if (tag == "emergency")
-		{
-			r = 250;
-			g = 250;
-			b = 255;
-		}
-		else if (tag == "unclassified" || tag == "emergency" || tag == "residential" || tag == "service" || tag == "traffic_island")
-		{
-			r = 15;
-			g = 15;
-			b = 20;
-		}
-		else if (tag == "bus") {
-			r = 150;
-			g = 150;
-			b = 150;
-		}
-		else if (tag == "reserved") {	// TODO: Not a keyword I'm aware of
-			r = 0; g = 0; b = 0;
-			visible = false;
-		}
-	}
+			if (td.vertices.size() < 6 || td.segments.size() < 6)
+				continue;
 
-	tag = relation->GetTag("area:railway");
-	if (tag != "")
-	{
-		if (tag == "tram") {
-			r = 150;
-			g = 150;
-			b = 150;
+			TraceZone triangulateZone("triangulate");
+			triangulateZone.Arg("vertices", td.vertices.size() / 2);
+			TriangulateWithTriangle(td, points, triangles);
+			triangulateZone.Arg("triangles", triangles.size() / 3);
 		}
-	}
 
-	tag = relation->GetTag("bridge:support");
-	if (tag != "")
-	{
-		r = 184;
-		g = 184;
-		b = 184;
-	}
+		Span<const int> segments = { td.segments.data(), td.segments.size() };
+		Span<const int> ringStarts = { td.rings.data(), td.rings.size() };
+		AddPolygon(geometry, { points.data(), points.size() }, { triangles.data(), triangles.size() }, segments, ringStarts);
 
-	tag = relation->GetTag("tunnel");
-	if (tag == "yes")
-	{
-		r = 240;
-		g = 240;
-		b = 255;
+		if (cache)
+		{
+			cached.emplace_back();
+			TriangulationCache::Group& group = cached.back();
+			for (const Vector2d& point : points)
+				group.points.push_back(world.ToProjected(point));
+			group.triangles.assign(triangles.begin(), triangles.end());
+			group.segments.assign(segments.begin(), segments.end());
+			group.rings.assign(ringStarts.begin(), ringStarts.end());
+		}
 	}
 
-	if (r == 255 && b == 255) {
-		std::cout << relation->id << std::endl;
-	}
+	if (cache)
+		cache->Insert(key, cached);
 }
 
 void Multipolygon::SetColor(int r, int g, int b)
@@ -554,289 +154,343 @@ void Multipolygon::SetColor(int r, int g, int b)
 	this->b = b;
 }
 
-void Multipolygon::Draw()
+void Multipolygon::AddPolygon(GeometryStore& geometry, Span<const Vector2d> points, Span<const int> triangles, Span<const int> segments, Span<const int> rings)
 {
-	if (!visible)
-		return;
+	Polygon polygon;
+	polygon.vertices = geometry.AddPoints(points.data, points.size());
+	polygon.indices = geometry.AddIndices(triangles.data, triangles.size(), points.size());
+	polygon.segments = geometry.AddIndices(segments.data, segments.size(), points.size());
+	polygon.rings = geometry.AddIndices(rings.data, rings.size(), segments.size());
+	polygons.push_back(polygon);
+}
 
-	//for (const Polygon& polygon : polygons) {
-	//	for (auto it = polygon.vertices.begin(); it != polygon.vertices.end() - 1; it++) {
-	//		thickLineRGBA(renderer,
-	//			it->x, it->y,
-	//			(it+1)->x, (it+1)->y,
-	//			2,
-	//			r, g, b, 255
-	//			);
-	//	}
-	//}
+void PrepareTriangulation(const RingGroup& ringGroup, const World& world, TriangulationData& td)
+{
+	for (const Ring& ring : ringGroup.rings)
+	{
+		ScratchVector<REAL> vertices;
+		for (const NodeCoord& node : ring.nodes) {
+			// Snapped before triangulating, so the triangles are made of the points that get stored
+			Vector2d point = world.ToWorld(node.lon, node.lat);
+			vertices.push_back(SnapToGrid(point.x));
+			vertices.push_back(SnapToGrid(point.y));
+		}
 
-	for (const Polygon& polygon : polygons) {
-		switch(rendering)
-		{
-		case RenderType::FILL:
-			for (int i = 0; i < polygon.indices.size(); i += 3)	// Be a graphics card
-			{
+		td.rings.push_back(td.segments.size());
 
-				/*filledTrigonRGBA(renderer,
-					polygon.vertices[polygon.indices[i + 0]].x, polygon.vertices[polygon.indices[i + 0]].y,
-					polygon.vertices[polygon.indices[i + 1]].x, polygon.vertices[polygon.indices[i + 1]].y,
-					polygon.vertices[polygon.indices[i + 2]].x, polygon.vertices[polygon.indices[i + 2]].y,
-					r, g, b, 255
-				);*/
-			}
-			break;
+		int segment = td.vertices.size() / 2;
+		for (int i = 0; i < vertices.size() / 2; i += 1) {
+			td.segments.push_back(segment + i);
+			td.segments.push_back(segment + i + 1);
+		}
+		td.segments.back() = td.vertices.size() / 2;
 
-		case RenderType::OUTLINE:
-			for(int i = 0; i < polygon.segments.size(); i += 2)
-			{
-				/*thickLineRGBA(renderer,
-					polygon.vertices[polygon.segments[i + 0]].x, polygon.vertices[polygon.segments[i + 0]].y,
-					polygon.vertices[polygon.segments[i + 1]].x, polygon.vertices[polygon.segments[i + 1]].y,
-					5, r, g, b, 255
-				);*/
-			}
-			break;
+		td.vertices.insert(td.vertices.end(), vertices.begin(), vertices.end());
 
-		case RenderType::INDOOR:
-			for (int i = 0; i < polygon.indices.size(); i += 3)	// Be a graphics card
+		if (ring.hole) {
+			double holeX = 0.0f;
+			double holeY = 0.0f;
+			for (int i = 0; i < vertices.size(); i += 2)
 			{
-
-				/*filledTrigonRGBA(renderer,
-					polygon.vertices[polygon.indices[i + 0]].x, polygon.vertices[polygon.indices[i + 0]].y,
-					polygon.vertices[polygon.indices[i + 1]].x, polygon.vertices[polygon.indices[i + 1]].y,
-					polygon.vertices[polygon.indices[i + 2]].x, polygon.vertices[polygon.indices[i + 2]].y,
-					r, g, b, 255
-				);*/
+				holeX += vertices[i];
+				holeY += vertices[i + 1];
 			}
 
-			for (int i = 0; i < polygon.segments.size(); i += 2)
-			{
-				/*lineRGBA(renderer,
-					polygon.vertices[polygon.segments[i + 0]].x, polygon.vertices[polygon.segments[i + 0]].y,
-					polygon.vertices[polygon.segments[i + 1]].x, polygon.vertices[polygon.segments[i + 1]].y,
-					10, 10, 15, 255
-				);*/
-			}
-			break;
+			holeX /= vertices.size() / 2;
+			holeY /= vertices.size() / 2;
+
+			td.holes.push_back(holeX);
+			td.holes.push_back(holeY);
 		}
 	}
 }
 
-bool Intersect(double p0_x, double p0_y, double p1_x, double p1_y, double p2_x, double p2_y, double p3_x, double p3_y)
+bool TriangulateWithEarcut(const TriangulationData& td, ScratchVector<Vector2d>& points, ScratchVector<int>& triangles)
 {
-	if ((p0_x == p2_x && p0_y == p2_y) || 
-		(p0_x == p3_x && p0_y == p3_y) ||
-		(p1_x == p2_x && p1_y == p2_y) ||
-		(p1_x == p3_x && p1_y == p3_y)) 
+	// Every ring is a closed loop of its own vertices, one segment per vertex, so a ring starts at the same
+	// vertex as its first segment. Once duplicates are merged that isn't true anymore
+	if (td.segments.size() != td.vertices.size())
 		return false;
 
-	float s1_x, s1_y, s2_x, s2_y;
-	s1_x = p1_x - p0_x;     s1_y = p1_y - p0_y;
-	s2_x = p3_x - p2_x;     s2_y = p3_y - p2_y;
+	points.resize(td.vertices.size() / 2);
+	for (size_t i = 0; i < points.size(); i++)
+		points[i] = { td.vertices[i * 2], td.vertices[i * 2 + 1] };
 
-	float s, t;
-	s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y)) / (-s2_x * s1_y + s1_x * s2_y);
-	t = (s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x)) / (-s2_x * s1_y + s1_x * s2_y);
+	ScratchVector<int> ringStarts(td.rings.size());
+	for (size_t i = 0; i < td.rings.size(); i++)
+		ringStarts[i] = td.rings[i] / 2;
 
-	if (s >= 0 && s <= 1 && t >= 0 && t <= 1)
-	{
-		// Collision detected
-		return 1;
-	}
+	if (Earcut({ points.data(), points.size() }, { ringStarts.data(), ringStarts.size() }, triangles))
+		return true;
 
-	return 0; // No collision
+	points.clear();
+	return false;
 }
 
-bool Intersect(const osmp::Node& p0, const osmp::Node& p1, const osmp::Node& p2, const osmp::Node& p3)
+void TriangulateWithTriangle(TriangulationData& td, ScratchVector<Vector2d>& points, ScratchVector<int>& triangles)
 {
-	return Intersect(p0->lon, p0->lat, p1->lon, p1->lat, p2->lon, p2->lat, p3->lon, p3->lat);
+	char triSwitches[] = "zpBQ";
+
+	triangulateio in;
+
+	in.numberofpoints = td.vertices.size() / 2;
+	in.pointlist = td.vertices.data();
+	in.pointmarkerlist = NULL;
+
+	in.numberofpointattributes = 0;
+	in.numberofpointattributes = NULL;
+
+	in.numberofholes = td.holes.size() / 2;
+	in.holelist = td.holes.data();
+
+	in.numberofsegments = td.segments.size() / 2;
+	in.segmentlist = td.segments.data();
+	in.segmentmarkerlist = NULL;
+
+	in.numberofregions = 0;
+	in.regionlist = NULL;
+
+	triangulateio out;
+	out.pointlist = NULL;
+	out.pointmarkerlist = NULL;
+	out.trianglelist = NULL;
+	out.segmentlist = NULL;
+	out.segmentmarkerlist = NULL;
+
+	triangulate(triSwitches, &in, &out, NULL);
+
+	points.resize(out.numberofpoints);
+	for (int i = 0; i < out.numberofpoints; i++)
+		points[i] = { out.pointlist[i * 2], out.pointlist[i * 2 + 1] };
+
+	triangles.assign(out.trianglelist, out.trianglelist + out.numberoftriangles * 3);
+
+	trifree((VOID*)out.pointlist);
+	trifree(out.trianglelist);
+	trifree(out.segmentlist);
 }
+
 bool SelfIntersecting(const Ring& ring)
 {
-	struct Segment {
-		osmp::Node p1, p2;
+	ScratchVector<Vector2d> points;
+	points.reserve(ring.nodes.size());
+	for (const NodeCoord& node : ring.nodes)
+		points.push_back({ node.lon, node.lat });
+
+	return SelfIntersecting(Span<const Vector2d>{ points.data(), points.size() });
+}
+
+void MergeDuplicateVertices(TriangulationData& td)
+{
+	struct Key {
+		uint64_t x, y;
+
+		bool operator==(const Key& other) const { return (x == other.x && y == other.y); }
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& key) const { return (size_t)(key.x * 0x9E3779B97F4A7C15ull ^ (key.y + 0x632BE59BD9B4E019ull + (key.x << 6))); }
+	};
+
+	// Compare the exact bit patterns, with the only exception that -0 is the same as 0
+	auto bits = [](REAL value) {
+		if (value == 0.0)
+			value = 0.0;
+
+		uint64_t result;
+		memcpy(&result, &value, sizeof(result));
+		return result;
 	};
 
-	// Get all segments
-	std::vector<Segment> segments;
-	for (auto it = ring.nodes.begin(); it != ring.nodes.end(); it++)
+	int numVertices = td.vertices.size() / 2;
+	std::unordered_map<Key, int, KeyHash, std::equal_to<Key>, ScratchAllocator<std::pair<const Key, int>>> firstIndex;
+	firstIndex.reserve(numVertices);
+
+	// Every vertex is mapped to the first one in the same spot
+	ScratchVector<int> remap(numVertices);
+	ScratchVector<REAL> vertices;
+	vertices.reserve(td.vertices.size());
+	for (int i = 0; i < numVertices; i++)
 	{
-		if (it == ring.nodes.end() - 1)
-		{
-			segments.push_back({
-				*it, ring.nodes.front()
-				});
-		}
-		else
+		auto result = firstIndex.insert({ { bits(td.vertices[2 * i]), bits(td.vertices[2 * i + 1]) }, (int)(vertices.size() / 2) });
+		if (result.second)
 		{
-			segments.push_back({
-				*it, *(it + 1)
-				});
+			vertices.push_back(td.vertices[2 * i]);
+			vertices.push_back(td.vertices[2 * i + 1]);
 		}
+
+		remap[i] = result.first->second;
 	}
 
-	// Check for self intersection (O(n^2)...)
-	for (auto it = segments.begin(); it != segments.end(); it++)
+	if (vertices.size() == td.vertices.size())
+		return;
+
+	// Segments collapsed into a single point are dropped, rings left without any segments as well
+	ScratchVector<int> segments, rings;
+	segments.reserve(td.segments.size());
+	size_t ring = 0;
+	for (int i = 0; i < td.segments.size(); i += 2)
 	{
-		for (auto jt = segments.begin(); jt != segments.end(); jt++)
+		for (; ring < td.rings.size() && td.rings[ring] <= i; ring++)
 		{
-			if (it == jt) continue;
-
-			if (Intersect(it->p1, it->p2, jt->p1, jt->p2)) 
-				return true;
+			if (rings.empty() || rings.back() != segments.size())
+				rings.push_back(segments.size());
 		}
-	}
 
-	return false;
-}
+		int a = remap[td.segments[i]];
+		int b = remap[td.segments[i + 1]];
+		if (a == b)
+			continue;
 
-bool BuildRing(Ring& ring, osmp::MemberWays& unassigned, int ringCount)
-{
-	const osmp::MemberWays original = unassigned;
+		segments.push_back(a);
+		segments.push_back(b);
+	}
 
-	// RA-2
-	int attempts = 0;
-	ring = Ring{ unassigned[attempts].way->GetNodes(), unassigned[attempts].role == "inner", ringCount };
-	unassigned.erase(unassigned.begin() + attempts);
+	if (!rings.empty() && rings.back() == segments.size())
+		rings.pop_back();
 
-RA3:
-	// RA-3
-	if (ring.nodes.front() == ring.nodes.back())
-	{
-		if (SelfIntersecting(ring))
-		{
-			unassigned = original;
-			attempts += 1;
-			if (unassigned.size() == attempts)
-				return false;
+	td.vertices = std::move(vertices);
+	td.segments = std::move(segments);
+	td.rings = std::move(rings);
+}
 
-			ring = Ring{ unassigned[attempts].way->GetNodes(), unassigned[attempts].role == "inner", ringCount };
-			goto RA3;
-		}
-		else
-		{
-			ring.nodes.pop_back();
-			return true;
-		}
-	}
-	else // RA-4
+MemberIndex::MemberIndex(const std::vector<RelationMember>& members) :
+	members(members), used(members.size(), false), remaining(members.size())
+{
+	endpoints.reserve(members.size() * 2);
+	for (int i = 0; i < members.size(); i++)
 	{
-		osmp::Node lastNode = ring.nodes.back();
-		for (auto it = unassigned.begin(); it != unassigned.end(); it++)
+		// Ways with less than two nodes have no edge to add to a ring
+		if (members[i].nodes->size() < 2)
 		{
-			if (it->way->GetNodes().front() == lastNode)
-			{
-				ring.nodes.insert(ring.nodes.end(), it->way->GetNodes().begin() + 1, it->way->GetNodes().end());
-				unassigned.erase(it);
-				goto RA3;
-			}
-			else if (it->way->GetNodes().back() == lastNode)
-			{
-				ring.nodes.insert(ring.nodes.end(), it->way->GetNodes().rbegin() + 1, it->way->GetNodes().rend());
-				unassigned.erase(it);
-				goto RA3;
-			}
+			used[i] = true;
+			remaining--;
+			continue;
 		}
 
-		// No ring found
-		unassigned = original;
-		return false;
+		endpoints.emplace(members[i].nodes->front().id, i);
+		if (members[i].nodes->back().id != members[i].nodes->front().id)
+			endpoints.emplace(members[i].nodes->back().id, i);
 	}
 }
 
-bool AssignRings(std::vector<Ring>& rings, const osmp::MemberWays& members)
+int MemberIndex::Find(const NodeCoord& node) const
 {
-	// Ring assignment
-	osmp::MemberWays unassigned = members;
-	int ringCount = 0;
-	while (!unassigned.empty())
+	// Take the lowest index so the result doesn't depend on the hash map's iteration order
+	int found = -1;
+	auto range = endpoints.equal_range(node.id);
+	for (auto it = range.first; it != range.second; it++)
 	{
-		rings.push_back({});
-		if (!BuildRing(rings.back(), unassigned, ringCount) || rings.size() > members.size())
-			return false;
-
-		ringCount++;
+		if (!used[it->second] && (found == -1 || it->second < found))
+			found = it->second;
 	}
 
-	return true;
+	return found;
 }
 
-bool cmp(const osmp::Node& a, const osmp::Node& b) 
+bool BuildRing(Ring& ring, MemberIndex& index, int ringCount)
 {
-	return (a->lon < b->lon);
-}
+	// Ways taken by the current attempt, so a failed attempt only gives those back
+	ScratchVector<int> taken;
+	auto release = [&index, &taken]() {
+		for (int way : taken)
+			index.used[way] = false;
+
+		index.remaining += taken.size();
+		taken.clear();
+	};
 
-void FindAllContainedRings(const std::vector<bool>& containmentMatrix, int container, int numRings, std::vector<int>& buffer)
-{
-	buffer.clear();
-	for (int j = 0; j < numRings; j++) {
-		if (containmentMatrix[INDEXOF(container, j, numRings)])
-			buffer.push_back(j);
-	}
-}
+	// RA-2, if the ring turns out self intersecting the next unused way is tried as the start instead
+	for (int start = 0; start < index.members.size(); start++)
+	{
+		if (index.used[start])
+			continue;
 
-void FindAllContainedRingsThatArentContainedByUnusedRings(const std::vector<bool>& containmentMatrix, int container, int numRings, const std::vector<Ring>& unusedRings, std::vector<int>& buffer)
-{
-	FindAllContainedRings(containmentMatrix, container, numRings, buffer);
-
-	for (auto j = buffer.begin(); j != buffer.end(); ) {
-		bool foundRing = false;
-		for (const Ring& ring : unusedRings) {
-			if (containmentMatrix[INDEXOF(ring.index, *j, numRings)]) {
-				foundRing = true;
-				break;
+		const RelationMember& first = index.members[start];
+		ring = Ring{ ScratchVector<NodeCoord>(first.nodes->begin(), first.nodes->end()), first.inner, ringCount };
+		index.used[start] = true;
+		index.remaining--;
+		taken.push_back(start);
+
+		while (true)
+		{
+			// RA-3
+			if (ring.nodes.front() == ring.nodes.back())
+			{
+				if (SelfIntersecting(ring))
+					break;
+
+				ring.nodes.pop_back();
+				return true;
 			}
+
+			// RA-4
+			const NodeCoord lastNode = ring.nodes.back();
+			int next = index.Find(lastNode);
+			if (next == -1)
+			{
+				// No ring found
+				release();
+				return false;
+			}
+
+			const NodeList& nodes = *index.members[next].nodes;
+			if (nodes.front() == lastNode)
+				ring.nodes.insert(ring.nodes.end(), nodes.begin() + 1, nodes.end());
+			else
+				ring.nodes.insert(ring.nodes.end(), nodes.rbegin() + 1, nodes.rend());
+
+			index.used[next] = true;
+			index.remaining--;
+			taken.push_back(next);
 		}
 
-		if(foundRing) 
-			j = buffer.erase(j);
-		else
-			++j;
+		release();
 	}
-}
 
-bool Compare(const Ring& ring, int index) {
-	return (ring.index == index);
+	return false;
 }
 
-int FindUncontainedRing(const std::vector<bool>& containmentMatrix, int rings, const std::vector<Ring>& unusedRings)
+bool AssignRings(ScratchVector<Ring>& rings, const std::vector<RelationMember>& members)
 {
-	for (int j = 0; j < rings; j++) {
-		if (std::find_if(unusedRings.begin(), unusedRings.end(), [j](const Ring& ring) { return (ring.index == j); }) == unusedRings.end())
-			continue;
-
-		bool isContained = false;
-		for (int i = 0; i < rings; i++) {
-			if (containmentMatrix[INDEXOF(i, j, rings)])
-			{
-				isContained = true;
-				break;
-			}
+	// Ring assignment
+	MemberIndex index(members);
+	int ringCount = 0;
+	while (index.remaining > 0)
+	{
+		rings.push_back({});
+		if (!BuildRing(rings.back(), index, ringCount) || rings.size() > members.size())
+		{
+			// Only whole rings are handed out, the ones that were found can still be drawn
+			rings.pop_back();
+			return false;
 		}
 
-		if (!isContained)
-			return j;
+		ringCount++;
 	}
 
-	return -1;
+	return true;
 }
 
-bool PointInsideRing(const Ring& ring, const osmp::Node& point)
+bool PointInsideRing(const Ring& ring, const NodeCoord& point)
 {
-	const osmp::Node& rightestNode = *(std::max_element(ring.nodes.begin(), ring.nodes.end(), cmp));
-	
-	int intersections = 0;
-	for (auto it = ring.nodes.begin(); it != ring.nodes.end(); it++)
+	if (!ring.bounds.Contains(point.lon, point.lat))
+		return false;
+
+	// Count the edges crossed by a ray going right from the point
+	bool inside = false;
+	for (size_t i = 0, j = ring.nodes.size() - 1; i < ring.nodes.size(); j = i++)
 	{
-		const osmp::Node& jt = ((it == ring.nodes.end() - 1) ? ring.nodes.front() : *(it + 1));
-		intersections += Intersect((*it)->GetLon(), (*it)->GetLat(),
-			jt->GetLon(), jt->GetLat(), 
-			point->GetLon(), point->GetLat(), 
-			rightestNode->GetLon() + 1.0f, point->GetLat()
-		);
+		const NodeCoord& a = ring.nodes[i];
+		const NodeCoord& b = ring.nodes[j];
+		if ((a.lat > point.lat) != (b.lat > point.lat) &&
+			point.lon < (b.lon - a.lon) * (point.lat - a.lat) / (b.lat - a.lat) + a.lon)
+		{
+			inside = !inside;
+		}
 	}
 
-	return (intersections % 2 != 0);
+	return inside;
 }
 
 bool IsRingContained(const Ring& r1, const Ring& r2)
@@ -848,73 +502,122 @@ bool IsRingContained(const Ring& r1, const Ring& r2)
 	//{
 	//	for (auto jt = r2.nodes.begin(); jt != r2.nodes.end(); jt++)
 	//	{
-	//		osmp::Node n1 = ((it == r1.nodes.end() - 1) ? r1.nodes.front() : *(it + 1));
-	//		osmp::Node n2 = ((jt == r2.nodes.end() - 1) ? r2.nodes.front() : *(jt + 1));
+	//		NodeCoord n1 = ((it == r1.nodes.end() - 1) ? r1.nodes.front() : *(it + 1));
+	//		NodeCoord n2 = ((jt == r2.nodes.end() - 1) ? r2.nodes.front() : *(jt + 1));
 
 	//		if (Intersect(*it, n1, *jt, n2))
 	//			return false;
 	//	}
 	//}
 
+	// A contained ring has to fit into the bounding box of its container
+	if (!r1.bounds.Contains(r2.bounds))
+		return false;
+
 	if (PointInsideRing(r1, r2.nodes.front()))
 		return true;
 
 	return false;
 }
 
-bool GroupRings(std::vector<RingGroup>& ringGroups, std::vector<Ring>& rings)
+bool GroupRings(ScratchVector<RingGroup>& ringGroups, ScratchVector<Ring>& rings)
 {
-	const std::vector<Ring> original = rings;
-
 	//RG-1
 	int ringNum = rings.size();
-	std::vector<bool> containmentMatrix(ringNum * ringNum);
-
+	std::vector<Box> bounds(ringNum);
 	for (int i = 0; i < ringNum; i++)
 	{
-		for (int j = 0; j < ringNum; j++)
+		Ring& ring = rings[i];
+		ring.bounds = { ring.nodes.front().lon, ring.nodes.front().lat, ring.nodes.front().lon, ring.nodes.front().lat };
+		for (const NodeCoord& node : ring.nodes)
 		{
-			if (i == j) {
-				containmentMatrix[INDEXOF(i, j, ringNum)] = false;
+			ring.bounds.minX = std::min(ring.bounds.minX, node.lon);
+			ring.bounds.minY = std::min(ring.bounds.minY, node.lat);
+			ring.bounds.maxX = std::max(ring.bounds.maxX, node.lon);
+			ring.bounds.maxY = std::max(ring.bounds.maxY, node.lat);
+		}
+
+		bounds[i] = ring.bounds;
+	}
+
+	// Only rings whose bounding box contains the first node of another ring can contain it
+	ScratchVector<ScratchVector<int>> containers(ringNum);	// Rings containing ring i
+	ScratchVector<ScratchVector<int>> contained(ringNum);	// Rings contained by ring i
+	SpatialIndex index(bounds);
+	std::vector<uint32_t> candidates;
+	for (int j = 0; j < ringNum; j++)
+	{
+		candidates.clear();
+		index.Query(rings[j].nodes.front().lon, rings[j].nodes.front().lat, candidates);
+		for (uint32_t i : candidates)
+		{
+			if (i == j)
 				continue;
-			}
 
-			containmentMatrix[INDEXOF(i, j, ringNum)] = IsRingContained(rings[i], rings[j]);
+			if (IsRingContained(rings[i], rings[j]))
+			{
+				containers[j].push_back(i);
+				contained[i].push_back(j);
+			}
 		}
 	}
-	
+
+	// Rings whose containers have all been used up are ready to become outer rings, lowest index first
+	ScratchVector<int> unusedContainers(ringNum);
+	ScratchVector<bool> used(ringNum, false);
+	std::priority_queue<int, ScratchVector<int>, std::greater<int>> ready;
+	for (int j = 0; j < ringNum; j++)
+	{
+		unusedContainers[j] = containers[j].size();
+		if (unusedContainers[j] == 0)
+			ready.push(j);
+	}
+
+	auto use = [&](int ring) {
+		used[ring] = true;
+		for (int j : contained[ring])
+		{
+			if (--unusedContainers[j] == 0 && !used[j])
+				ready.push(j);
+		}
+	};
+
 	// RG-2 / RG-3
-	while (!rings.empty())	// TODO: Make this time out
+	int remaining = ringNum;
+	while (remaining > 0)
 	{
-		int uncontainedRing = FindUncontainedRing(containmentMatrix, ringNum, rings);
-		if (uncontainedRing == -1) {
+		while (!ready.empty() && used[ready.top()])
+			ready.pop();
+
+		if (ready.empty()) {
 			std::cerr << "Failed to find uncontained ring in step RG-2" << std::endl;
-			return false;
-		}
-		auto it = std::find_if(rings.begin(), rings.end(), [uncontainedRing](const Ring& ring) { return (ring.index == uncontainedRing); });
-		if (it == rings.end())
-		{
-			std::cerr << "Uncontained Ring is out of range" << std::endl;
+			rings.clear();
 			return false;
 		}
 
-		ringGroups.push_back({ {*it} });
-		rings.erase(it);
+		int uncontainedRing = ready.top();
+		ready.pop();
+		use(uncontainedRing);
+		remaining--;
 
+		ringGroups.push_back({});
+		ringGroups.back().rings.push_back(std::move(rings[uncontainedRing]));
 
 		// RG-4
-		std::vector<int> containedRings;
-		FindAllContainedRingsThatArentContainedByUnusedRings(containmentMatrix, uncontainedRing, ringNum, rings, containedRings);
-
-		for (auto it = rings.begin(); it != rings.end(); ) {
-			if (std::find(containedRings.begin(), containedRings.end(), it->index) != containedRings.end()) {
-				ringGroups.back().rings.push_back(*it);
-				ringGroups.back().rings.back().hole = true;
-				it = rings.erase(it);
-			}
-			else {
-				it++;
-			}
+		ScratchVector<int> containedRings;
+		for (int j : contained[uncontainedRing])
+		{
+			if (!used[j] && unusedContainers[j] == 0)
+				containedRings.push_back(j);
+		}
+
+		for (int j : containedRings)
+		{
+			use(j);
+			remaining--;
+
+			ringGroups.back().rings.push_back(std::move(rings[j]));
+			ringGroups.back().rings.back().hole = true;
 		}
 
 		// TODO: RG-5 / RG-6 will be left out for now as they're optional. 
@@ -922,5 +625,6 @@ bool GroupRings(std::vector<RingGroup>& ringGroups, std::vector<Ring>& rings)
 
 	}
 
+	rings.clear();
 	return true;
 }
@@ -1,32 +1,54 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <osmp.hpp>
+#include "OsmData.hpp"
+#include "Geometry.hpp"
+#include "Style.hpp"
+#include "Projection.hpp"
+#include "span.hpp"
+
+class MapCache;
+class MapArena;
+class TriangulationCache;
 
 class Multipolygon
 {
+	friend class MapCache;
+	friend class MapArena;
+	friend class RegionStore;
+
 public:
-	Multipolygon(const osmp::Relation& relation, int width, int height, const osmp::Bounds& bounds);
+	// The polygons are packed into the geometry store, which has to outlive the multipolygon.
+	// With a triangulation cache, relations found in it aren't triangulated again and new ones are added to it
+	Multipolygon(uint64_t id, const Style& style, const std::vector<RelationMember>& members, const World& world, GeometryStore& geometry, TriangulationCache* cache = nullptr);
 
 	void SetColor(int r, int g, int b);
-	void Draw();
+
+	uint64_t Id() const { return id; }
+
+	// Drops the polygons, all that's left of a relation that was deleted or rebuilt somewhere else
+	void Clear() { polygons.clear(); }
 
 	bool operator < (const Multipolygon& other) const {
 		return (rendering < other.rendering);
 	}
 
 private:
-	struct Vertex {
-		double x, y;
-	};
+	Multipolygon() = default;	// Only used when loading from a MapCache
+
+	void AddPolygon(GeometryStore& geometry, Span<const Vector2d> points, Span<const int> triangles, Span<const int> segments, Span<const int> rings);
+
 	struct Polygon {
-		std::vector<Vertex> vertices;
-		std::vector<int> indices;
-		std::vector<int> segments;
+		PackedPoints vertices;
+		PackedIndices indices;
+		PackedIndices segments;
+		PackedIndices rings;		// Where every ring starts in segments, the first ring is the outer one
 	};
 
-	std::vector<Polygon> polygons;
+	std::vector<Polygon> polygons;	// Point into a GeometryStore or a mapped cache file
 	int r;
 	int g;
 	int b;
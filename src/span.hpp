@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Non-owning view over a contiguous array, so geometry can live either in
+// a std::vector or directly inside a memory mapped cache file
+template<typename T>
+struct Span
+{
+	T* data = nullptr;
+	size_t count = 0;
+
+	size_t size() const { return count; }
+	bool empty() const { return (count == 0); }
+
+	T* begin() const { return data; }
+	T* end() const { return data + count; }
+
+	T& operator[](size_t i) const { return data[i]; }
+};
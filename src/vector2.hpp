@@ -1,3 +1,5 @@
+#pragma once
+
 template<typename T>
 struct Vector2D
 {
@@ -5,4 +7,5 @@ struct Vector2D
 };
 
 typedef Vector2D<float> Vector2f;
+typedef Vector2D<double> Vector2d;
 typedef Vector2D<int>   Vector2i;
\ No newline at end of file
@@ -0,0 +1,160 @@
+// Builds a tiny arena on the CPU and checks its layout: which draw ranges the features end up in, where their indices
+// start, what the vertices are and how the detail levels line up. Exits with 1 if anything is off
+#include <iostream>
+#include <vector>
+
+#include "MapArena.hpp"
+#include "Geometry.hpp"
+#include "ThreadPool.hpp"
+
+static int failures = 0;
+
+static void Expect(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+static PackedPoints Points(GeometryStore& geometry, const std::vector<Vector2d>& points)
+{
+	return geometry.AddPoints(points.data(), points.size());
+}
+
+static bool SameColor(const MapArena::DrawRange& range, int r, int g, int b)
+{
+	return (range.r == r && range.g == g && range.b == b);
+}
+
+int main()
+{
+	ThreadPool pool(2);
+	GeometryStore geometry;
+
+	// A square of 1 km around the center of the map, a single closed way
+	osmp::Bounds bounds = { -0.01, -0.01, 0.01, 0.01 };
+	World world(bounds);
+	NodeList outer = { { 1, -0.0045, -0.0045 }, { 2, 0.0045, -0.0045 }, { 3, 0.0045, 0.0045 }, { 4, -0.0045, 0.0045 }, { 1, -0.0045, -0.0045 } };
+	std::vector<RelationMember> members = { { &outer, false } };
+
+	std::vector<Multipolygon> multipolygons;
+	multipolygons.emplace_back(1, Style{ 0, 200, 0, Style::FILL, true }, members, world, geometry);
+
+	// Two red buildings that share a range and a blue one. Closed ways repeat their first point
+	std::vector<Area> buildings(3);
+	buildings[0].points = Points(geometry, { { 0, 0 }, { 10, 0 }, { 10, 10 }, { 0, 10 }, { 0, 0 } });
+	buildings[1].points = Points(geometry, { { 20, 0 }, { 30, 0 }, { 30, 10 }, { 20, 10 }, { 20, 0 } });
+	buildings[2].points = Points(geometry, { { 40, 0 }, { 50, 0 }, { 50, 10 }, { 40, 10 }, { 40, 0 } });
+	buildings[0].r = buildings[1].r = 255;
+	buildings[0].g = buildings[1].g = buildings[0].b = buildings[1].b = 0;
+	buildings[2].r = buildings[2].g = 0;
+	buildings[2].b = 255;
+
+	// A straight road with a point every meter, simplifying leaves only its ends. A single point has nothing to draw
+	std::vector<Vector2d> points;
+	for (int i = 0; i <= 10; i++)
+		points.push_back({ (double)i, 20.0 });
+
+	std::vector<Highway> highways(2);
+	highways[0].points = Points(geometry, points);
+	highways[1].points = Points(geometry, { { 5, 5 } });
+	for (Highway& highway : highways)
+	{
+		highway.r = 128;
+		highway.g = 128;
+		highway.b = 128;
+	}
+
+	MapArena arena;
+	arena.Build(multipolygons, buildings, highways, pool);
+	Expect(arena.Check(), "the arena checks out");
+
+	// One range per layer and color, the layers in draw order
+	Span<const MapArena::DrawRange> ranges = arena.Ranges(0);
+	Expect(ranges.size() == 4, "four draw ranges");
+	if (ranges.size() != 4)
+		return 1;
+
+	Expect(ranges[0].layer == MapArena::FILLED_AREAS && ranges[0].primitive == MapArena::DrawRange::TRIANGLES && SameColor(ranges[0], 0, 200, 0),
+		"the multipolygon is a green filled area");
+	Expect(ranges[1].layer == MapArena::BUILDINGS && ranges[1].primitive == MapArena::DrawRange::TRIANGLES && SameColor(ranges[1], 255, 0, 0),
+		"the red buildings come next");
+	Expect(ranges[2].layer == MapArena::BUILDINGS && SameColor(ranges[2], 0, 0, 255), "then the blue building");
+	Expect(ranges[3].layer == MapArena::HIGHWAYS && ranges[3].primitive == MapArena::DrawRange::LINES && SameColor(ranges[3], 128, 128, 128),
+		"the highway is drawn last, as lines");
+
+	// Two triangles per building, one line per road segment. The ranges follow each other in the index buffer
+	Expect(ranges[0].count == 6, "the square multipolygon is two triangles");
+	Expect(ranges[1].count == 12, "both red buildings are in one range");
+	Expect(ranges[2].count == 6, "the blue building is two triangles");
+	Expect(ranges[3].count == 20, "the road is ten lines at full detail");
+	for (size_t i = 0; i < ranges.size(); i++)
+		Expect(ranges[i].first == (i == 0 ? 0 : ranges[i - 1].first + ranges[i - 1].count), "ranges start where the one before ends");
+
+	// The single point highway is left out
+	Span<const MapArena::Feature> features = arena.Features(0);
+	Expect(features.size() == 5, "five features");
+	if (features.size() != 5)
+		return 1;
+
+	const uint32_t expectedRanges[5] = { 0, 1, 1, 2, 3 };
+	for (size_t i = 0; i < features.size(); i++)
+	{
+		const MapArena::Feature& feature = features[i];
+		Expect(feature.range == expectedRanges[i], "features are in draw order");
+		for (uint32_t j = feature.first; j < feature.first + feature.count; j++)
+		{
+			uint32_t index = arena.Indices()[j];
+			Expect(index >= feature.firstVertex && index < feature.firstVertex + feature.vertexCount, "indices only use the feature's own vertices");
+		}
+	}
+
+	// Buildings drop the repeated point, the road keeps every point as it is
+	const std::vector<MapArena::Vertex>& vertices = arena.Vertices();
+	Expect(features[1].vertexCount == 4 && features[2].vertexCount == 4 && features[3].vertexCount == 4, "buildings have four corners");
+	Expect(features[4].vertexCount == 11, "the road keeps all of its points");
+	bool corners = true;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		const MapArena::Vertex& vertex = vertices[features[2].firstVertex + i];
+		corners = corners && (vertex.x == 20.0f || vertex.x == 30.0f) && (vertex.y == 0.0f || vertex.y == 10.0f);
+	}
+	Expect(corners, "the second building is where it was put");
+	bool road = true;
+	for (uint32_t i = 0; i < 11; i++)
+		road = road && vertices[features[4].firstVertex + i].x == (float)i && vertices[features[4].firstVertex + i].y == 20.0f;
+	Expect(road, "the road's vertices are its points in order");
+
+	// Every level has the same ranges and features, each level's slice starts where the one before ends
+	uint32_t levelStart = 0;
+	for (int level = 0; level < LOD_LEVELS; level++)
+	{
+		Span<const MapArena::DrawRange> levelRanges = arena.Ranges(level);
+		Span<const MapArena::Feature> levelFeatures = arena.Features(level);
+		Expect(levelRanges.size() == ranges.size() && levelFeatures.size() == features.size(), "every level has the same ranges and features");
+		if (levelRanges.size() != ranges.size() || levelFeatures.size() != features.size())
+			break;
+
+		Expect(levelRanges[0].first == levelStart, "a level starts where the one before ends");
+		for (size_t i = 0; i < levelRanges.size(); i++)
+			Expect(levelRanges[i].layer == ranges[i].layer && SameColor(levelRanges[i], ranges[i].r, ranges[i].g, ranges[i].b), "levels share their ranges");
+		for (size_t i = 0; i < levelFeatures.size(); i++)
+		{
+			Expect(levelFeatures[i].range == features[i].range, "features stay in their range on every level");
+			Expect(levelFeatures[i].firstVertex == features[i].firstVertex && levelFeatures[i].vertexCount == features[i].vertexCount, "levels share the vertices");
+		}
+
+		// Past full detail the straight road is a single line
+		if (level > 0)
+			Expect(levelRanges[3].count == 2, "the simplified road is a single line");
+
+		levelStart = levelRanges[levelRanges.size() - 1].first + levelRanges[levelRanges.size() - 1].count;
+	}
+	Expect(levelStart == arena.Indices().size(), "the levels cover the whole index buffer");
+
+	if (failures == 0)
+		std::cout << "Arena layout is as expected" << std::endl;
+	return (failures == 0) ? 0 : 1;
+}